@@ -0,0 +1,61 @@
+#!/usr/bin/env python3
+
+# Compares two result files of SoftwareRendererBench --kernels --json path, e.g. of the build
+# before and after an optimization. Prints the change of every kernel and fails when one got
+# slower than the threshold or computes something else (different checksum).
+#
+# Example: ./bench_compare.py out/bench/before.json out/bench/after.json --threshold 10
+
+import sys
+import json
+import argparse
+
+
+def load_benchmarks(path):
+	with open(path) as bench_file:
+		results = json.load(bench_file)
+	return results["context"], {benchmark["name"]: benchmark for benchmark in results["benchmarks"]}
+
+
+def main():
+	parser = argparse.ArgumentParser(description="SoftwareRendererBench kernel comparison")
+	parser.add_argument("baseline")
+	parser.add_argument("contender")
+	parser.add_argument("--threshold", type=float, default=10.0, help="slowdown of the median in percent that counts as regression")
+	args = parser.parse_args()
+
+	baseline_context, baseline = load_benchmarks(args.baseline)
+	contender_context, contender = load_benchmarks(args.contender)
+
+	for key in sorted(set(baseline_context) | set(contender_context)):
+		if baseline_context.get(key) != contender_context.get(key):
+			print("context {}: {} -> {}".format(key, baseline_context.get(key), contender_context.get(key)))
+
+	header = "{:<32} {:>12} {:>12} {:>9}  {}".format("kernel", "base ns", "new ns", "change", "")
+	print(header)
+	print("-" * len(header))
+
+	failed = False
+	for name in baseline:
+		if name not in contender:
+			print("{:<32} missing".format(name))
+			continue
+
+		before = baseline[name]["nanosecondsPerItem"]
+		after = contender[name]["nanosecondsPerItem"]
+		change = 100.0 * (after - before) / before
+
+		notes = []
+		if change > args.threshold:
+			notes.append("REGRESSION")
+		if baseline[name]["checksum"] != contender[name]["checksum"]:
+			notes.append("checksum differs")
+		failed = failed or len(notes) > 0
+
+		print("{:<32} {:>12.3f} {:>12.3f} {:>+8.1f}%  {}".format(name, before, after, change, ", ".join(notes)))
+
+	sys.exit(1 if failed else 0)
+
+
+if __name__ == "__main__":
+	main()
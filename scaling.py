@@ -0,0 +1,184 @@
+#!/usr/bin/env python3
+
+# Scaling benchmark of the SoftwareRenderer: generates scenes of growing size with the
+# SceneGenerator, renders them with a fixed sample count for every thread count and reports
+# the scene setup time, the pixel samples per second and the peak resident memory. With --stats
+# the renderer also writes its traversal counters, which add the stats columns to the CSV.
+#
+# Example: ./scaling.py --mode labyrinth --sizes 4 8 16 32 --threads 1 4 16
+#
+# The many_lights mode scales the light count (size^2 panel lights), e.g. compare
+# ./scaling.py --mode many_lights --next-event-estimation with and without --light-tree.
+
+import os
+import re
+import csv
+import json
+import argparse
+import subprocess
+
+
+SCENE_SETUP_REGEX = re.compile(r"Scene setup time: ([0-9.e+-]+) s, (\d+) objects")
+RENDER_TIME_REGEX = re.compile(r"Render time: ([0-9.e+-]+) s, (\d+) samples per pixel, ([0-9.e+-]+) samples/s")
+
+BUILD_PATH = "build"
+GENERATOR_EXECPATH = os.path.join(BUILD_PATH, "SceneGenerator")
+RENDERER_EXECPATH = os.path.join(BUILD_PATH, "SoftwareRenderer")
+OUT_PATH = os.path.join("out", "scaling")
+
+PATH_TRACER_TEMPLATE = """PathTracer
+	visionJumpCount({vision_jump_count})
+	raysPerPixel({samples})
+	nextEventEstimation({next_event_estimation})
+	lightTree({light_tree})
+"""
+
+CSV_KEYS = [
+	"mode", "size", "objects", "threads", "samples", "width", "height",
+	"setup_time", "render_time", "samples_per_second", "peak_rss_mb", "wall_time",
+]
+
+STATS_CSV_KEYS = [
+	"load_time", "bvh_build_time", "write_time", "rays_per_second", "primary_rays_per_second",
+	"nodes_per_ray", "triangle_tests_per_ray", "average_path_depth", "max_path_depth",
+]
+
+
+def saveCSV(path, data):
+	with open(path, "w", newline="") as output_file:
+		dict_writer = csv.DictWriter(output_file, CSV_KEYS + STATS_CSV_KEYS)
+		dict_writer.writeheader()
+		dict_writer.writerows(data)
+
+
+def run_measured(args):
+	# os.wait4 returns the resource usage of exactly this child, ru_maxrss is in KiB on Linux
+	process = subprocess.Popen(args, stdout=subprocess.PIPE, stderr=subprocess.STDOUT)
+	output = process.stdout.read().decode()
+	_, status, usage = os.wait4(process.pid, 0)
+	process.stdout.close()
+
+	if os.waitstatus_to_exitcode(status) != 0:
+		raise RuntimeError("{} failed:\n{}".format(" ".join(args), output[-2000:]))
+
+	return output, usage
+
+
+def generate_scene(mode, size, seed):
+	scene_dir = os.path.join(OUT_PATH, "scenes")
+	os.makedirs(scene_dir, exist_ok=True)
+
+	scene_path = os.path.join(scene_dir, "{}_{}.scene".format(mode, size))
+	camera_path = os.path.join(scene_dir, "{}_{}.camera".format(mode, size))
+	subprocess.run([GENERATOR_EXECPATH, mode, str(size), scene_path, camera_path, "--seed", str(seed)], check=True, stdout=subprocess.DEVNULL)
+
+	return scene_path, camera_path
+
+
+def read_stats(stats_path):
+	with open(stats_path) as stats_file:
+		stats = json.load(stats_file)
+
+	return {
+		"load_time": stats["phases"]["load"],
+		"bvh_build_time": stats["phases"]["bvhBuild"],
+		"write_time": stats["phases"]["write"],
+		"rays_per_second": stats["raysPerSecond"],
+		"primary_rays_per_second": stats["primaryRaysPerSecond"],
+		"nodes_per_ray": stats["total"]["nodesPerRay"],
+		"triangle_tests_per_ray": stats["total"]["triangleTestsPerRay"],
+		"average_path_depth": stats["total"]["averagePathDepth"],
+		"max_path_depth": stats["total"]["maxPathDepth"],
+	}
+
+
+def render(renderer_path, scene_path, camera_path, width, height, threads, stats, extra_args):
+	image_path = os.path.join(OUT_PATH, "image.ppm")
+	stats_path = os.path.join(OUT_PATH, "stats.json")
+	args = [RENDERER_EXECPATH, renderer_path, scene_path, str(width), str(height), str(threads), camera_path, image_path] + extra_args
+	if stats:
+		args += ["--stats", stats_path]
+
+	wall_start = os.times().elapsed
+	output, usage = run_measured(args)
+	wall_time = os.times().elapsed - wall_start
+
+	setup = SCENE_SETUP_REGEX.search(output)
+	render = RENDER_TIME_REGEX.search(output)
+	if setup is None or render is None:
+		raise RuntimeError("could not find the timings in the output of {}:\n{}".format(" ".join(args), output[-2000:]))
+
+	result = {
+		"objects": int(setup.group(2)),
+		"setup_time": float(setup.group(1)),
+		"render_time": float(render.group(1)),
+		"samples": int(render.group(2)),
+		"samples_per_second": float(render.group(3)),
+		"peak_rss_mb": usage.ru_maxrss / 1024.0,
+		"wall_time": wall_time,
+	}
+	if stats:
+		result.update(read_stats(stats_path))
+
+	return result
+
+
+def print_table(results):
+	header = "{:>12} {:>6} {:>8} {:>7} {:>10} {:>11} {:>14} {:>10}".format(
+		"mode", "size", "objects", "threads", "setup [s]", "render [s]", "samples/s", "RSS [MB]")
+	print(header)
+	print("-" * len(header))
+	for result in results:
+		line = "{:>12} {:>6} {:>8} {:>7} {:>10.4f} {:>11.3f} {:>14.0f} {:>10.1f}".format(
+			result["mode"], result["size"], result["objects"], result["threads"],
+			result["setup_time"], result["render_time"], result["samples_per_second"], result["peak_rss_mb"])
+		if "nodes_per_ray" in result:
+			line += "  {:.1f} nodes/ray, {:.1f} triangles/ray".format(result["nodes_per_ray"], result["triangle_tests_per_ray"])
+		print(line)
+
+
+def main():
+	parser = argparse.ArgumentParser(description="SoftwareRenderer scaling benchmark")
+	parser.add_argument("--mode", choices=["labyrinth", "cornell_box", "many_lights"], default="labyrinth")
+	parser.add_argument("--sizes", type=int, nargs="+", default=[4, 8, 16, 32])
+	parser.add_argument("--threads", type=int, nargs="+", default=[os.cpu_count()])
+	parser.add_argument("--samples", type=int, default=16)
+	parser.add_argument("--vision-jump-count", type=int, default=5)
+	parser.add_argument("--next-event-estimation", action="store_true", help="sample the light sources at every diffuse vertex")
+	parser.add_argument("--light-tree", action="store_true", help="pick the light sources through the light tree, needs --next-event-estimation")
+	parser.add_argument("--width", type=int, default=320)
+	parser.add_argument("--height", type=int, default=240)
+	parser.add_argument("--repeat", type=int, default=1, help="runs per configuration, the fastest one is reported")
+	parser.add_argument("--seed", type=int, default=42)
+	parser.add_argument("--stats", action="store_true", help="let the renderer count rays, traversed nodes and triangle tests")
+	parser.add_argument("--csv", default=os.path.join(OUT_PATH, "scaling.csv"))
+	parser.add_argument("renderer_args", nargs=argparse.REMAINDER, help="passed on to SoftwareRenderer after --")
+	args = parser.parse_args()
+
+	extra_args = [arg for arg in args.renderer_args if arg != "--"]
+
+	os.makedirs(OUT_PATH, exist_ok=True)
+	renderer_path = os.path.join(OUT_PATH, "path_tracer.renderer")
+	with open(renderer_path, "w") as f:
+		f.write(PATH_TRACER_TEMPLATE.format(vision_jump_count=args.vision_jump_count, samples=args.samples,
+			next_event_estimation=int(args.next_event_estimation), light_tree=int(args.light_tree)))
+
+	results = []
+	for size in args.sizes:
+		scene_path, camera_path = generate_scene(args.mode, size, args.seed)
+
+		for threads in args.threads:
+			runs = [render(renderer_path, scene_path, camera_path, args.width, args.height, threads, args.stats, extra_args) for _ in range(args.repeat)]
+			result = min(runs, key=lambda run: run["render_time"])
+			result.update({"mode": args.mode, "size": size, "threads": threads, "width": args.width, "height": args.height})
+			results.append(result)
+			print("{} size {} with {} threads: {:.0f} samples/s".format(args.mode, size, threads, result["samples_per_second"]), flush=True)
+
+	print()
+	print_table(results)
+	saveCSV(args.csv, results)
+	print("\nResults written to {}".format(args.csv))
+
+
+if __name__ == "__main__":
+	main()
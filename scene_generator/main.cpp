@@ -0,0 +1,287 @@
+#include <iostream>
+#include <fstream>
+#include <random>
+#include <vector>
+#include <string>
+#include <cmath>
+#include <algorithm>
+
+#define GENERATOR_SEED 42
+#define LABYRINTH_SPACING 2.0f
+#define LABYRINTH_CAMERA_HEIGHT 60.0f
+#define CORNELL_BOX_FILL 0.6f
+#define MANY_LIGHTS_SPACING 2.0f
+#define MANY_LIGHTS_CAMERA_HEIGHT 0.6f
+
+
+struct Object {
+	std::string mesh;
+	float position[3];
+	float scale[3];
+	float rotation[4];
+	float color[3];
+	float lightSource;
+	float diffuse;
+	float reflect;
+	float transparent;
+};
+
+Object createObject(const std::string& mesh, float x, float y, float z) {
+	return {mesh, {x, y, z}, {1.0f, 1.0f, 1.0f}, {0.0f, 1.0f, 0.0f, 0.0f}, {1.0f, 1.0f, 1.0f}, 0.0f, 1.0f, 0.0f, 0.0f};
+}
+
+static void setRotation(Object& obj, float x, float y, float z, float angle) {
+	obj.rotation[0] = x;
+	obj.rotation[1] = y;
+	obj.rotation[2] = z;
+	obj.rotation[3] = angle;
+}
+
+void writeObject(std::ostream& out, const Object& obj) {
+	out << obj.mesh << "\n";
+	out << "\tposition(" << obj.position[0] << ", " << obj.position[1] << ", " << obj.position[2] << ")\n";
+	if (obj.scale[0] != 1.0f || obj.scale[1] != 1.0f || obj.scale[2] != 1.0f) {
+		out << "\tscale(" << obj.scale[0] << ", " << obj.scale[1] << ", " << obj.scale[2] << ")\n";
+	}
+	if (obj.rotation[3] != 0.0f) {
+		out << "\trotation(" << obj.rotation[0] << ", " << obj.rotation[1] << ", " << obj.rotation[2] << ", " << obj.rotation[3] << ")\n";
+	}
+	if (obj.color[0] != 1.0f || obj.color[1] != 1.0f || obj.color[2] != 1.0f) {
+		out << "\tcolor(" << obj.color[0] << ", " << obj.color[1] << ", " << obj.color[2] << ")\n";
+	}
+	if (obj.diffuse != 1.0f || obj.reflect != 0.0f || obj.transparent != 0.0f) {
+		out << "\tdiffuse(" << obj.diffuse << ")\n";
+		out << "\treflect(" << obj.reflect << ")\n";
+		out << "\ttransparent(" << obj.transparent << ")\n";
+		out << "\trefractionIndex(1.5)\n";
+	}
+	if (obj.lightSource > 0.0f) out << "\tlightSource(" << obj.lightSource << ")\n";
+	out << "\n";
+}
+
+void writeCamera(std::ostream& out, float x, float y, float z, float theta, float phi) {
+	out << "Camera\n";
+	out << "\tposition(" << x << ", " << y << ", " << z << ")\n";
+	out << "#\ttheta (left, right), phi (up, down)\n";
+	out << "\tangle(" << theta << ", " << phi << ")\n";
+}
+
+// Like res/scene/labyrinth.scene, which is size 12: a maze of size x size cells on a grid of
+// blocks, every free grid position holds a small light ball.
+std::vector<Object> createLabyrinth(unsigned int size, std::mt19937& rng) {
+	unsigned int gridSize = 2 * size + 1;
+	std::vector<bool> free(gridSize * gridSize, false);
+
+	// randomized depth first search over the cells, which sit at the odd grid positions
+	std::vector<unsigned int> stack = {0};
+	std::vector<bool> visited(size * size, false);
+	visited[0] = true;
+	free[gridSize + 1] = true;
+
+	while (!stack.empty()) {
+		unsigned int cell = stack.back();
+		unsigned int cx = cell % size, cy = cell / size;
+
+		std::vector<unsigned int> neighbours;
+		if (cx > 0        && !visited[cell - 1])    neighbours.push_back(cell - 1);
+		if (cx + 1 < size && !visited[cell + 1])    neighbours.push_back(cell + 1);
+		if (cy > 0        && !visited[cell - size]) neighbours.push_back(cell - size);
+		if (cy + 1 < size && !visited[cell + size]) neighbours.push_back(cell + size);
+
+		if (neighbours.empty()) {
+			stack.pop_back();
+			continue;
+		}
+
+		unsigned int next = neighbours[std::uniform_int_distribution<size_t>(0, neighbours.size() - 1)(rng)];
+		unsigned int nx = next % size, ny = next / size;
+		free[(cy + ny + 1) * gridSize + (cx + nx + 1)] = true;
+		free[(2 * ny + 1) * gridSize + (2 * nx + 1)] = true;
+		visited[next] = true;
+		stack.push_back(next);
+	}
+
+	float offset = -LABYRINTH_SPACING * float(size);
+	std::vector<Object> objects;
+
+	Object floor = createObject("panel.obj", 0.0f, -1.0f, 0.0f);
+	floor.scale[1] = floor.scale[2] = 2.5f * LABYRINTH_SPACING * float(gridSize);
+	setRotation(floor, 0.0f, 0.0f, 1.0f, 1.57079f);
+	objects.push_back(floor);
+
+	for (unsigned int y = 0; y < gridSize; ++y) {
+		for (unsigned int x = 0; x < gridSize; ++x) {
+			float px = offset + LABYRINTH_SPACING * float(x);
+			float pz = offset + LABYRINTH_SPACING * float(y);
+
+			if (!free[y * gridSize + x]) {
+				objects.push_back(createObject("block.obj", px, 0.0f, pz));
+			} else {
+				Object light = createObject("ball.obj", px, 0.0f, pz);
+				light.scale[0] = light.scale[1] = light.scale[2] = 0.1f;
+				light.lightSource = 5.0f;
+				objects.push_back(light);
+			}
+		}
+	}
+
+	return objects;
+}
+
+// The Cornell box of res/scene/cornell_box_with_blocks_and_ball.scene filled with count
+// randomly placed blocks and balls, their size shrinks so they fill about the same volume.
+std::vector<Object> createCornellBox(unsigned int count, std::mt19937& rng) {
+	std::vector<Object> objects;
+
+	Object walls[6] = {
+		createObject("panel.obj", -1.0f,  0.0f,  0.0f),
+		createObject("panel.obj",  1.0f,  0.0f,  0.0f),
+		createObject("panel.obj",  0.0f, -1.0f,  0.0f),
+		createObject("panel.obj",  0.0f,  1.0f,  0.0f),
+		createObject("panel.obj",  0.0f,  0.0f, -1.0f),
+		createObject("panel.obj",  0.0f,  0.0f,  1.0f),
+	};
+	float wallRotations[6][4] = {{0, 1, 0, 0}, {0, 1, 0, 3.14159f}, {0, 0, 1, 1.57079f}, {0, 0, 1, -1.57079f}, {0, 1, 0, -1.57079f}, {0, 1, 0, 1.57079f}};
+	float wallColors[6][3] = {{1, 1, 1}, {1, 1, 1}, {1, 1, 1}, {1, 1, 1}, {0, 1, 0}, {1, 0, 0}};
+	for (unsigned int i = 0; i < 6; ++i) {
+		std::copy(wallRotations[i], wallRotations[i] + 4, walls[i].rotation);
+		std::copy(wallColors[i], wallColors[i] + 3, walls[i].color);
+		objects.push_back(walls[i]);
+	}
+
+	std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+	float maxScale = CORNELL_BOX_FILL / std::cbrt(float(std::max(1u, count)));
+
+	for (unsigned int i = 0; i < count; ++i) {
+		bool ball = unit(rng) < 0.5f;
+		float scale = maxScale * (0.5f + 0.5f * unit(rng));
+		float range = 0.95f - scale;
+
+		Object obj = createObject(ball ? "ball.obj" : "block.obj",
+			range * (2.0f * unit(rng) - 1.0f), range * (2.0f * unit(rng) - 1.0f), range * (2.0f * unit(rng) - 1.0f));
+		obj.scale[0] = obj.scale[1] = obj.scale[2] = scale;
+		if (!ball) setRotation(obj, 0.0f, 1.0f, 0.0f, float(2.0 * M_PI) * unit(rng));
+		for (unsigned int c = 0; c < 3; ++c) obj.color[c] = 0.2f + 0.8f * unit(rng);
+
+		float material = unit(rng);
+		if (material > 0.9f) {
+			obj.diffuse = 0.0f;
+			obj.transparent = 1.0f;
+		} else if (material > 0.75f) {
+			obj.diffuse = 0.0f;
+			obj.reflect = 1.0f;
+		}
+
+		objects.push_back(obj);
+	}
+
+	Object light = createObject("ball.obj", 0.0f, 0.85f, 0.0f);
+	light.scale[0] = light.scale[1] = light.scale[2] = 0.1f;
+	light.lightSource = 1.0f;
+	objects.push_back(light);
+
+	return objects;
+}
+
+// A floor with size x size small panel lights facing down at random heights above it, with
+// random colors and about one block per four lights that casts shadows. Only a few lights are
+// close to any point, the light count grows with size^2 while the scene area grows alike.
+std::vector<Object> createManyLights(unsigned int size, std::mt19937& rng) {
+	std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+	float extent = MANY_LIGHTS_SPACING * float(size);
+	float offset = -0.5f * extent + 0.5f * MANY_LIGHTS_SPACING;
+	std::vector<Object> objects;
+
+	Object floor = createObject("panel.obj", 0.0f, -1.0f, 0.0f);
+	floor.scale[1] = floor.scale[2] = 0.5f * extent + MANY_LIGHTS_SPACING;
+	setRotation(floor, 0.0f, 0.0f, 1.0f, 1.57079f);
+	objects.push_back(floor);
+
+	for (unsigned int i = 0; i < size * size / 4; ++i) {
+		Object block = createObject("block.obj", extent * (unit(rng) - 0.5f), -0.7f, extent * (unit(rng) - 0.5f));
+		block.scale[0] = block.scale[1] = block.scale[2] = 0.3f;
+		setRotation(block, 0.0f, 1.0f, 0.0f, float(2.0 * M_PI) * unit(rng));
+		objects.push_back(block);
+	}
+
+	for (unsigned int y = 0; y < size; ++y) {
+		for (unsigned int x = 0; x < size; ++x) {
+			float jitter = 0.5f * MANY_LIGHTS_SPACING;
+			Object light = createObject("panel.obj",
+				offset + MANY_LIGHTS_SPACING * float(x) + jitter * (unit(rng) - 0.5f),
+				0.0f + 1.0f * unit(rng),
+				offset + MANY_LIGHTS_SPACING * float(y) + jitter * (unit(rng) - 0.5f));
+			light.scale[1] = light.scale[2] = 0.3f + 0.3f * unit(rng);
+			setRotation(light, 0.0f, 0.0f, 1.0f, -1.57079f);
+			for (unsigned int c = 0; c < 3; ++c) light.color[c] = 0.3f + 0.7f * unit(rng);
+			light.lightSource = 1.0f;
+			objects.push_back(light);
+		}
+	}
+
+	return objects;
+}
+
+int main(int argc, char* argv[]) {
+	if (argc < 4) {
+		std::cout << "Error: wrong paramter count!" << std::endl;
+		std::cout << "Usage: SceneGenerator labyrinth|cornell_box|many_lights size scene [camera] [--seed number]" << std::endl;
+		std::cout << "  labyrinth    maze of size x size cells, about 4 size^2 objects" << std::endl;
+		std::cout << "  cornell_box  Cornell box with size random blocks and balls" << std::endl;
+		std::cout << "  many_lights  floor below size x size panel lights" << std::endl;
+		return -1;
+	}
+
+	std::string mode = argv[1];
+	unsigned int size = (unsigned int) std::max(1, std::atoi(argv[2]));
+	std::string scenePath = argv[3];
+	std::string cameraPath;
+	uint64_t seed = GENERATOR_SEED;
+
+	for (int i = 4; i < argc; ++i) {
+		std::string option = argv[i];
+		if (option == "--seed" && i + 1 < argc) seed = std::stoull(argv[++i]);
+		else if (cameraPath.empty() && option.rfind("--", 0) != 0) cameraPath = option;
+		else {
+			std::cout << "Error: unknown option \"" << option << "\"!" << std::endl;
+			return -1;
+		}
+	}
+
+	std::mt19937 rng(seed);
+	std::vector<Object> objects;
+	if      (mode == "labyrinth")   objects = createLabyrinth(size, rng);
+	else if (mode == "cornell_box") objects = createCornellBox(size, rng);
+	else if (mode == "many_lights") objects = createManyLights(size, rng);
+	else {
+		std::cout << "Error: unknown mode \"" << mode << "\"!" << std::endl;
+		return -1;
+	}
+
+	std::ofstream sceneFile(scenePath);
+	if (!sceneFile.is_open()) {
+		std::cout << "Error: could not write \"" << scenePath << "\"!" << std::endl;
+		return -1;
+	}
+	sceneFile << "# SceneGenerator " << mode << " " << size << " --seed " << seed << "\n\n";
+	for (const Object& obj: objects) writeObject(sceneFile, obj);
+
+	if (!cameraPath.empty()) {
+		std::ofstream cameraFile(cameraPath);
+		if (mode == "labyrinth") {
+			// res/camera/labyrinth.camera scaled with the labyrinth
+			writeCamera(cameraFile, 0.0f, LABYRINTH_CAMERA_HEIGHT * float(2 * size + 1) / 25.0f, 0.0f, 1.0f, -1.0f);
+		} else if (mode == "many_lights") {
+			// looking down at the floor from behind the edge, over the whole grid
+			float extent = MANY_LIGHTS_SPACING * float(size);
+			writeCamera(cameraFile, 0.0f, MANY_LIGHTS_CAMERA_HEIGHT * extent + 1.0f, 0.7f * extent + 1.0f, 1.5f, -0.4f);
+		} else {
+			writeCamera(cameraFile, 3.4f, 0.0f, 0.0f, 1.0f, 0.0f);
+		}
+	}
+
+	size_t lightCount = std::count_if(objects.begin(), objects.end(), [](const Object& obj) { return obj.lightSource > 0.0f; });
+	std::cout << "Wrote " << objects.size() << " objects (" << lightCount << " light sources) to " << scenePath << std::endl;
+
+	return 0;
+}
@@ -0,0 +1,73 @@
+#include "binary_file.h"
+
+#include <filesystem>
+#include <unistd.h>
+
+
+// every process writes its own temporary file, so parallel writers of the same path never share one
+BinaryWriter::BinaryWriter(const std::string& path)
+:path(path), tmpPath(path + "." + std::to_string(getpid()) + ".tmp"), file(tmpPath, std::ios::out | std::ios::binary), position(0), committed(false) {}
+
+BinaryWriter::~BinaryWriter() {
+	if (committed) return;
+
+	file.close();
+	std::error_code error;
+	std::filesystem::remove(tmpPath, error);
+}
+
+bool BinaryWriter::isOpen() const {
+	return file.is_open();
+}
+
+bool BinaryWriter::commit() {
+	file.close();
+	if (!file) return false;
+
+	std::error_code error;
+	std::filesystem::rename(tmpPath, path, error);
+	committed = !error;
+	return committed;
+}
+
+void BinaryWriter::writeBytes(const void* data, size_t size) {
+	file.write(static_cast<const char*>(data), size);
+	position += size;
+}
+
+void BinaryWriter::pad() {
+	static const char zeros[BINARY_FILE_ALIGNMENT] = {};
+	writeBytes(zeros, (BINARY_FILE_ALIGNMENT - position % BINARY_FILE_ALIGNMENT) % BINARY_FILE_ALIGNMENT);
+}
+
+
+BinaryReader::BinaryReader(const char* data, size_t size)
+:data(data), size(size), position(0), valid(true) {}
+
+BinaryReader::~BinaryReader() {}
+
+bool BinaryReader::isValid() const {
+	return valid;
+}
+
+void BinaryReader::invalidate() {
+	valid = false;
+}
+
+void BinaryReader::readBytes(void* target, size_t count) {
+	if (!valid || count > size - position) {
+		valid = false;
+		return;
+	}
+	if (count > 0) std::memcpy(target, data + position, count);
+	position += count;
+}
+
+void BinaryReader::skipPadding() {
+	size_t padding = (BINARY_FILE_ALIGNMENT - position % BINARY_FILE_ALIGNMENT) % BINARY_FILE_ALIGNMENT;
+	if (padding > size - position) {
+		valid = false;
+		return;
+	}
+	position += padding;
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <cstring>
+#include <cstdint>
+
+#define BINARY_FILE_ALIGNMENT 64
+
+
+// Writes plain values and arrays to a temporary file that replaces the target on commit,
+// so readers never see a partially written file. Arrays are stored as a 64 bit count
+// followed by the elements, aligned to BINARY_FILE_ALIGNMENT within the file.
+class BinaryWriter {
+	public:
+		BinaryWriter(const std::string& path);
+		~BinaryWriter();
+
+		bool isOpen() const;
+		bool commit();
+
+		template<typename T>
+		void write(const T& value) {
+			writeBytes(&value, sizeof(T));
+		}
+
+		template<typename T>
+		void writeArray(const std::vector<T>& values) {
+			write(uint64_t(values.size()));
+			pad();
+			writeBytes(values.data(), values.size() * sizeof(T));
+		}
+
+	private:
+		void writeBytes(const void* data, size_t size);
+		void pad();
+
+		std::string path;
+		std::string tmpPath;
+		std::ofstream file;
+		size_t position;
+		bool committed;
+};
+
+// Reads what BinaryWriter wrote from memory, usually a MappedFile. Reading past the end
+// leaves the values untouched and marks the reader invalid instead of throwing.
+class BinaryReader {
+	public:
+		BinaryReader(const char* data, size_t size);
+		~BinaryReader();
+
+		bool isValid() const;
+		// for data that was read completely but is inconsistent
+		void invalidate();
+
+		template<typename T>
+		T read() {
+			T value{};
+			readBytes(&value, sizeof(T));
+			return value;
+		}
+
+		template<typename T>
+		void readArray(std::vector<T>& values) {
+			uint64_t count = read<uint64_t>();
+			skipPadding();
+			if (!valid || count > (size - position) / sizeof(T)) {
+				valid = false;
+				return;
+			}
+			values.resize(count);
+			readBytes(values.data(), count * sizeof(T));
+		}
+
+	private:
+		void readBytes(void* data, size_t size);
+		void skipPadding();
+
+		const char* data;
+		size_t size;
+		size_t position;
+		bool valid;
+};
@@ -1,20 +1,28 @@
 #include "bidirectional_path_tracer.h"
 
+#include "../render_stats.h"
+
 #define SURFACE_DISTANCE_OFFSET 0.01f
 
 
-BidirectionalPathTracer::BidirectionalPathTracer()
-:rng(new RandomGenerator()) {}
+BidirectionalPathTracer::BidirectionalPathTracer() {}
 
-BidirectionalPathTracer::~BidirectionalPathTracer() {
-	delete rng;
-}
+BidirectionalPathTracer::~BidirectionalPathTracer() {}
 
 void BidirectionalPathTracer::parseInput(const InputEntry& inputEntry) {
 	visionJumpCount = inputEntry.get<unsigned int>("visionJumpCount");
 	lightJumpCount  = inputEntry.get<unsigned int>("lightJumpCount");
 	maxDepth        = inputEntry.get<unsigned int>("maxDepth");
 	raysPerPixel    = inputEntry.get<unsigned int>("raysPerPixel");
+	lightTree = inputEntry.keyExists("lightTree") && inputEntry.get<unsigned int>("lightTree") != 0;
+}
+
+unsigned int BidirectionalPathTracer::getRaysPerPixel() const {
+	return raysPerPixel;
+}
+
+bool BidirectionalPathTracer::usesLightTree() const {
+	return lightTree;
 }
 
 Vector3f BidirectionalPathTracer::renderPixel(const PixelRenderData& prd) const {
@@ -28,8 +36,11 @@ Vector3f BidirectionalPathTracer::renderPixel(const PixelRenderData& prd) const
 	std::vector<HitPoint> visionPath(visionJumpCount);
 	std::vector<HitPoint> lightPath(lightJumpCount);
 	Ray startVisionRay(prd.origin, direction);
-	for (unsigned int i = 0; i < raysPerPixel; ++i) {
-		uint visionPathDepth = traceSinglePath(prd, visionPath, startVisionRay, 0, visionJumpCount, false);
+	Scene::RayHit primaryHit;
+	if (prd.sampleCount > 0 && visionJumpCount > 0) primaryHit = tracePrimaryRay(prd, startVisionRay);
+	for (unsigned int i = 0; i < prd.sampleCount; ++i) {
+		uint visionPathDepth = traceSinglePath(prd, visionPath, startVisionRay, 0, visionJumpCount, false, &primaryHit);
+		RenderStats::addPath(visionPathDepth);
 
 		if (visionPathDepth == 0) continue;
 
@@ -38,9 +49,13 @@ Vector3f BidirectionalPathTracer::renderPixel(const PixelRenderData& prd) const
 			continue;
 		}
 
-		LightSourcePoint lsp = getRandomLightSourcePoint(prd);
-		Ray startLightRay(lsp.pos, rng->randomNormalDirection(lsp.normal));
-		lightPath[0].pos = startLightRay.origin;
+		if (prd.lightSampler->empty()) continue;
+
+		LightSourcePoint lsp;
+		if (!getRandomLightSourcePoint(prd, primaryHit.vertex, lsp)) continue;
+		Vector3f lightDirection = prd.rng->randomNormalDirection(lsp.normal);
+		Ray startLightRay(lsp.pos + SURFACE_DISTANCE_OFFSET * lightDirection, lightDirection);
+		lightPath[0].pos = lsp.pos;
 		lightPath[0].normal = lsp.normal;
 		lightPath[0].cumulativeColor = lsp.color;
 		lightPath[0].diffuse = true;
@@ -56,6 +71,7 @@ Vector3f BidirectionalPathTracer::renderPixel(const PixelRenderData& prd) const
 				Vector3f startPos = visionPath[vi].pos + SURFACE_DISTANCE_OFFSET * visionPath[vi].normal;
 				Vector3f endPos = lightPath[li].pos + SURFACE_DISTANCE_OFFSET * lightPath[li].normal;
 
+				RenderStats::add(RenderStats::ShadowRays, 1);
 				bool occluded = prd.scene->isOccluded(startPos, endPos);
 				if (!occluded) {
 					Vector3f direction = endPos - startPos;
@@ -74,12 +90,12 @@ Vector3f BidirectionalPathTracer::renderPixel(const PixelRenderData& prd) const
 		if (done) finalColor += color * (1.0f / float(maxDepth));
 	}
 	
-	finalColor *= 2.0f * M_PI * (1.0f / float(raysPerPixel));
+	finalColor *= 2.0f * M_PI;
 
 	return finalColor;
 }
 
-size_t BidirectionalPathTracer::traceSinglePath(const PixelRenderData& prd, std::vector<HitPoint>& path, Ray ray, size_t startDepth, size_t maxDepth, bool isLightRay) const {
+size_t BidirectionalPathTracer::traceSinglePath(const PixelRenderData& prd, std::vector<HitPoint>& path, Ray ray, size_t startDepth, size_t maxDepth, bool isLightRay, const Scene::RayHit* firstHit) const {
 	Vector3f color = Vector3f({1.0f, 1.0f, 1.0f});
 	size_t pathDepth = 0;
 
@@ -88,7 +104,17 @@ size_t BidirectionalPathTracer::traceSinglePath(const PixelRenderData& prd, std:
 	bool backfaceCulling = !isLightRay;
 
 	for (size_t i = startDepth; i < maxDepth; ++i) {
-		if (!prd.scene->traceRay(ray, hitVertex, obj)) {
+		bool hit;
+		if (i == startDepth && firstHit != nullptr) {
+			hit = firstHit->obj != nullptr;
+			hitVertex = firstHit->vertex;
+			obj = firstHit->obj;
+		} else {
+			RenderStats::add(i == 0 && !isLightRay ? RenderStats::PrimaryRays : RenderStats::SecondaryRays, 1);
+			hit = prd.scene->traceRay(ray, hitVertex, obj);
+		}
+
+		if (!hit) {
 			break;
 		} else {
 			float ndotd = hitVertex.normal.dot(ray.direction);
@@ -99,11 +125,11 @@ size_t BidirectionalPathTracer::traceSinglePath(const PixelRenderData& prd, std:
 			backfaceCulling = false;
 
 			pathDepth = i + 1;
-			float rayHandlingValue = rng->rand();
+			float rayHandlingValue = prd.rng->rand();
 
 			Vector3f prevDirection = ray.direction;
 			if (rayHandlingValue <= obj->diffuseThreshold) {
-				ray.direction = rng->randomNormalDirection(hitVertex.normal);
+				ray.direction = prd.rng->randomNormalDirection(hitVertex.normal);
 			} else if (rayHandlingValue <= obj->reflectThreshold) {
 				ray.direction = reflect(ray.direction, hitVertex.normal);
 			} else if (rayHandlingValue <= obj->transparentThreshold) {
@@ -137,32 +163,29 @@ size_t BidirectionalPathTracer::traceSinglePath(const PixelRenderData& prd, std:
 	return pathDepth;
 }
 
-BidirectionalPathTracer::LightSourcePoint BidirectionalPathTracer::getRandomLightSourcePoint(const PixelRenderData& prd) const {
-	size_t lightIndex = rng->rand() * float(prd.lightSources->size());
-	GraphicsObject* lightSource = prd.lightSources->at(lightIndex);
-
-	float sqrtr1 = sqrt(rng->rand());
-	float r2 = rng->rand();
-	Vector3f barycentricCoords({1.0f - sqrtr1, sqrtr1 * (1.0f - r2), sqrtr1 * r2});
-
-	size_t ti = rng->rand() * float(lightSource->triangles.size());
-	Triangle& t = lightSource->triangles[ti];
-
-	LightSourcePoint lsp;
-
-	lsp.pos = t.v0 * barycentricCoords[0] + t.v1 * barycentricCoords[1] + t.v2 * barycentricCoords[2];
+bool BidirectionalPathTracer::getRandomLightSourcePoint(const PixelRenderData& prd, const Mesh::Vertex& visionVertex, LightSourcePoint& lsp) const {
+	LightSampler::Sample sample;
+	float pdf;
+	if (lightTree) {
+		// The light path reaches every vision vertex, not only the camera hit the tree is guided
+		// by, so the other half samples by power and keeps the pdf of every light above 0.
+		bool treeSample = prd.rng->rand() < 0.5f;
+		sample = treeSample ? prd.lightTree->sample(prd.rng, visionVertex.pos, visionVertex.normal) : prd.lightSampler->sample(prd.rng);
+		if (sample.pdf <= 0.0f) return false;
+
+		pdf = 0.5f * prd.lightTree->getPdf(visionVertex.pos, visionVertex.normal, sample.obj, sample.triangleIndex);
+		pdf += 0.5f * prd.lightSampler->getPdf(sample.obj, sample.triangleIndex);
+	} else {
+		sample = prd.lightSampler->sample(prd.rng);
+		pdf = sample.pdf;
+	}
 
-	const Mesh::Vertex& vert0 = lightSource->vertices[t.indices[0]];
-	const Mesh::Vertex& vert1 = lightSource->vertices[t.indices[1]];
-	const Mesh::Vertex& vert2 = lightSource->vertices[t.indices[2]];
-	lsp.normal = Vector3f({0.0f, 0.0f, 0.0f});
-	lsp.normal += barycentricCoords[0] * vert0.normal;
-	lsp.normal += barycentricCoords[1] * vert1.normal;
-	lsp.normal += barycentricCoords[2] * vert2.normal;
-	lsp.normal.normalize();
+	lsp.pos = sample.pos;
+	lsp.normal = sample.normal;
 
-	lsp.color = lightSource->color;
-	lsp.lightStrength = lightSource->lightStrength;
+	// relative to picking a point uniformly on all light sources
+	lsp.color = sample.obj->color * (1.0f / (pdf * prd.lightSampler->getTotalArea()));
+	lsp.lightStrength = sample.obj->lightStrength;
 
-	return lsp;
+	return true;
 }
@@ -3,7 +3,6 @@
 #include <vector>
 
 #include "renderer.h"
-#include "../math/random.h"
 
 
 class BidirectionalPathTracer: public Renderer {
@@ -12,7 +11,9 @@ class BidirectionalPathTracer: public Renderer {
 		~BidirectionalPathTracer();
 
 		virtual void parseInput(const InputEntry& inputEntry) override;
+		virtual unsigned int getRaysPerPixel() const override;
 		virtual Vector3f renderPixel(const PixelRenderData& prd) const override;
+		virtual bool usesLightTree() const override;
 	
 	private:
 		struct LightSourcePoint {
@@ -30,13 +31,15 @@ class BidirectionalPathTracer: public Renderer {
 			bool lightHit;
 		};
 
-		RandomGenerator* rng;
-
 		unsigned int visionJumpCount;
 		unsigned int lightJumpCount;
 		unsigned int maxDepth;
 		unsigned int raysPerPixel;
+		// half of the light paths start at a light the light tree picks for the camera hit
+		bool lightTree;
 
-		size_t traceSinglePath(const PixelRenderData& prd, std::vector<HitPoint>& path, Ray ray, size_t startDepth, size_t maxDepth, bool isLightRay) const;
-		LightSourcePoint getRandomLightSourcePoint(const PixelRenderData& prd) const;
+		// firstHit replaces tracing the ray at startDepth when given
+		size_t traceSinglePath(const PixelRenderData& prd, std::vector<HitPoint>& path, Ray ray, size_t startDepth, size_t maxDepth, bool isLightRay, const Scene::RayHit* firstHit=nullptr) const;
+		// false when no light source was picked, visionVertex guides the light tree
+		bool getRandomLightSourcePoint(const PixelRenderData& prd, const Mesh::Vertex& visionVertex, LightSourcePoint& lsp) const;
 };
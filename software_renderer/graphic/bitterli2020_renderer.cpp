@@ -0,0 +1,296 @@
+#include "bitterli2020_renderer.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "../init_exception.h"
+#include "../render_stats.h"
+
+#define SURFACE_DISTANCE_OFFSET 0.01f
+// the spatial reuse merges the reservoirs of the (2r + 1)^2 pixels around a pixel
+#define SPATIAL_REUSE_RADIUS 1
+// neighbours whose normals differ by more than ~25 degrees or whose distance to the camera
+// differs by more than 10% are not reused
+#define NEIGHBOUR_NORMAL_THRESHOLD 0.906f
+#define NEIGHBOUR_DISTANCE_THRESHOLD 0.1f
+// the previous reservoirs are clamped to this many times the candidates of a frame, so old
+// samples cannot dominate forever
+#define TEMPORAL_HISTORY_LIMIT 20
+
+
+static bool isSimilarSurface(const Vector3f& normal, float distance, const Vector3f& otherNormal, float otherDistance) {
+	return normal.dot(otherNormal) >= NEIGHBOUR_NORMAL_THRESHOLD && std::abs(distance - otherDistance) <= NEIGHBOUR_DISTANCE_THRESHOLD * distance;
+}
+
+Bitterli2020::Bitterli2020() {}
+
+Bitterli2020::~Bitterli2020() {}
+
+void Bitterli2020::parseInput(const InputEntry& inputEntry) {
+	visionJumpCount = inputEntry.get<unsigned int>("visionJumpCount");
+	candidateCount  = inputEntry.get<unsigned int>("candidateCount");
+	sampleCount     = inputEntry.get<unsigned int>("sampleCount");
+	raysPerPixel = inputEntry.keyExists("raysPerPixel") ? inputEntry.get<unsigned int>("raysPerPixel") : 1;
+	if (sampleCount == 0) throw InitException("Bitterli2020", "sampleCount has to be at least 1");
+}
+
+unsigned int Bitterli2020::getRaysPerPixel() const {
+	return raysPerPixel;
+}
+
+unsigned int Bitterli2020::getStageCount() const {
+	return 2;
+}
+
+void Bitterli2020::beginPass(const PixelRenderData& prd) {
+	size_t pixelCount = size_t(prd.imageSize[0]) * prd.imageSize[1];
+	if (surfaces.size() == pixelCount) {
+		std::swap(surfaces, previousSurfaces);
+		return;
+	}
+
+	Surface empty;
+	empty.diffuse = false;
+	surfaces.assign(pixelCount, empty);
+	previousSurfaces.assign(pixelCount, empty);
+	reservoirs.assign(pixelCount * sampleCount, createReservoir());
+	history.assign(pixelCount * sampleCount, createReservoir());
+}
+
+Vector3f Bitterli2020::renderPixel(const PixelRenderData& prd) const {
+	if (prd.stage == 0) {
+		createReservoirs(prd);
+		return Vector3f({0.0f, 0.0f, 0.0f});
+	}
+	return shadePixel(prd);
+}
+
+Bitterli2020::Reservoir Bitterli2020::createReservoir() {
+	Reservoir r;
+	r.targetPdf = 0.0f;
+	r.weightSum = 0.0f;
+	r.M = 0;
+	r.W = 0.0f;
+	return r;
+}
+
+// M is the number of candidates x stands for, 1 for a new one and the M of a reservoir when merging
+bool Bitterli2020::updateReservoir(Reservoir& r, RandomGenerator* rng, const LightSampler::Sample& x, float targetPdf, float weight, uint32_t M) {
+	r.M += M;
+	if (weight <= 0.0f) return false;
+	r.weightSum += weight;
+	if (rng->rand() * r.weightSum > weight) return false;
+	r.y = x;
+	r.targetPdf = targetPdf;
+	return true;
+}
+
+Ray Bitterli2020::getStartRay(const PixelRenderData& prd) const {
+	Vector2f pixelCenter = Vector2f({(float) prd.pixel[0], (float) prd.pixel[1]}) + Vector2f({0.5f, 0.5f});
+	Vector2f inUV = Vector2f({pixelCenter[0] / (float) prd.imageSize[0], pixelCenter[1] / (float) prd.imageSize[1]});
+	Vector2f d = (2.0f * inUV) - Vector2f({1.0f, 1.0f});
+	Vector3f target = cutVector(prd.projInverse * Vector4f({d[0], d[1], 1.0f, 1.0f})).normalize();
+	Vector3f direction = cutVector(prd.viewInverse * expandVector(target, 0.0f)).normalize();
+
+	return Ray(prd.origin, direction);
+}
+
+// Follows the camera ray like the PathTracer does until it reaches a diffuse vertex or a light
+// source, the surface colors and the light emission are in the units of the PathTracer.
+Bitterli2020::Surface Bitterli2020::traceSurface(const PixelRenderData& prd) const {
+	Surface surface;
+	surface.emission = Vector3f({0.0f, 0.0f, 0.0f});
+	surface.diffuse = false;
+
+	Ray ray = getStartRay(prd);
+	Vector3f throughput({1.0f, 1.0f, 1.0f});
+	float distance = 0.0f;
+	bool backfaceCulling = true;
+	size_t pathDepth = 0;
+
+	for (size_t depth = 0; depth < visionJumpCount; ++depth) {
+		Scene::RayHit hit;
+		if (depth == 0) {
+			hit = tracePrimaryRay(prd, ray);
+		} else {
+			RenderStats::add(RenderStats::SecondaryRays, 1);
+			prd.scene->traceRay(ray, hit);
+		}
+		if (hit.obj == nullptr) break;
+
+		const Mesh::Vertex& hitVertex = hit.vertex;
+		const GraphicsObject* obj = hit.obj;
+		distance += hitVertex.pos.distance(ray.origin);
+		float ndotd = hitVertex.normal.dot(ray.direction);
+		if (backfaceCulling && ndotd > 0.0f) {
+			ray.origin = hitVertex.pos + SURFACE_DISTANCE_OFFSET * ray.direction;
+			continue;
+		}
+		backfaceCulling = false;
+		pathDepth = depth + 1;
+
+		if (obj->lightSource && ndotd <= 0.0f) {
+			surface.emission = throughput * getLightEmission(obj) * (2.0f * M_PI);
+			break;
+		}
+
+		float rayHandlingValue = prd.rng->rand();
+		if (rayHandlingValue <= obj->diffuseThreshold) {
+			surface.pos = hitVertex.pos;
+			surface.normal = hitVertex.normal;
+			surface.color = throughput * obj->color;
+			surface.distance = distance;
+			surface.diffuse = true;
+			break;
+		} else if (rayHandlingValue <= obj->reflectThreshold) {
+			ray.direction = reflect(ray.direction, hitVertex.normal);
+		} else if (rayHandlingValue <= obj->transparentThreshold) {
+			ray.direction = customRefract(ray.direction, hitVertex.normal, obj->refractionIndex);
+		}
+		ray.origin = hitVertex.pos + SURFACE_DISTANCE_OFFSET * ray.direction;
+		ray.update();
+	}
+
+	RenderStats::addPath(pathDepth);
+	return surface;
+}
+
+// Stage one: resamples the candidates into the reservoirs of the pixel, drops the picked points
+// that are shadowed and merges every reservoir with the one of the previous pass.
+void Bitterli2020::createReservoirs(const PixelRenderData& prd) const {
+	size_t pixelIndex = prd.pixel[0] + size_t(prd.pixel[1]) * prd.imageSize[0];
+	Surface& surface = surfaces[pixelIndex];
+	surface = traceSurface(prd);
+
+	const Surface& previousSurface = previousSurfaces[pixelIndex];
+	bool temporalReuse = surface.diffuse && previousSurface.diffuse
+		&& isSimilarSurface(surface.normal, surface.distance, previousSurface.normal, previousSurface.distance);
+	unsigned int frameCandidateCount = std::max(1u, candidateCount / sampleCount);
+
+	for (unsigned int s = 0; s < sampleCount; ++s) {
+		Reservoir& result = reservoirs[pixelIndex * sampleCount + s];
+		result = createReservoir();
+		if (!surface.diffuse || prd.lightSampler->empty()) continue;
+
+		Reservoir r = createReservoir();
+		for (unsigned int i = 0; i < frameCandidateCount; ++i) {
+			LightSampler::Sample x = prd.lightSampler->sample(prd.rng);
+			float targetPdf = getTargetPdf(surface, x);
+			updateReservoir(r, prd.rng, x, targetPdf, targetPdf / x.pdf, 1);
+		}
+		if (r.weightSum > 0.0f) {
+			r.W = r.weightSum / (r.M * r.targetPdf);
+			if (isOccluded(prd, surface, r.y)) r.W = 0.0f;
+		}
+
+		if (!temporalReuse) {
+			result = r;
+			continue;
+		}
+
+		Reservoir previous = history[pixelIndex * sampleCount + s];
+		previous.M = std::min(previous.M, TEMPORAL_HISTORY_LIMIT * frameCandidateCount);
+		updateReservoir(result, prd.rng, r.y, r.targetPdf, r.targetPdf * r.W * r.M, r.M);
+		bool previousPicked = false;
+		if (previous.M > 0) {
+			float targetPdf = getTargetPdf(surface, previous.y);
+			previousPicked = updateReservoir(result, prd.rng, previous.y, targetPdf, targetPdf * previous.W * previous.M, previous.M);
+		}
+		if (result.weightSum <= 0.0f) continue;
+
+		// Only the reservoirs that could have picked y count, otherwise the merge is biased. Both
+		// dropped their shadowed picks, so the other one has to see y, the winner always does.
+		bool visible = true;
+		uint32_t Z = 0;
+		if (previousPicked) {
+			visible = !isOccluded(prd, surface, result.y);
+			Z = previous.M + (visible ? r.M : 0);
+		} else {
+			Z = r.M;
+			if (getTargetPdf(previousSurface, result.y) > 0.0f && !isOccluded(prd, previousSurface, result.y)) Z += previous.M;
+		}
+		result.W = visible ? result.weightSum / (Z * result.targetPdf) : 0.0f;
+	}
+}
+
+// Stage two: merges the reservoirs of the similar neighbours and shades the picked points. The
+// shadowed picks keep W = 0 in the history, like in stage one.
+Vector3f Bitterli2020::shadePixel(const PixelRenderData& prd) const {
+	size_t pixelIndex = prd.pixel[0] + size_t(prd.pixel[1]) * prd.imageSize[0];
+	const Surface& surface = surfaces[pixelIndex];
+	if (!surface.diffuse) return surface.emission;
+
+	std::vector<size_t> neighbours;
+	neighbours.reserve((2 * SPATIAL_REUSE_RADIUS + 1) * (2 * SPATIAL_REUSE_RADIUS + 1));
+	for (int dy = -SPATIAL_REUSE_RADIUS; dy <= SPATIAL_REUSE_RADIUS; ++dy) {
+		for (int dx = -SPATIAL_REUSE_RADIUS; dx <= SPATIAL_REUSE_RADIUS; ++dx) {
+			int x = int(prd.pixel[0]) + dx;
+			int y = int(prd.pixel[1]) + dy;
+			if (x < 0 || y < 0 || x >= int(prd.imageSize[0]) || y >= int(prd.imageSize[1])) continue;
+
+			size_t neighbourIndex = x + size_t(y) * prd.imageSize[0];
+			const Surface& neighbour = surfaces[neighbourIndex];
+			if (!neighbour.diffuse) continue;
+			if (neighbourIndex != pixelIndex && !isSimilarSurface(surface.normal, surface.distance, neighbour.normal, neighbour.distance)) continue;
+			neighbours.push_back(neighbourIndex);
+		}
+	}
+
+	Vector3f illumination({0.0f, 0.0f, 0.0f});
+	for (unsigned int s = 0; s < sampleCount; ++s) {
+		Reservoir result = createReservoir();
+		for (size_t n: neighbours) {
+			const Reservoir& r = reservoirs[n * sampleCount + s];
+			if (r.M == 0) continue;
+			float targetPdf = getTargetPdf(surface, r.y);
+			updateReservoir(result, prd.rng, r.y, targetPdf, targetPdf * r.W * r.M, r.M);
+		}
+
+		if (result.weightSum > 0.0f) {
+			// Stage one dropped the shadowed picks, so a neighbour could only have picked y if it
+			// sees it. Counting the others too would make Z too big and the shadow edges too dark.
+			bool visible = !isOccluded(prd, surface, result.y);
+			uint32_t Z = 0;
+			for (size_t n: neighbours) {
+				uint32_t M = reservoirs[n * sampleCount + s].M;
+				if (M == 0 || getTargetPdf(surfaces[n], result.y) <= 0.0f) continue;
+				if (n == pixelIndex ? visible : !isOccluded(prd, surfaces[n], result.y)) Z += M;
+			}
+
+			if (visible && Z > 0) {
+				result.W = result.weightSum / (Z * result.targetPdf);
+				illumination += getContribution(surface, result.y) * result.W;
+			} else {
+				result.W = 0.0f;
+			}
+		}
+
+		history[pixelIndex * sampleCount + s] = result;
+	}
+
+	return surface.emission + illumination / float(sampleCount);
+}
+
+Vector3f Bitterli2020::getContribution(const Surface& surface, const LightSampler::Sample& y) const {
+	Vector3f direction = y.pos - surface.pos;
+	float distanceSquared = direction.magnitudeSquared();
+	direction.normalize();
+
+	float cosSurface = surface.normal.dot(direction);
+	float cosLight = -y.normal.dot(direction);
+	if (distanceSquared <= 0.0f || cosSurface <= 0.0f || cosLight <= 0.0f) return Vector3f({0.0f, 0.0f, 0.0f});
+
+	return surface.color * getLightEmission(y.obj) * (cosSurface * cosLight / distanceSquared);
+}
+
+float Bitterli2020::getTargetPdf(const Surface& surface, const LightSampler::Sample& y) const {
+	Vector3f contribution = getContribution(surface, y);
+	return 0.2126f * contribution[0] + 0.7152f * contribution[1] + 0.0722f * contribution[2];
+}
+
+bool Bitterli2020::isOccluded(const PixelRenderData& prd, const Surface& surface, const LightSampler::Sample& y) const {
+	Vector3f startPos = surface.pos + SURFACE_DISTANCE_OFFSET * surface.normal;
+	Vector3f endPos = y.pos + SURFACE_DISTANCE_OFFSET * y.normal;
+	RenderStats::add(RenderStats::ShadowRays, 1);
+	return prd.scene->isOccluded(startPos, endPos);
+}
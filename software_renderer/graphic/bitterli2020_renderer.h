@@ -0,0 +1,72 @@
+#pragma once
+
+#include <vector>
+
+#include "renderer.h"
+
+
+// CPU version of the Bitterli2020 renderer (res/shader/bitterli2020*.glsl), reservoir based
+// spatiotemporal importance resampling of the direct light (Bitterli et al. 2020). Every pass
+// renders one frame in two stages: the first follows the camera ray to its first diffuse vertex,
+// resamples candidateCount light points into sampleCount reservoirs and merges them with the
+// reservoirs of the previous pass. The second merges the reservoirs of the 3x3 neighbours and
+// shades the light points they picked.
+class Bitterli2020: public Renderer {
+	public:
+		Bitterli2020();
+		~Bitterli2020();
+
+		virtual void parseInput(const InputEntry& inputEntry) override;
+		virtual unsigned int getRaysPerPixel() const override;
+		virtual unsigned int getStageCount() const override;
+		virtual void beginPass(const PixelRenderData& prd) override;
+		virtual Vector3f renderPixel(const PixelRenderData& prd) const override;
+
+	private:
+		struct Reservoir {
+			LightSampler::Sample y;
+			// the target function of y at the pixel of the reservoir
+			float targetPdf;
+			float weightSum;
+			uint32_t M;
+			float W;
+		};
+
+		// the first diffuse vertex of the camera path
+		struct Surface {
+			Vector3f pos;
+			Vector3f normal;
+			// the diffuse color times the throughput of the path up to it
+			Vector3f color;
+			// light sources the path ended in, the whole pixel when it did not reach a diffuse vertex
+			Vector3f emission;
+			float distance;
+			bool diffuse;
+		};
+
+		unsigned int visionJumpCount;
+		unsigned int candidateCount;
+		unsigned int sampleCount;
+		// frames, not a GPU parameter
+		unsigned int raysPerPixel;
+
+		// Filled by the stages of a pass, a pixel only writes its own elements. The reservoirs
+		// of a pass become the history of the next one.
+		mutable std::vector<Surface> surfaces;
+		mutable std::vector<Surface> previousSurfaces;
+		mutable std::vector<Reservoir> reservoirs;
+		mutable std::vector<Reservoir> history;
+
+		static Reservoir createReservoir();
+		// returns whether x replaced the pick of r
+		static bool updateReservoir(Reservoir& r, RandomGenerator* rng, const LightSampler::Sample& x, float targetPdf, float weight, uint32_t M);
+
+		Ray getStartRay(const PixelRenderData& prd) const;
+		Surface traceSurface(const PixelRenderData& prd) const;
+		void createReservoirs(const PixelRenderData& prd) const;
+		Vector3f shadePixel(const PixelRenderData& prd) const;
+		// the unshadowed light y sends over the surface to the camera
+		Vector3f getContribution(const Surface& surface, const LightSampler::Sample& y) const;
+		float getTargetPdf(const Surface& surface, const LightSampler::Sample& y) const;
+		bool isOccluded(const PixelRenderData& prd, const Surface& surface, const LightSampler::Sample& y) const;
+};
@@ -1,32 +1,112 @@
 #include "graphics_engine.h"
 
+#include <fstream>
+#include <filesystem>
+#include <cstdio>
+#include <limits>
+
+#include "../init_exception.h"
+
+#define STATS_REPORT_VERSION 1
+
 #define SURFACE_DISTANCE_OFFSET 0.01f
+#define CHECKPOINT_MAGIC 0x50435253 // "SRCP"
+#define CHECKPOINT_VERSION 2
+#define NOISE_MIN_LUMINANCE 0.001f
+
+
+void threadRender(GraphicsEngine* graphicsEngine, unsigned int threadIndex, const Matrix4f& viewInverse, const Matrix4f& projInverse, const Vector3f& origin) {
+	graphicsEngine->render(threadIndex, viewInverse, projInverse, origin);
+}
+
+static float getLuminance(const Vector3f& color) {
+	return 0.2126f * color[0] + 0.7152f * color[1] + 0.0722f * color[2];
+}
 
+template<typename T>
+void writeBinary(std::ofstream& file, const T* data, size_t count) {
+	file.write(reinterpret_cast<const char*>(data), count * sizeof(T));
+}
 
-void threadRender(GraphicsEngine* graphicsEngine, const Matrix4f& viewInverse, const Matrix4f& projInverse, const Vector3f& origin) {
-	graphicsEngine->render(viewInverse, projInverse, origin);
+template<typename T>
+void readBinary(std::ifstream& file, T* data, size_t count) {
+	file.read(reinterpret_cast<char*>(data), count * sizeof(T));
+}
+
+// the quotes and backslashes of paths would end the JSON string early
+std::string escapeJson(const std::string& text) {
+	std::string escaped;
+	escaped.reserve(text.size());
+	for (char c: text) {
+		if (c == '"' || c == '\\') {
+			escaped += '\\';
+			escaped += c;
+		} else if ((unsigned char) c < 0x20) {
+			char code[7];
+			std::snprintf(code, sizeof(code), "\\u%04x", (unsigned int) c);
+			escaped += code;
+		} else {
+			escaped += c;
+		}
+	}
+	return escaped;
+}
+
+static uint32_t getMortonCode(uint32_t x, uint32_t y) {
+	uint32_t code = 0;
+	for (uint32_t bit = 0; bit < 16; ++bit) {
+		code |= ((x >> bit) & 1) << (2 * bit + 0);
+		code |= ((y >> bit) & 1) << (2 * bit + 1);
+	}
+	return code;
 }
 
 
 GraphicsEngine::GraphicsEngine()
-:imageSize(), image(), camera(nullptr),
-objects(), lightSources(), scene(),
-threadCount(1), pixelCounter(0), renderer(nullptr) {}
+:imageSize(), image(), imagePath(), camera(nullptr),
+objects(), lightSources(), lightSampler(), lightTree(), scene(), seed(0),
+threadCount(1), tileSize(16), tiles(), tileQueues(), finishedTileCounter(0), bvhBuildMethod(BVH::BuildMethod::BinnedSAH), bvhReport(false), rayBatches(true),
+renderer(nullptr), sceneBuildTime(0.0f), renderTime(0.0f),
+samplesPerPass(0), timeBudget(0.0f), targetNoise(0.0f), maxSamples(0), checkpointPath(), checkpointInterval(60.0f), checkpointKey(0),
+accumulationBuffer(), passLuminanceSum(), passLuminanceSquareSum(), accumulatedSamples(0), passCount(0), passSampleStart(0), passSampleCount(0), passStage(0),
+threadStats() {}
 
 GraphicsEngine::~GraphicsEngine() {
 	if (renderer != nullptr) delete renderer;
 }
 
-void GraphicsEngine::init(Renderer* renderer, unsigned int threadCount) {
-	this->renderer = renderer;
-	this->threadCount = threadCount;
-
+void GraphicsEngine::initScene() {
+	auto start = std::chrono::steady_clock::now();
 	for (GraphicsObject* obj: objects) {
 		obj->init();
 		scene.addObject(obj);
 	}
-	scene.init();
+	scene.init(bvhBuildMethod);
+	sceneBuildTime = std::chrono::duration<float>(std::chrono::steady_clock::now() - start).count();
+
+	if (bvhReport) std::cout << "BVH scene " << scene.getBVHStats() << std::endl;
+}
+
+void GraphicsEngine::init(Renderer* renderer, unsigned int threadCount) {
+	this->renderer = renderer;
+	this->threadCount = threadCount;
+
 	image.resize(imageSize[0] * imageSize[1] * 3);
+	accumulationBuffer.assign(imageSize[0] * imageSize[1], Vector3f({0.0f, 0.0f, 0.0f}));
+	passLuminanceSum.assign(imageSize[0] * imageSize[1], 0.0f);
+	passLuminanceSquareSum.assign(imageSize[0] * imageSize[1], 0.0f);
+	accumulatedSamples = 0;
+	passCount = 0;
+	threadStats.assign(threadCount, RenderStats());
+	lightSampler.init(lightSources);
+	if (renderer->usesLightTree()) {
+		lightTree.init(lightSources);
+		if (bvhReport) {
+			LightTree::Stats stats = lightTree.getStats();
+			std::cout << "Light tree: " << stats.lightCount << " light triangles, " << stats.nodeCount << " nodes, depth " << stats.maxDepth << ", built in " << stats.buildTime << " s" << std::endl;
+		}
+	}
+	createTiles();
 }
 
 void GraphicsEngine::saveImage(const std::string path) {
@@ -39,59 +119,334 @@ void GraphicsEngine::saveImage(const std::string path) {
 	file.close();
 }
 
+void GraphicsEngine::writeStatsReport(const std::string& path, const std::string& scenePath, float loadTime, float bvhBuildTime, float writeTime) const {
+	std::ofstream file(path);
+	if (!file.is_open()) throw InitException("GraphicsEngine", "could not write stats report \"" + path + "\"!");
+
+	RenderStats total;
+	for (const RenderStats& stats: threadStats) total.add(stats);
+	float seconds = std::max(renderTime, 1e-6f);
+
+	file << "{\n";
+	file << "\t\"version\": " << STATS_REPORT_VERSION << ",\n";
+	file << "\t\"scene\": \"" << escapeJson(scenePath) << "\",\n";
+	file << "\t\"objects\": " << objects.size() << ",\n";
+	file << "\t\"imageSize\": [" << imageSize[0] << ", " << imageSize[1] << "],\n";
+	file << "\t\"threads\": " << threadCount << ",\n";
+	file << "\t\"samplesPerPixel\": " << accumulatedSamples << ",\n";
+	file << "\t\"phases\": {\n";
+	file << "\t\t\"load\": " << loadTime << ",\n";
+	file << "\t\t\"bvhBuild\": " << bvhBuildTime << ",\n";
+	file << "\t\t\"render\": " << renderTime << ",\n";
+	file << "\t\t\"write\": " << writeTime << "\n";
+	file << "\t},\n";
+	file << "\t\"raysPerSecond\": " << double(total.getRayCount()) / seconds << ",\n";
+	file << "\t\"primaryRaysPerSecond\": " << double(total.counters[RenderStats::PrimaryRays]) / seconds << ",\n";
+	file << "\t\"total\": ";
+	total.writeJson(file, "\t");
+	file << ",\n\t\"perThread\": [";
+	for (size_t t = 0; t < threadStats.size(); ++t) {
+		file << (t == 0 ? "\n\t\t" : ",\n\t\t");
+		threadStats[t].writeJson(file, "\t\t");
+	}
+	file << "\n\t]\n";
+	file << "}\n";
+
+	if (!file) throw InitException("GraphicsEngine", "could not write stats report \"" + path + "\"!");
+}
+
 void GraphicsEngine::render() {
 	Matrix4f viewInverse = camera->getViewMatrix().inverseMatrix();
 	Matrix4f projInverse = camera->getProjectionMatrix(float(imageSize[0]) / float(imageSize[1])).inverseMatrix();
 
 	Vector3f origin = cutVector(viewInverse * Vector4f({0.0f, 0.0f, 0.0f, 1.0f}));
 
-	pixelCounter = 0;
-	std::vector<std::thread> threads;
-	threads.reserve(threadCount);
+	unsigned int raysPerPixel = renderer->getRaysPerPixel();
+	unsigned int passSamples = samplesPerPass > 0 ? samplesPerPass : raysPerPixel;
+	if (renderer->getStageCount() > 1) passSamples = 1;
+	unsigned int sampleLimit = getSampleLimit();
+
+	auto start = std::chrono::steady_clock::now();
+	auto lastCheckpoint = start;
+	float elapsed = 0.0f;
+	unsigned int startSamples = accumulatedSamples;
+	std::string stopReason;
+
+	while (!isFinished(elapsed, stopReason)) {
+		unsigned int sampleCount = std::min(passSamples, sampleLimit - accumulatedSamples);
+
+		renderPass(sampleCount, viewInverse, projInverse, origin);
+
+		auto now = std::chrono::steady_clock::now();
+		elapsed = std::chrono::duration<float>(now - start).count();
+
+		if (samplesPerPass > 0 || renderer->getStageCount() > 1) {
+			std::cout << "pass " << passCount << ": " << accumulatedSamples << " samples per pixel";
+			if (passCount >= 2) std::cout << ", noise " << getNoiseEstimate();
+			std::cout << ", " << elapsed << " s" << std::endl;
+		}
+
+		if (!checkpointPath.empty() && std::chrono::duration<float>(now - lastCheckpoint).count() >= checkpointInterval) {
+			saveCheckpoint(checkpointPath);
+			resolveImage();
+			if (!imagePath.empty()) saveImage(imagePath);
+			lastCheckpoint = now;
+		}
+	}
+
+	if (timeBudget > 0.0f || targetNoise > 0.0f) std::cout << "Stopped by the " << stopReason << std::endl;
+	if (!checkpointPath.empty()) saveCheckpoint(checkpointPath);
+	resolveImage();
+	renderTime = elapsed;
+
+	// pixel samples, the camera ray of a pixel is traced once per pass, see --stats for the ray counts
+	double samples = double(imageSize[0]) * double(imageSize[1]) * double(accumulatedSamples - startSamples);
+	std::cout << "Render time: " << elapsed << " s, " << accumulatedSamples - startSamples << " samples per pixel, ";
+	std::cout << samples / std::max(elapsed, 1e-6f) << " samples/s" << std::endl;
+}
+
+void GraphicsEngine::renderPass(unsigned int sampleCount, const Matrix4f& viewInverse, const Matrix4f& projInverse, const Vector3f& origin) {
+	passSampleStart = accumulatedSamples;
+	passSampleCount = sampleCount;
+
+	Renderer::PixelRenderData prd = getPixelRenderData(viewInverse, projInverse, origin);
+	renderer->beginPass(prd);
+
+	for (passStage = 0; passStage < renderer->getStageCount(); ++passStage) {
+		// every thread starts on its own contiguous part of the Morton ordered tiles
+		tileQueues = std::vector<TileQueue>(threadCount);
+		for (unsigned int t = 0; t < threadCount; ++t) {
+			tileQueues[t].next = (tiles.size() * t) / threadCount;
+			tileQueues[t].end  = (tiles.size() * (t + 1)) / threadCount;
+		}
+		finishedTileCounter = 0;
+
+		std::vector<std::thread> threads;
+		threads.reserve(threadCount);
+
+		for (unsigned int t = 0; t < threadCount; ++t) {
+			threads.push_back(std::thread(threadRender, this, t, viewInverse, projInverse, origin));
+		}
 
-	for (unsigned int t = 0; t < threadCount; ++t) {
-		threads.push_back(std::thread(threadRender, this, viewInverse, projInverse, origin));
+		for (std::thread& th: threads) th.join();
 	}
 
-	for (std::thread& th: threads) th.join();
+	accumulatedSamples += sampleCount;
+	++passCount;
 }
 
-void GraphicsEngine::render(const Matrix4f& viewInverse, const Matrix4f& projInverse, const Vector3f& origin) {
-	uint32_t fullSize = imageSize[0] * imageSize[1];
-	uint32_t fullStep = fullSize / 100;
+void GraphicsEngine::render(unsigned int threadIndex, const Matrix4f& viewInverse, const Matrix4f& projInverse, const Vector3f& origin) {
+	uint32_t tileCount = tiles.size();
+	bool lastStage = passStage + 1 == renderer->getStageCount();
 
+	RandomGenerator rng;
+	Renderer::PixelRenderData prd = getPixelRenderData(viewInverse, projInverse, origin);
+	prd.rng = &rng;
+
+	std::vector<Vector3f> tileBuffer(tileSize * tileSize);
+
+	uint32_t tileIndex;
+	while (nextTile(threadIndex, tileIndex)) {
+		const Tile& tile = tiles[tileIndex];
+		uint32_t tileWidth = tile.end[0] - tile.start[0];
+
+		if (rayBatches) {
+			renderer->renderTile(prd, tile.start, tile.end, tileBuffer.data());
+		} else {
+			renderer->renderTilePixels(prd, tile.start, tile.end, tileBuffer.data());
+		}
+		if (!lastStage) continue;
+
+		// every pixel belongs to exactly one tile, so the buffers need no locking
+		for (uint32_t y = tile.start[1]; y < tile.end[1]; ++y) {
+			for (uint32_t x = tile.start[0]; x < tile.end[0]; ++x) {
+				const Vector3f& color = tileBuffer[(x - tile.start[0]) + (y - tile.start[1]) * tileWidth];
+				size_t i = x + y * imageSize[0];
+
+				accumulationBuffer[i] += color;
+
+				float passLuminance = getLuminance(color) / float(passSampleCount);
+				passLuminanceSum[i] += passLuminance;
+				passLuminanceSquareSum[i] += passLuminance * passLuminance;
+			}
+		}
+
+		uint32_t finished = finishedTileCounter.fetch_add(1) + 1;
+		unsigned int done = (100 * finished) / tileCount;
+		if (samplesPerPass == 0 && renderer->getStageCount() == 1 && done != (100 * (finished - 1)) / tileCount) {
+			std::cout << done << "% done" << std::endl;
+		}
+	}
+
+	// every thread writes only its own slot, once per stage
+	if (RenderStats::enabled) {
+		threadStats[threadIndex].add(RenderStats::local);
+		RenderStats::local = RenderStats();
+	}
+}
+
+Renderer::PixelRenderData GraphicsEngine::getPixelRenderData(const Matrix4f& viewInverse, const Matrix4f& projInverse, const Vector3f& origin) const {
 	Renderer::PixelRenderData prd;
 	prd.scene = &scene;
 	prd.objects = &objects;
 	prd.lightSources = &lightSources;
+	prd.lightSampler = &lightSampler;
+	prd.lightTree = &lightTree;
+	prd.rng = nullptr;
+	prd.seed = seed;
+	prd.sampleStart = passSampleStart;
+	prd.sampleCount = passSampleCount;
+	prd.stage = passStage;
 
 	prd.imageSize = imageSize;
 	prd.origin = origin;
 	prd.viewInverse = viewInverse;
 	prd.projInverse = projInverse;
+	return prd;
+}
 
-	while (true) {
-		uint32_t currentPixel = pixelCounter.fetch_add(1);
+void GraphicsEngine::createTiles() {
+	Vector2u tileCount({
+		(imageSize[0] + tileSize - 1) / tileSize,
+		(imageSize[1] + tileSize - 1) / tileSize
+	});
 
-		if (currentPixel >= fullSize) {
-			if (currentPixel == fullSize) std::cout << "100% done" << std::endl;
-			break;
-		}
+	std::vector<std::pair<uint32_t, Tile>> orderedTiles;
+	orderedTiles.reserve(tileCount[0] * tileCount[1]);
 
-		if (currentPixel % fullStep == 0 && currentPixel != 0) {
-			unsigned int done = (unsigned int)(100.0f * (float(currentPixel) / float(fullSize)));
-			std::cout << done << "% done" << std::endl;
+	for (uint32_t ty = 0; ty < tileCount[1]; ++ty) {
+		for (uint32_t tx = 0; tx < tileCount[0]; ++tx) {
+			Tile tile;
+			tile.start = Vector2u({tx * tileSize, ty * tileSize});
+			tile.end = Vector2u({
+				std::min(tile.start[0] + tileSize, imageSize[0]),
+				std::min(tile.start[1] + tileSize, imageSize[1])
+			});
+			orderedTiles.push_back({getMortonCode(tx, ty), tile});
 		}
+	}
+
+	std::sort(orderedTiles.begin(), orderedTiles.end(), [](const std::pair<uint32_t, Tile>& a, const std::pair<uint32_t, Tile>& b) {
+		return a.first < b.first;
+	});
 
-		prd.pixel[0] = currentPixel % imageSize[0];
-		prd.pixel[1] = currentPixel / imageSize[0];
-		Vector3f finalColor = renderer->renderPixel(prd);
+	tiles.clear();
+	tiles.reserve(orderedTiles.size());
+	for (const std::pair<uint32_t, Tile>& orderedTile: orderedTiles) {
+		tiles.push_back(orderedTile.second);
+	}
+}
+
+bool GraphicsEngine::nextTile(unsigned int threadIndex, uint32_t& tileIndex) {
+	// take from the own queue first, then steal from the other threads in turn
+	for (unsigned int i = 0; i < threadCount; ++i) {
+		TileQueue& queue = tileQueues[(threadIndex + i) % threadCount];
+		if (queue.next.load(std::memory_order_relaxed) >= queue.end) continue;
+
+		tileIndex = queue.next.fetch_add(1, std::memory_order_relaxed);
+		if (tileIndex < queue.end) return true;
+	}
+	return false;
+}
 
-		for (unsigned int i = 0; i < 3; ++i)
-			finalColor[i] = std::clamp(finalColor[i], 0.0f, 1.0f);
+void GraphicsEngine::saveCheckpoint(const std::string& path) const {
+	// written next to the old checkpoint first, so a kill while writing keeps the old one intact
+	std::string tmpPath = path + ".tmp";
+	std::ofstream file(tmpPath, std::ios::out | std::ios::binary);
+	if (!file.is_open()) throw InitException("GraphicsEngine", "could not write checkpoint \"" + tmpPath + "\"!");
 
-		unsigned int index = (prd.pixel[0] + prd.pixel[1] * imageSize[0]) * 3;
-		for (unsigned int i = 0; i < 3; ++i)
-			image[index + i] = (char) (finalColor[i] * 255.0f);
+	uint32_t header[] = {CHECKPOINT_MAGIC, CHECKPOINT_VERSION, imageSize[0], imageSize[1], accumulatedSamples, passCount};
+	writeBinary(file, header, 6);
+	writeBinary(file, &seed, 1);
+	writeBinary(file, &checkpointKey, 1);
+	writeBinary(file, accumulationBuffer.data(), accumulationBuffer.size());
+	writeBinary(file, passLuminanceSum.data(), passLuminanceSum.size());
+	writeBinary(file, passLuminanceSquareSum.data(), passLuminanceSquareSum.size());
+	file.close();
+
+	std::error_code error;
+	if (!file) {
+		std::filesystem::remove(tmpPath, error);
+		throw InitException("GraphicsEngine", "could not write checkpoint \"" + tmpPath + "\", kept the previous one!");
+	}
+	std::filesystem::rename(tmpPath, path, error);
+	if (error) throw InitException("GraphicsEngine", "could not replace checkpoint \"" + path + "\": " + error.message());
+}
+
+void GraphicsEngine::loadCheckpoint(const std::string& path) {
+	std::ifstream file(path, std::ios::in | std::ios::binary);
+	if (!file.is_open()) throw InitException("GraphicsEngine", "could not open checkpoint \"" + path + "\"!");
+
+	uint32_t header[6];
+	uint64_t checkpointSeed;
+	uint64_t key;
+	readBinary(file, header, 6);
+	readBinary(file, &checkpointSeed, 1);
+	readBinary(file, &key, 1);
+
+	if (!file || header[0] != CHECKPOINT_MAGIC || header[1] != CHECKPOINT_VERSION) {
+		throw InitException("GraphicsEngine", "\"" + path + "\" is no checkpoint of this version!");
+	}
+	if (header[2] != imageSize[0] || header[3] != imageSize[1] || checkpointSeed != seed) {
+		throw InitException("GraphicsEngine", "checkpoint \"" + path + "\" was rendered with another image size or seed!");
+	}
+	if (key != checkpointKey) {
+		throw InitException("GraphicsEngine", "checkpoint \"" + path + "\" was rendered with another renderer, scene or camera!");
+	}
+
+	accumulatedSamples = header[4];
+	passCount = header[5];
+	readBinary(file, accumulationBuffer.data(), accumulationBuffer.size());
+	readBinary(file, passLuminanceSum.data(), passLuminanceSum.size());
+	readBinary(file, passLuminanceSquareSum.data(), passLuminanceSquareSum.size());
+
+	if (!file) throw InitException("GraphicsEngine", "checkpoint \"" + path + "\" is truncated!");
+}
+
+// A target noise alone may never be reached, so without a time budget the render always stops
+// at raysPerPixel or maxSamples.
+unsigned int GraphicsEngine::getSampleLimit() const {
+	if (maxSamples > 0) return maxSamples;
+	if (timeBudget > 0.0f) return std::numeric_limits<unsigned int>::max();
+	return renderer->getRaysPerPixel();
+}
+
+bool GraphicsEngine::isFinished(float elapsed, std::string& reason) const {
+	unsigned int sampleLimit = getSampleLimit();
+	if (accumulatedSamples >= sampleLimit) {
+		reason = "sample limit of " + std::to_string(sampleLimit) + " samples per pixel";
+	} else if (timeBudget > 0.0f && elapsed >= timeBudget) {
+		reason = "time budget of " + std::to_string(timeBudget) + " s";
+	} else if (targetNoise > 0.0f && passCount >= 2 && getNoiseEstimate() <= targetNoise) {
+		reason = "target noise of " + std::to_string(targetNoise);
+	} else {
+		return false;
+	}
+	return true;
+}
+
+// Relative standard error of the image, estimated per pixel from the spread of the pass means
+// and weighted by pixel luminance so dark pixels with a few lucky hits do not dominate.
+float GraphicsEngine::getNoiseEstimate() const {
+	double errorSum = 0.0;
+	double meanSum = 0.0;
+
+	for (size_t i = 0; i < passLuminanceSum.size(); ++i) {
+		float mean = passLuminanceSum[i] / float(passCount);
+		float variance = std::max(0.0f, passLuminanceSquareSum[i] / float(passCount) - mean * mean) * float(passCount) / float(passCount - 1);
+		errorSum += std::sqrt(variance / float(passCount));
+		meanSum += mean;
+	}
+
+	return meanSum > NOISE_MIN_LUMINANCE ? float(errorSum / meanSum) : 0.0f;
+}
+
+void GraphicsEngine::resolveImage() {
+	float scale = accumulatedSamples > 0 ? 1.0f / float(accumulatedSamples) : 0.0f;
+
+	for (size_t i = 0; i < accumulationBuffer.size(); ++i) {
+		for (unsigned int c = 0; c < 3; ++c) {
+			image[3 * i + c] = (char) (uint8_t) (std::clamp(accumulationBuffer[i][c] * scale, 0.0f, 1.0f) * 255.0f);
+		}
 	}
 }
@@ -4,12 +4,14 @@
 #include <algorithm>
 #include <thread>
 #include <atomic>
+#include <chrono>
 
 #include "renderer.h"
 #include "graphics_object.h"
 #include "scene.h"
 
 #include "../camera.h"
+#include "../render_stats.h"
 #include "../math/ray.h"
 #include "../math/random.h"
 
@@ -23,6 +25,17 @@ class GraphicsEngine {
 			float lightStrength;
 		};
 
+		struct Tile {
+			Vector2u start;
+			Vector2u end;
+		};
+
+		// one tile range per thread, padded so the counters do not share a cache line
+		struct alignas(64) TileQueue {
+			std::atomic_uint32_t next;
+			uint32_t end;
+		};
+
 		struct HitPoint {
 			Vector3f pos;
 			Vector3f normal;
@@ -35,11 +48,17 @@ class GraphicsEngine {
 		~GraphicsEngine();
 
 		// void parseInput(const InputEntry& inputEntry);
+		// initializes the objects and builds the scene hierarchy, not needed for a baked scene
+		void initScene();
 		void init(Renderer* renderer, unsigned int threadCount);
 		void saveImage(const std::string path);
+		// writes the counters of every thread as JSON, only filled while RenderStats::enabled is set
+		void writeStatsReport(const std::string& path, const std::string& scenePath, float loadTime, float bvhBuildTime, float writeTime) const;
 
 		void render();
-		void render(const Matrix4f& viewInverse, const Matrix4f& projInverse, const Vector3f& origin);
+		void render(unsigned int threadIndex, const Matrix4f& viewInverse, const Matrix4f& projInverse, const Vector3f& origin);
+		void saveCheckpoint(const std::string& path) const;
+		void loadCheckpoint(const std::string& path);
 		// void renderPixel(unsigned int x, unsigned int y, const Matrix4f& viewInverse, const Matrix4f& projInverse, const Vector3f& origin);
 		// size_t traceSinglePath(std::vector<HitPoint>& path, Ray ray, size_t startDepth, size_t maxDepth, bool isLightRay);
 
@@ -47,17 +66,64 @@ class GraphicsEngine {
 
 		Vector2u imageSize;
 		std::vector<char> image;
+		std::string imagePath;
 		Camera* camera;
 		std::vector<GraphicsObject*> objects;
 		std::vector<GraphicsObject*> lightSources;
+		LightSampler lightSampler;
+		LightTree lightTree;
 		Scene scene;
-		// RandomGenerator rng;
+		uint64_t seed;
 
 		// unsigned int visionJumpCount;
 		// unsigned int lightJumpCount;
 		// unsigned int maxDepth;
 		// unsigned int raysPerPixel;
 		unsigned int threadCount;
-		std::atomic_uint32_t pixelCounter;
+		unsigned int tileSize;
+		std::vector<Tile> tiles;
+		std::vector<TileQueue> tileQueues;
+		std::atomic_uint32_t finishedTileCounter;
+		BVH::BuildMethod bvhBuildMethod;
+		bool bvhReport;
+		bool rayBatches;
 		Renderer* renderer;
+		// seconds spent in initScene and in the last call of render
+		float sceneBuildTime;
+		float renderTime;
+
+		// Progressive rendering: samplesPerPass samples per pixel are added to the accumulation
+		// buffer each pass until raysPerPixel is reached, or until the time budget or the target
+		// noise is reached when one of them is set. maxSamples replaces raysPerPixel as the upper
+		// bound, which also applies with a target noise. 0 disables a setting.
+		unsigned int samplesPerPass;
+		float timeBudget;
+		float targetNoise;
+		unsigned int maxSamples;
+		std::string checkpointPath;
+		float checkpointInterval;
+		// identifies the renderer, scene and camera, a checkpoint of other inputs is not resumed
+		uint64_t checkpointKey;
+
+	private:
+		Renderer::PixelRenderData getPixelRenderData(const Matrix4f& viewInverse, const Matrix4f& projInverse, const Vector3f& origin) const;
+		void createTiles();
+		bool nextTile(unsigned int threadIndex, uint32_t& tileIndex);
+		void renderPass(unsigned int sampleCount, const Matrix4f& viewInverse, const Matrix4f& projInverse, const Vector3f& origin);
+		float getNoiseEstimate() const;
+		unsigned int getSampleLimit() const;
+		bool isFinished(float elapsed, std::string& reason) const;
+		void resolveImage();
+
+		// sums of all samples, plus per pixel sums of the pass mean luminance and its square
+		std::vector<Vector3f> accumulationBuffer;
+		std::vector<float> passLuminanceSum;
+		std::vector<float> passLuminanceSquareSum;
+		unsigned int accumulatedSamples;
+		unsigned int passCount;
+		unsigned int passSampleStart;
+		unsigned int passSampleCount;
+		unsigned int passStage;
+
+		std::vector<RenderStats> threadStats;
 };
@@ -1,49 +1,51 @@
 #include "graphics_object.h"
 
+#include "../binary_file.h"
+
+
+// mat * expandVector(vec, w) without the temporary vectors, these run for every ray and object
+static Vector3f transformPoint(const Matrix4f& mat, const Vector3f& pos) {
+	Vector3f ret;
+	for (size_t j = 0; j < 3; ++j) {
+		ret[j] = mat.m[0][j] * pos[0] + mat.m[1][j] * pos[1] + mat.m[2][j] * pos[2] + mat.m[3][j];
+	}
+	return ret;
+}
+
+static Vector3f transformDirection(const Matrix4f& mat, const Vector3f& direction) {
+	Vector3f ret;
+	for (size_t j = 0; j < 3; ++j) {
+		ret[j] = mat.m[0][j] * direction[0] + mat.m[1][j] * direction[1] + mat.m[2][j] * direction[2];
+	}
+	return ret;
+}
 
 GraphicsObject::GraphicsObject(const Mesh* mesh, const Vector3f& position)
 :scale({1.0f, 1.0f, 1.0f}), rotation(), position(position),
 color(Vector3f({1.0f, 1.0f, 1.0f})), lightSource(false), lightStrength(0.0f),
 diffuseWeight(1.0f), reflectWeight(0.0f), transparentWeight(0.0f), refractionIndex(1.0f),
-vertices(), mesh(mesh), objectMatrix(), triangles(), bvh() {}
+aabb(), mesh(mesh), objectMatrix(), objectMatrixInverse(), normalMatrix() {}
 
 GraphicsObject::~GraphicsObject() {}
 
 void GraphicsObject::init() {
-	vertices.resize(mesh->vertices.size());
-
-	for (size_t i = 0; i < mesh->vertices.size(); ++i) {
-		Vector4f pos = expandVector(mesh->vertices[i].pos, 1.0f);
-		Vector4f normal = expandVector(mesh->vertices[i].normal, 0.0f);
-
-		Matrix4f mat = getMatrix();
-		pos = mat * pos;
-		normal = mat * normal;
-
-		vertices[i].pos = cutVector(pos);
-		vertices[i].normal = cutVector(normal);
-
-		aabb.addPoint(vertices[i].pos);
-	}
-
-	triangles.reserve(mesh->indices.size() / 3);
-	for (unsigned int i = 0; i < mesh->indices.size(); i += 3) {
-		unsigned int v0 = mesh->indices[i+0];
-		unsigned int v1 = mesh->indices[i+1];
-		unsigned int v2 = mesh->indices[i+2];
-
-		triangles.emplace_back(
-			Vector3u({v0, v1, v2}),
-			vertices[v0].pos,
-			vertices[v1].pos,
-			vertices[v2].pos
-		);
+	objectMatrix = getMatrix();
+	objectMatrixInverse = objectMatrix.inverseMatrix();
+	normalMatrix = objectMatrixInverse;
+	normalMatrix.transpose();
+
+	// world bounds from the corners of the mesh bounds
+	aabb = AABB();
+	AABB meshBounds = mesh->bvh.getBounds();
+	if (!meshBounds.isEmpty()) {
+		for (unsigned int corner = 0; corner < 8; ++corner) {
+			Vector3f pos;
+			for (size_t i = 0; i < 3; ++i) {
+				pos[i] = (corner & (1 << i)) ? meshBounds.getMax()[i] : meshBounds.getMin()[i];
+			}
+			aabb.addPoint(toWorldPos(pos));
+		}
 	}
-	
-	bvh = mesh->bvh;
-	bvh.rebuild([this](size_t index){
-		return this->triangles[index].aabb;
-	});
 
 	float totalWeight = diffuseWeight + reflectWeight + transparentWeight;
 	diffuseThreshold = diffuseWeight / totalWeight;
@@ -51,6 +53,52 @@ void GraphicsObject::init() {
 	transparentThreshold = reflectThreshold + (transparentWeight / totalWeight);
 }
 
+void GraphicsObject::write(BinaryWriter& writer) const {
+	writer.write(scale);
+	writer.write(rotation);
+	writer.write(position);
+
+	writer.write(color);
+	writer.write(lightSource);
+	writer.write(lightStrength);
+
+	writer.write(diffuseWeight);
+	writer.write(reflectWeight);
+	writer.write(transparentWeight);
+	writer.write(diffuseThreshold);
+	writer.write(reflectThreshold);
+	writer.write(transparentThreshold);
+	writer.write(refractionIndex);
+
+	writer.write(aabb);
+	writer.write(objectMatrix);
+	writer.write(objectMatrixInverse);
+	writer.write(normalMatrix);
+}
+
+void GraphicsObject::read(BinaryReader& reader) {
+	scale = reader.read<Vector3f>();
+	rotation = reader.read<Rotation>();
+	position = reader.read<Vector3f>();
+
+	color = reader.read<Vector3f>();
+	lightSource = reader.read<bool>();
+	lightStrength = reader.read<float>();
+
+	diffuseWeight = reader.read<float>();
+	reflectWeight = reader.read<float>();
+	transparentWeight = reader.read<float>();
+	diffuseThreshold = reader.read<float>();
+	reflectThreshold = reader.read<float>();
+	transparentThreshold = reader.read<float>();
+	refractionIndex = reader.read<float>();
+
+	aabb = reader.read<AABB>();
+	objectMatrix = reader.read<Matrix4f>();
+	objectMatrixInverse = reader.read<Matrix4f>();
+	normalMatrix = reader.read<Matrix4f>();
+}
+
 Matrix4f GraphicsObject::getMatrix() const {
 	Matrix4f objectMatrix;
 
@@ -61,27 +109,73 @@ Matrix4f GraphicsObject::getMatrix() const {
 	return objectMatrix;
 }
 
-bool GraphicsObject::traceRay(const Ray& ray, Vector3f& hitPos, const Triangle*& currentTriangle, float& minDistance) const {
-	std::vector<size_t> elems = bvh.getHits(ray);
-	if (elems.empty()) return false;
+SIMD_KERNEL bool GraphicsObject::traceRay(const Ray& ray, float& tMax, uint32_t& triangleIndex) const {
+	return mesh->traceRay(toObjectRay(ray), tMax, triangleIndex);
+}
+
+SIMD_KERNEL bool GraphicsObject::isOccluded(const Ray& ray, float tMax) const {
+	return mesh->isOccluded(toObjectRay(ray), tMax);
+}
 
-	std::vector<const Triangle*> potentialHits(elems.size());
-	for (size_t i = 0; i < elems.size(); ++i) {
-		potentialHits[i] = &triangles[elems[i]];
+SIMD_KERNEL uint32_t GraphicsObject::traceRayPacket(RayPacket& packet, uint32_t laneMask, uint32_t* triangleIndices) const {
+	RayPacket objectPacket;
+	for (uint32_t lanes = laneMask; lanes != 0; lanes &= lanes - 1) {
+		size_t lane = __builtin_ctz(lanes);
+		objectPacket.setRay(lane, toObjectRay(packet.getRay(lane)), packet.tMax[lane]);
 	}
-	
-	bool hit = false;
-	for (const Triangle* triangle: potentialHits) {
-		Vector3f currentHitPos;
-		if (triangle->rayIntersects(ray, currentHitPos)) {
-			float currentDistance = ray.origin.distanceSquared(currentHitPos);
-			if (currentDistance < minDistance) {
-				hitPos = currentHitPos;
-				minDistance = currentDistance;
-				currentTriangle = triangle;
-				hit = true;
-			}
-		}
+
+	uint32_t hitLanes = mesh->traceRayPacket(objectPacket, laneMask, triangleIndices);
+	for (uint32_t lanes = hitLanes; lanes != 0; lanes &= lanes - 1) {
+		size_t lane = __builtin_ctz(lanes);
+		packet.tMax[lane] = objectPacket.tMax[lane];
 	}
-	return hit;
+
+	return hitLanes;
+}
+
+SIMD_KERNEL void GraphicsObject::getHitVertex(const Ray& ray, float t, uint32_t triangleIndex, Mesh::Vertex& hitVertex) const {
+	hitVertex.pos = ray.origin + t * ray.direction;
+
+	Vector3f objectPos = transformPoint(objectMatrixInverse, hitVertex.pos);
+	hitVertex.normal = getNormal(triangleIndex, mesh->triangles[triangleIndex].getBarycentricCoords(objectPos));
+}
+
+Vector3f GraphicsObject::getPos(uint32_t triangleIndex, const Vector3f& barycentricCoords) const {
+	const Mesh::Vertex& vert0 = mesh->vertices[mesh->indices[3 * triangleIndex + 0]];
+	const Mesh::Vertex& vert1 = mesh->vertices[mesh->indices[3 * triangleIndex + 1]];
+	const Mesh::Vertex& vert2 = mesh->vertices[mesh->indices[3 * triangleIndex + 2]];
+
+	return toWorldPos(vert0.pos * barycentricCoords[0] + vert1.pos * barycentricCoords[1] + vert2.pos * barycentricCoords[2]);
+}
+
+Vector3f GraphicsObject::getNormal(uint32_t triangleIndex, const Vector3f& barycentricCoords) const {
+	const Mesh::Vertex& vert0 = mesh->vertices[mesh->indices[3 * triangleIndex + 0]];
+	const Mesh::Vertex& vert1 = mesh->vertices[mesh->indices[3 * triangleIndex + 1]];
+	const Mesh::Vertex& vert2 = mesh->vertices[mesh->indices[3 * triangleIndex + 2]];
+
+	Vector3f normal({0.0f, 0.0f, 0.0f});
+	normal += barycentricCoords[0] * vert0.normal;
+	normal += barycentricCoords[1] * vert1.normal;
+	normal += barycentricCoords[2] * vert2.normal;
+
+	return toWorldNormal(normal);
+}
+
+float GraphicsObject::getTriangleArea(uint32_t triangleIndex) const {
+	Vector3f v0 = getPos(triangleIndex, Vector3f({1.0f, 0.0f, 0.0f}));
+	Vector3f v1 = getPos(triangleIndex, Vector3f({0.0f, 1.0f, 0.0f}));
+	Vector3f v2 = getPos(triangleIndex, Vector3f({0.0f, 0.0f, 1.0f}));
+	return ::getTriangleArea(v0, v1, v2);
+}
+
+Vector3f GraphicsObject::toWorldPos(const Vector3f& pos) const {
+	return transformPoint(objectMatrix, pos);
+}
+
+Vector3f GraphicsObject::toWorldNormal(const Vector3f& normal) const {
+	return transformDirection(normalMatrix, normal).normalize();
+}
+
+Ray GraphicsObject::toObjectRay(const Ray& ray) const {
+	return Ray(transformPoint(objectMatrixInverse, ray.origin), transformDirection(objectMatrixInverse, ray.direction));
 }
@@ -4,18 +4,22 @@
 #include "triangle.h"
 
 #include "../math/ray.h"
+#include "../math/ray_packet.h"
 #include "../math/vector.h"
 #include "../math/matrix.h"
 #include "../math/rotation.h"
 #include "../math/aabb.h"
-#include "../math/bounding_volume_hierachy.h"
 
 #include <vector>
 
 
 class Mesh;
 class Device;
+class BinaryWriter;
+class BinaryReader;
 
+// An instance of a mesh, rays are moved into the object space of the shared mesh geometry.
+// Ray directions are not renormalized there, so t is the same in world and object space.
 class GraphicsObject {
 	public:
 		GraphicsObject(const Mesh* mesh, const Vector3f& position);
@@ -23,7 +27,22 @@ class GraphicsObject {
 
 		void init();
 		Matrix4f getMatrix() const;
-		bool traceRay(const Ray& ray, Vector3f& hitPos, const Triangle*& currentTriangle, float& minDistance) const;
+		// the initialized state without the mesh, which is shared and stored by the caller
+		void write(BinaryWriter& writer) const;
+		void read(BinaryReader& reader);
+		bool traceRay(const Ray& ray, float& tMax, uint32_t& triangleIndex) const;
+		bool isOccluded(const Ray& ray, float tMax) const;
+		// shrinks the tMax of the lanes that hit this object, returns those lanes
+		uint32_t traceRayPacket(RayPacket& packet, uint32_t laneMask, uint32_t* triangleIndices) const;
+
+		void getHitVertex(const Ray& ray, float t, uint32_t triangleIndex, Mesh::Vertex& hitVertex) const;
+		Vector3f getPos(uint32_t triangleIndex, const Vector3f& barycentricCoords) const;
+		Vector3f getNormal(uint32_t triangleIndex, const Vector3f& barycentricCoords) const;
+		// in world space
+		float getTriangleArea(uint32_t triangleIndex) const;
+		Vector3f toWorldPos(const Vector3f& pos) const;
+		Vector3f toWorldNormal(const Vector3f& normal) const;
+		Ray toObjectRay(const Ray& ray) const;
 
 		Vector3f scale;
 		Rotation rotation;
@@ -43,11 +62,10 @@ class GraphicsObject {
 
 		float refractionIndex;
 
-		std::vector<Mesh::Vertex> vertices;
 		AABB aabb;
 
 		const Mesh* mesh;
 		Matrix4f objectMatrix;
-		std::vector<Triangle> triangles;
-		BVH bvh;
+		Matrix4f objectMatrixInverse;
+		Matrix4f normalMatrix;
 };
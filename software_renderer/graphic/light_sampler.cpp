@@ -0,0 +1,78 @@
+#include "light_sampler.h"
+
+
+LightSampler::LightSampler()
+:emitters(), emitterTable(), emitterIndices(), totalArea(0.0f) {}
+
+LightSampler::~LightSampler() {}
+
+void LightSampler::init(const std::vector<GraphicsObject*>& lightSources) {
+	emitters.clear();
+	emitterIndices.clear();
+	totalArea = 0.0f;
+
+	std::vector<float> powers;
+	for (const GraphicsObject* lightSource: lightSources) {
+		std::vector<float> areas(lightSource->mesh->triangles.size());
+		float area = 0.0f;
+		for (uint32_t ti = 0; ti < areas.size(); ++ti) {
+			areas[ti] = lightSource->getTriangleArea(ti);
+			area += areas[ti];
+		}
+		if (area <= 0.0f) continue;
+
+		emitterIndices[lightSource] = emitters.size();
+		emitters.push_back({lightSource, AliasTable(), area});
+		emitters.back().triangles.init(areas);
+		powers.push_back(getPower(lightSource, area));
+		totalArea += area;
+	}
+
+	emitterTable.init(powers);
+}
+
+bool LightSampler::empty() const {
+	return emitters.empty();
+}
+
+LightSampler::Sample LightSampler::sample(RandomGenerator* rng) const {
+	const Emitter& emitter = emitters[emitterTable.sample(rng->rand())];
+
+	float sqrtr1 = sqrt(rng->rand());
+	float r2 = rng->rand();
+	Vector3f barycentricCoords({1.0f - sqrtr1, sqrtr1 * (1.0f - r2), sqrtr1 * r2});
+
+	uint32_t ti = emitter.triangles.sample(rng->rand());
+
+	Sample sample;
+	sample.pos = emitter.obj->getPos(ti, barycentricCoords);
+	sample.normal = emitter.obj->getNormal(ti, barycentricCoords);
+	sample.obj = emitter.obj;
+	sample.triangleIndex = ti;
+	sample.pdf = getPdf(emitter.obj, ti);
+	return sample;
+}
+
+float LightSampler::getPdf(const GraphicsObject* obj, uint32_t triangleIndex) const {
+	auto it = emitterIndices.find(obj);
+	if (it == emitterIndices.end()) return 0.0f;
+
+	// the triangles are picked by area, so every point of the light source is equally likely
+	const Emitter& emitter = emitters[it->second];
+	if (emitter.triangles.getProbability(triangleIndex) <= 0.0f) return 0.0f;
+	return emitterTable.getProbability(it->second) / emitter.area;
+}
+
+float LightSampler::getProbability(const GraphicsObject* obj) const {
+	auto it = emitterIndices.find(obj);
+	return it == emitterIndices.end() ? 0.0f : emitterTable.getProbability(it->second);
+}
+
+float LightSampler::getTotalArea() const {
+	return totalArea;
+}
+
+float LightSampler::getPower(const GraphicsObject* lightSource, float area) {
+	const Vector3f& color = lightSource->color;
+	return lightSource->lightStrength * (0.2126f * color[0] + 0.7152f * color[1] + 0.0722f * color[2]) * area;
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <vector>
+#include <unordered_map>
+
+#include "graphics_object.h"
+
+#include "../math/alias_table.h"
+#include "../math/random.h"
+
+
+// Picks points on the light sources: a light source proportional to its power (lightStrength
+// times the luminance of its color times its area), then one of its triangles proportional to
+// its area, then a uniform point on it. Built once per scene, sampling is O(1).
+class LightSampler {
+	public:
+		struct Sample {
+			Vector3f pos;
+			Vector3f normal;
+			const GraphicsObject* obj;
+			uint32_t triangleIndex;
+			// per unit area
+			float pdf;
+		};
+
+		LightSampler();
+		~LightSampler();
+
+		// the objects have to be initialized
+		void init(const std::vector<GraphicsObject*>& lightSources);
+		bool empty() const;
+		Sample sample(RandomGenerator* rng) const;
+		// the pdf of sample per unit area for points on the triangle, 0 for other objects
+		float getPdf(const GraphicsObject* obj, uint32_t triangleIndex) const;
+		// the probability of picking the light source
+		float getProbability(const GraphicsObject* obj) const;
+		float getTotalArea() const;
+
+		// the weight of a light source or a part of it with the given area
+		static float getPower(const GraphicsObject* lightSource, float area);
+
+	private:
+		struct Emitter {
+			const GraphicsObject* obj;
+			AliasTable triangles;
+			float area;
+		};
+
+		std::vector<Emitter> emitters;
+		AliasTable emitterTable;
+		std::unordered_map<const GraphicsObject*, uint32_t> emitterIndices;
+		float totalArea;
+};
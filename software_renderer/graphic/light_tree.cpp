@@ -0,0 +1,343 @@
+#include "light_tree.h"
+
+#include <cmath>
+#include <chrono>
+#include <limits>
+#include <algorithm>
+
+
+// cos(max(0, a - b)) and sin(max(0, a - b)) from the sines and cosines of the angles
+static float cosSubClamped(float sinA, float cosA, float sinB, float cosB) {
+	if (cosA > cosB) return 1.0f;
+	return cosA * cosB + sinA * sinB;
+}
+
+static float sinSubClamped(float sinA, float cosA, float sinB, float cosB) {
+	if (cosA > cosB) return 0.0f;
+	return sinA * cosB - cosA * sinB;
+}
+
+static float getSin(float cos) {
+	return std::sqrt(std::max(0.0f, 1.0f - cos * cos));
+}
+
+// The smallest cone around the normal cones a and b
+static void mergeCones(const Vector3f& axisA, float cosA, const Vector3f& axisB, float cosB, Vector3f& axis, float& cosTheta) {
+	float thetaA = std::acos(std::clamp(cosA, -1.0f, 1.0f));
+	float thetaB = std::acos(std::clamp(cosB, -1.0f, 1.0f));
+	float thetaD = std::acos(std::clamp(axisA.dot(axisB), -1.0f, 1.0f));
+
+	if (std::min(thetaD + thetaB, float(M_PI)) <= thetaA) {
+		axis = axisA;
+		cosTheta = cosA;
+		return;
+	}
+	if (std::min(thetaD + thetaA, float(M_PI)) <= thetaB) {
+		axis = axisB;
+		cosTheta = cosB;
+		return;
+	}
+
+	float theta = 0.5f * (thetaA + thetaD + thetaB);
+	Vector3f rotationAxis = cross(axisA, axisB);
+	if (theta >= float(M_PI) || rotationAxis.magnitudeSquared() <= 0.0f) {
+		axis = axisA;
+		cosTheta = -1.0f;
+		return;
+	}
+
+	// axisA rotated towards axisB, so the cone just touches the far sides of both
+	float rotation = theta - thetaA;
+	rotationAxis.normalize();
+	axis = std::cos(rotation) * axisA + std::sin(rotation) * cross(rotationAxis, axisA);
+	axis.normalize();
+	cosTheta = std::cos(theta);
+}
+
+// Surface area orientation heuristic: the power times the solid angle the node emits into
+// times its surface area, stretched along axes the parent is thin in.
+static float getSplitCost(float power, const AABB& aabb, float cosTheta, float stretch) {
+	float thetaO = std::acos(std::clamp(cosTheta, -1.0f, 1.0f));
+	float thetaW = std::min(thetaO + float(M_PI_2), float(M_PI));
+	float sinThetaO = getSin(cosTheta);
+	float solidAngle = 2.0f * M_PI * (1.0f - cosTheta)
+		+ M_PI_2 * (2.0f * thetaW * sinThetaO - std::cos(thetaO - 2.0f * thetaW) - 2.0f * thetaO * sinThetaO + cosTheta);
+	return power * solidAngle * stretch * aabb.getSurfaceArea();
+}
+
+
+LightTree::LightTree()
+:nodes(), triangles(), leafNodes(), firstTriangles(), stats() {}
+
+LightTree::~LightTree() {}
+
+void LightTree::init(const std::vector<GraphicsObject*>& lightSources) {
+	auto start = std::chrono::steady_clock::now();
+	nodes.clear();
+	triangles.clear();
+	leafNodes.clear();
+	firstTriangles.clear();
+	stats = Stats();
+
+	std::vector<BuildLight> lights;
+	for (const GraphicsObject* lightSource: lightSources) {
+		firstTriangles[lightSource] = leafNodes.size();
+
+		for (uint32_t ti = 0; ti < lightSource->mesh->triangles.size(); ++ti) {
+			leafNodes.push_back(UINT32_MAX);
+			float area = lightSource->getTriangleArea(ti);
+			float power = LightSampler::getPower(lightSource, area);
+			if (area <= 0.0f || power <= 0.0f) continue;
+
+			Vector3f corners[3] = {Vector3f({1.0f, 0.0f, 0.0f}), Vector3f({0.0f, 1.0f, 0.0f}), Vector3f({0.0f, 0.0f, 1.0f})};
+			BuildLight light;
+			light.bounds.aabb = AABB();
+			light.bounds.axis = Vector3f({0.0f, 0.0f, 0.0f});
+			for (const Vector3f& corner: corners) {
+				light.bounds.aabb.addPoint(lightSource->getPos(ti, corner));
+				light.bounds.axis += lightSource->getNormal(ti, corner);
+			}
+			light.bounds.axis.normalize();
+
+			// the interpolated normals stay inside the cone of the vertex normals as long as it is convex
+			light.bounds.cosTheta = 1.0f;
+			for (const Vector3f& corner: corners) {
+				light.bounds.cosTheta = std::min(light.bounds.cosTheta, light.bounds.axis.dot(lightSource->getNormal(ti, corner)));
+			}
+			if (light.bounds.cosTheta <= 0.0f) light.bounds.cosTheta = -1.0f;
+
+			light.bounds.power = power;
+			light.centroid = light.bounds.aabb.getCenter();
+			light.triangle = triangles.size();
+			triangles.push_back({lightSource, ti, area});
+			lights.push_back(light);
+		}
+	}
+
+	stats.lightCount = lights.size();
+	if (!lights.empty()) {
+		nodes.reserve(2 * lights.size() - 1);
+		build(lights, 0, lights.size(), UINT32_MAX, 1);
+	}
+	stats.nodeCount = nodes.size();
+	stats.buildTime = std::chrono::duration<float>(std::chrono::steady_clock::now() - start).count();
+}
+
+bool LightTree::empty() const {
+	return nodes.empty();
+}
+
+LightTree::Stats LightTree::getStats() const {
+	return stats;
+}
+
+LightSampler::Sample LightTree::sample(RandomGenerator* rng, const Vector3f& pos, const Vector3f& normal) const {
+	LightSampler::Sample sample;
+	sample.obj = nullptr;
+	sample.pdf = 0.0f;
+	if (nodes.empty()) return sample;
+
+	uint32_t nodeIndex = 0;
+	float probability = 1.0f;
+	while (!nodes[nodeIndex].leaf) {
+		uint32_t first = nodeIndex + 1;
+		uint32_t second = nodes[nodeIndex].offset;
+		float firstImportance = getImportance(nodes[first], pos, normal);
+		float secondImportance = getImportance(nodes[second], pos, normal);
+		if (firstImportance + secondImportance <= 0.0f) return sample;
+
+		float firstProbability = firstImportance / (firstImportance + secondImportance);
+		if (rng->rand() < firstProbability) {
+			nodeIndex = first;
+			probability *= firstProbability;
+		} else {
+			nodeIndex = second;
+			probability *= 1.0f - firstProbability;
+		}
+	}
+
+	const LightTriangle& triangle = triangles[nodes[nodeIndex].offset];
+	float sqrtr1 = sqrt(rng->rand());
+	float r2 = rng->rand();
+	Vector3f barycentricCoords({1.0f - sqrtr1, sqrtr1 * (1.0f - r2), sqrtr1 * r2});
+
+	sample.pos = triangle.obj->getPos(triangle.triangleIndex, barycentricCoords);
+	sample.normal = triangle.obj->getNormal(triangle.triangleIndex, barycentricCoords);
+	sample.obj = triangle.obj;
+	sample.triangleIndex = triangle.triangleIndex;
+	sample.pdf = probability / triangle.area;
+	return sample;
+}
+
+float LightTree::getPdf(const Vector3f& pos, const Vector3f& normal, const GraphicsObject* obj, uint32_t triangleIndex) const {
+	auto it = firstTriangles.find(obj);
+	if (it == firstTriangles.end()) return 0.0f;
+	uint32_t leaf = leafNodes[it->second + triangleIndex];
+	if (leaf == UINT32_MAX) return 0.0f;
+
+	// the same choices as sample, from the leaf up
+	float probability = 1.0f;
+	uint32_t nodeIndex = leaf;
+	for (uint32_t parent = nodes[nodeIndex].parent; parent != UINT32_MAX; nodeIndex = parent, parent = nodes[parent].parent) {
+		float firstImportance = getImportance(nodes[parent + 1], pos, normal);
+		float secondImportance = getImportance(nodes[nodes[parent].offset], pos, normal);
+		if (firstImportance + secondImportance <= 0.0f) return 0.0f;
+
+		float firstProbability = firstImportance / (firstImportance + secondImportance);
+		probability *= nodeIndex == parent + 1 ? firstProbability : 1.0f - firstProbability;
+	}
+
+	return probability / triangles[nodes[leaf].offset].area;
+}
+
+uint32_t LightTree::build(std::vector<BuildLight>& lights, size_t begin, size_t end, uint32_t parent, size_t depth) {
+	stats.maxDepth = std::max(stats.maxDepth, depth);
+
+	LightBounds bounds = lights[begin].bounds;
+	for (size_t i = begin + 1; i < end; ++i) {
+		const LightBounds& other = lights[i].bounds;
+		bounds.aabb = AABB(bounds.aabb, other.aabb);
+		mergeCones(bounds.axis, bounds.cosTheta, other.axis, other.cosTheta, bounds.axis, bounds.cosTheta);
+		bounds.power += other.power;
+	}
+
+	uint32_t nodeIndex = nodes.size();
+	Node node;
+	node.aabbMin = bounds.aabb.getMin();
+	node.aabbMax = bounds.aabb.getMax();
+	node.axis = bounds.axis;
+	node.cosTheta = bounds.cosTheta;
+	node.sinTheta = getSin(bounds.cosTheta);
+	node.power = bounds.power;
+	node.offset = lights[begin].triangle;
+	node.parent = parent;
+	node.leaf = end - begin == 1;
+	nodes.push_back(node);
+
+	if (node.leaf) {
+		const LightTriangle& triangle = triangles[node.offset];
+		leafNodes[firstTriangles[triangle.obj] + triangle.triangleIndex] = nodeIndex;
+		return nodeIndex;
+	}
+
+	size_t mid = split(lights, begin, end, bounds);
+	build(lights, begin, mid, nodeIndex, depth + 1);
+	nodes[nodeIndex].offset = build(lights, mid, end, nodeIndex, depth + 1);
+	return nodeIndex;
+}
+
+// Binned split along the axis and bucket boundary with the lowest cost, at the median when
+// all centroids fall into one bucket.
+size_t LightTree::split(std::vector<BuildLight>& lights, size_t begin, size_t end, const LightBounds& bounds) const {
+	AABB centroidBounds;
+	for (size_t i = begin; i < end; ++i) centroidBounds.addPoint(lights[i].centroid);
+	Vector3f centroidMin = centroidBounds.getMin();
+	Vector3f extent = centroidBounds.getMax() - centroidMin;
+	Vector3f diagonal = bounds.aabb.getMax() - bounds.aabb.getMin();
+	float maxDiagonal = std::max({diagonal[0], diagonal[1], diagonal[2]});
+
+	float bestCost = std::numeric_limits<float>::max();
+	size_t bestAxis = 0;
+	size_t bestBucket = 0;
+	for (size_t axis = 0; axis < 3; ++axis) {
+		if (extent[axis] <= 0.0f) continue;
+
+		LightBounds buckets[LIGHT_TREE_BUCKET_COUNT];
+		size_t counts[LIGHT_TREE_BUCKET_COUNT] = {0};
+		for (size_t i = begin; i < end; ++i) {
+			size_t b = std::min(size_t(LIGHT_TREE_BUCKET_COUNT * (lights[i].centroid[axis] - centroidMin[axis]) / extent[axis]), size_t(LIGHT_TREE_BUCKET_COUNT - 1));
+			const LightBounds& other = lights[i].bounds;
+			if (counts[b]++ == 0) {
+				buckets[b] = other;
+				continue;
+			}
+			buckets[b].aabb = AABB(buckets[b].aabb, other.aabb);
+			mergeCones(buckets[b].axis, buckets[b].cosTheta, other.axis, other.cosTheta, buckets[b].axis, buckets[b].cosTheta);
+			buckets[b].power += other.power;
+		}
+
+		float stretch = maxDiagonal / std::max(diagonal[axis], 1e-6f);
+		for (size_t s = 1; s < LIGHT_TREE_BUCKET_COUNT; ++s) {
+			float cost = 0.0f;
+			for (size_t side = 0; side < 2; ++side) {
+				size_t from = side == 0 ? 0 : s;
+				size_t to = side == 0 ? s : LIGHT_TREE_BUCKET_COUNT;
+				LightBounds merged;
+				bool filled = false;
+				for (size_t b = from; b < to; ++b) {
+					if (counts[b] == 0) continue;
+					if (!filled) {
+						merged = buckets[b];
+						filled = true;
+						continue;
+					}
+					merged.aabb = AABB(merged.aabb, buckets[b].aabb);
+					mergeCones(merged.axis, merged.cosTheta, buckets[b].axis, buckets[b].cosTheta, merged.axis, merged.cosTheta);
+					merged.power += buckets[b].power;
+				}
+				if (!filled) {
+					cost = std::numeric_limits<float>::max();
+					break;
+				}
+				cost += getSplitCost(merged.power, merged.aabb, merged.cosTheta, stretch);
+			}
+
+			if (cost < bestCost) {
+				bestCost = cost;
+				bestAxis = axis;
+				bestBucket = s;
+			}
+		}
+	}
+
+	if (bestCost < std::numeric_limits<float>::max()) {
+		auto mid = std::partition(lights.begin() + begin, lights.begin() + end, [&](const BuildLight& light) {
+			size_t b = std::min(size_t(LIGHT_TREE_BUCKET_COUNT * (light.centroid[bestAxis] - centroidMin[bestAxis]) / extent[bestAxis]), size_t(LIGHT_TREE_BUCKET_COUNT - 1));
+			return b < bestBucket;
+		});
+		return mid - lights.begin();
+	}
+
+	size_t mid = (begin + end) / 2;
+	std::nth_element(lights.begin() + begin, lights.begin() + mid, lights.begin() + end, [](const BuildLight& a, const BuildLight& b) {
+		return a.triangle < b.triangle;
+	});
+	return mid;
+}
+
+// An upper bound of the light the node can send to the shading point: its power over the
+// distance squared, times the cosines at the lights and at the surface for the most favorable
+// point and normal inside the node.
+float LightTree::getImportance(const Node& node, const Vector3f& pos, const Vector3f& normal) const {
+	Vector3f center = 0.5f * (node.aabbMin + node.aabbMax);
+	float radiusSquared = 0.25f * node.aabbMax.distanceSquared(node.aabbMin);
+	float distanceSquared = pos.distanceSquared(center);
+
+	// the half angle of the bounding sphere of the node seen from pos
+	float sinThetaB = 1.0f;
+	float cosThetaB = -1.0f;
+	if (distanceSquared > radiusSquared) {
+		float sinSquared = radiusSquared / distanceSquared;
+		sinThetaB = std::sqrt(sinSquared);
+		cosThetaB = std::sqrt(1.0f - sinSquared);
+	}
+
+	Vector3f toPos = pos - center;
+	toPos.normalize();
+	float cosThetaW = node.axis.dot(toPos);
+	float sinThetaW = getSin(cosThetaW);
+
+	float cosThetaX = cosSubClamped(sinThetaW, cosThetaW, node.sinTheta, node.cosTheta);
+	float sinThetaX = sinSubClamped(sinThetaW, cosThetaW, node.sinTheta, node.cosTheta);
+	float cosThetaL = cosSubClamped(sinThetaX, cosThetaX, sinThetaB, cosThetaB);
+	if (cosThetaL <= 0.0f) return 0.0f;
+
+	float cosThetaI = -normal.dot(toPos);
+	float sinThetaI = getSin(cosThetaI);
+	float cosThetaS = cosSubClamped(sinThetaI, cosThetaI, sinThetaB, cosThetaB);
+	if (cosThetaS <= 0.0f) return 0.0f;
+
+	// clamped so points close to or inside the node do not get an unbounded weight
+	distanceSquared = std::max(distanceSquared, std::sqrt(radiusSquared));
+	return node.power * cosThetaL * cosThetaS / distanceSquared;
+}
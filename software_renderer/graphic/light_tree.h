@@ -0,0 +1,87 @@
+#pragma once
+
+#include <vector>
+#include <unordered_map>
+
+#include "graphics_object.h"
+#include "light_sampler.h"
+
+#include "../math/aabb.h"
+#include "../math/random.h"
+
+#define LIGHT_TREE_BUCKET_COUNT 12
+
+
+// Light hierarchy over the triangles of the light sources (Conty Estevez and Kulla, "Importance
+// Sampling of Many Lights with Adaptive Tree Splitting"). Every node bounds its triangles by an
+// AABB, their summed power and a cone around their normals. Sampling walks down from the root and
+// picks a child with a probability proportional to how much it can light the shading point, so
+// the cost and the noise grow with the depth of the tree instead of the light count.
+class LightTree {
+	public:
+		struct Stats {
+			size_t lightCount;
+			size_t nodeCount;
+			size_t maxDepth;
+			float buildTime;
+		};
+
+		LightTree();
+		~LightTree();
+
+		// the objects have to be initialized
+		void init(const std::vector<GraphicsObject*>& lightSources);
+		bool empty() const;
+		Stats getStats() const;
+		// pos and normal of the shading point, the pdf of the sample is 0 when no light can reach it
+		LightSampler::Sample sample(RandomGenerator* rng, const Vector3f& pos, const Vector3f& normal) const;
+		// the pdf of sample per unit area for points on the triangle
+		float getPdf(const Vector3f& pos, const Vector3f& normal, const GraphicsObject* obj, uint32_t triangleIndex) const;
+
+	private:
+		struct LightBounds {
+			AABB aabb;
+			Vector3f axis;
+			// of the half angle of the normal cone, the emission around every normal is a hemisphere
+			float cosTheta;
+			float power;
+		};
+
+		struct BuildLight {
+			LightBounds bounds;
+			Vector3f centroid;
+			uint32_t triangle;
+		};
+
+		// Depth first layout like BVH::Node: the first child directly follows its parent, inner
+		// nodes store the index of the second child in offset, leaves the index into triangles.
+		struct Node {
+			Vector3f aabbMin;
+			Vector3f aabbMax;
+			Vector3f axis;
+			float cosTheta;
+			float sinTheta;
+			float power;
+			uint32_t offset;
+			uint32_t parent;
+			bool leaf;
+		};
+
+		struct LightTriangle {
+			const GraphicsObject* obj;
+			uint32_t triangleIndex;
+			float area;
+		};
+
+		uint32_t build(std::vector<BuildLight>& lights, size_t begin, size_t end, uint32_t parent, size_t depth);
+		size_t split(std::vector<BuildLight>& lights, size_t begin, size_t end, const LightBounds& bounds) const;
+		float getImportance(const Node& node, const Vector3f& pos, const Vector3f& normal) const;
+
+		std::vector<Node> nodes;
+		std::vector<LightTriangle> triangles;
+		// the leaf of every light source triangle, UINT32_MAX for the ones without power
+		std::vector<uint32_t> leafNodes;
+		// the position of the first triangle of a light source in leafNodes
+		std::unordered_map<const GraphicsObject*, uint32_t> firstTriangles;
+		Stats stats;
+};
@@ -1,8 +1,11 @@
 #include "mesh.h"
 
+#include "../binary_file.h"
+#include "../render_stats.h"
+
 
 Mesh::Mesh()
-:vertices(), indices(), bvh() {}
+:vertices(), indices(), triangles(), triangleBlocks(), bvh(), wideBvh() {}
 
 Mesh::~Mesh() {}
 
@@ -21,10 +24,11 @@ void Mesh::addIndex(const Vector3u& index) {
 	indices.push_back(index[2]);
 }
 
-void Mesh::init() {
+void Mesh::init(BVH::BuildMethod buildMethod) {
+	initTriangles();
+
 	std::vector<BVH::Data> inputs;
-	inputs.reserve((indices.size() / 3));
-	
+	inputs.reserve(triangles.size());
 	for (size_t i = 0; i < indices.size(); i += 3) {
 		AABB aabb;
 		aabb.addPoint(vertices[indices[i+0]].pos);
@@ -33,5 +37,109 @@ void Mesh::init() {
 
 		inputs.push_back({aabb, i / 3});
 	}
-	bvh.init(inputs);
+	bvh.init(inputs, buildMethod);
+
+	wideBvh.init(bvh);
+	initTriangleBlocks();
+}
+
+void Mesh::write(BinaryWriter& writer) const {
+	writer.writeArray(vertices);
+	writer.writeArray(indices);
+	bvh.write(writer);
+	wideBvh.write(writer);
+}
+
+void Mesh::read(BinaryReader& reader) {
+	reader.readArray(vertices);
+	reader.readArray(indices);
+	bvh.read(reader);
+	wideBvh.read(reader);
+	if (!reader.isValid()) return;
+
+	size_t triangleCount = indices.size() / 3;
+	bool valid = indices.size() % 3 == 0 && bvh.isValid(triangleCount) && wideBvh.isValid(triangleCount);
+	for (size_t i = 0; i < indices.size() && valid; ++i) {
+		valid = indices[i] < vertices.size();
+	}
+	if (!valid) {
+		reader.invalidate();
+		return;
+	}
+
+	initTriangles();
+	initTriangleBlocks();
+}
+
+void Mesh::initTriangles() {
+	triangles.clear();
+	triangles.reserve(indices.size() / 3);
+	for (size_t i = 0; i < indices.size(); i += 3) {
+		unsigned int v0 = indices[i+0];
+		unsigned int v1 = indices[i+1];
+		unsigned int v2 = indices[i+2];
+
+		triangles.emplace_back(vertices[v0].pos, vertices[v1].pos, vertices[v2].pos);
+	}
+}
+
+void Mesh::initTriangleBlocks() {
+	const std::vector<uint32_t>& blockIndices = wideBvh.getElemIndices();
+	triangleBlocks.assign(wideBvh.getBlockCount(), TriangleBlock());
+	for (size_t i = 0; i < blockIndices.size(); ++i) {
+		if (blockIndices[i] == WIDE_BVH_EMPTY_ELEM) continue;
+		triangleBlocks[i / WIDE_BVH_WIDTH].setTriangle(i % WIDE_BVH_WIDTH, triangles[blockIndices[i]], blockIndices[i]);
+	}
+}
+
+SIMD_KERNEL bool Mesh::traceRay(const Ray& ray, float& tMax, uint32_t& triangleIndex) const {
+	uint64_t blockTests = 0;
+	bool hit = wideBvh.traverse(ray, tMax, [this, &ray, &triangleIndex, &blockTests](size_t block, float& tMax) {
+		const TriangleBlock& triangleBlock = triangleBlocks[block];
+		++blockTests;
+
+		float t;
+		int lane = triangleBlock.rayIntersects(ray, tMax, t);
+		if (lane < 0) return false;
+
+		tMax = t;
+		triangleIndex = triangleBlock.triangleIndex[lane];
+		return true;
+	});
+
+	RenderStats::add(RenderStats::TriangleTests, blockTests * SIMD_WIDTH);
+	return hit;
+}
+
+SIMD_KERNEL bool Mesh::isOccluded(const Ray& ray, float tMax) const {
+	uint64_t blockTests = 0;
+	bool occluded = wideBvh.traverseAny(ray, tMax, [this, &ray, &blockTests](size_t block, float tMax) {
+		++blockTests;
+		return triangleBlocks[block].isOccluding(ray, tMax);
+	});
+
+	RenderStats::add(RenderStats::TriangleTests, blockTests * SIMD_WIDTH);
+	return occluded;
+}
+
+SIMD_KERNEL uint32_t Mesh::traceRayPacket(RayPacket& packet, uint32_t laneMask, uint32_t* triangleIndices) const {
+	uint32_t hitLanes = 0;
+	uint64_t triangleTests = 0;
+
+	bvh.traversePacket(packet, laneMask, [this, &packet, &hitLanes, &triangleTests, triangleIndices](size_t index, uint32_t laneMask) {
+		triangleTests += __builtin_popcount(laneMask);
+		alignas(SIMD_ALIGNMENT) float t[RAY_PACKET_SIZE];
+		uint32_t hitMask = triangles[index].rayIntersects(packet, laneMask, t);
+		hitLanes |= hitMask;
+
+		while (hitMask != 0) {
+			size_t lane = __builtin_ctz(hitMask);
+			packet.tMax[lane] = t[lane];
+			triangleIndices[lane] = index;
+			hitMask &= hitMask - 1;
+		}
+	});
+
+	RenderStats::add(RenderStats::TriangleTests, triangleTests);
+	return hitLanes;
 }
@@ -6,8 +6,14 @@
 
 #include "../init_exception.h"
 #include "../math/vector.h"
+#include "../math/ray.h"
+#include "../math/ray_packet.h"
 #include "../math/bounding_volume_hierachy.h"
+#include "../math/wide_bvh.h"
+#include "triangle.h"
 
+class BinaryWriter;
+class BinaryReader;
 
 class Mesh {
 	public:
@@ -21,9 +27,26 @@ class Mesh {
 
 		void addVertex(const Vector3f& pos, const Vector3f& normal);
 		void addIndex(const Vector3u& index);
-		void init();
+		void init(BVH::BuildMethod buildMethod=BVH::BuildMethod::BinnedSAH);
+
+		// vertices, indices and both hierarchies, the triangles are rebuilt from them when reading,
+		// inconsistent data marks the reader invalid
+		void write(BinaryWriter& writer) const;
+		void read(BinaryReader& reader);
+
+		// queries in object space, shared by all objects using this mesh
+		bool traceRay(const Ray& ray, float& tMax, uint32_t& triangleIndex) const;
+		bool isOccluded(const Ray& ray, float tMax) const;
+		uint32_t traceRayPacket(RayPacket& packet, uint32_t laneMask, uint32_t* triangleIndices) const;
 
 		std::vector<Vertex> vertices;
 		std::vector<size_t> indices;
+		std::vector<Triangle> triangles;
+		std::vector<TriangleBlock> triangleBlocks;
 		BVH bvh;
+		WideBVH wideBvh;
+
+	private:
+		void initTriangles();
+		void initTriangleBlocks();
 };
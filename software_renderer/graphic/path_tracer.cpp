@@ -1,97 +1,236 @@
 #include "path_tracer.h"
 
-#define SURFACE_DISTANCE_OFFSET 0.01f
+#include "../render_stats.h"
 
+#define SURFACE_DISTANCE_OFFSET 0.01f
+// the diffuse bounces sample the hemisphere uniformly
+#define DIFFUSE_DIRECTION_PDF float(1.0 / (2.0 * M_PI))
 
-PathTracer::PathTracer()
-:rng(new RandomGenerator()) {}
 
-PathTracer::~PathTracer() {
-	delete rng;
+static float powerHeuristic(float pdf, float otherPdf) {
+	return (pdf * pdf) / (pdf * pdf + otherPdf * otherPdf);
 }
 
+PathTracer::PathTracer() {}
+
+PathTracer::~PathTracer() {}
+
 void PathTracer::parseInput(const InputEntry& inputEntry) {
 	visionJumpCount = inputEntry.get<unsigned int>("visionJumpCount");
 	raysPerPixel    = inputEntry.get<unsigned int>("raysPerPixel");
+	nextEventEstimation = inputEntry.keyExists("nextEventEstimation") && inputEntry.get<unsigned int>("nextEventEstimation") != 0;
+	lightTree = inputEntry.keyExists("lightTree") && inputEntry.get<unsigned int>("lightTree") != 0;
 }
 
-Vector3f PathTracer::renderPixel(const PixelRenderData& prd) const {
-	Vector2f pixelCenter = Vector2f({(float) prd.pixel[0], (float) prd.pixel[1]}) + Vector2f({0.5f, 0.5f});
-	Vector2f inUV = Vector2f({pixelCenter[0] / (float) prd.imageSize[0], pixelCenter[1] / (float) prd.imageSize[1]});
-	Vector2f d = (2.0f * inUV) - Vector2f({1.0f, 1.0f});
-	Vector3f target = cutVector(prd.projInverse * Vector4f({d[0], d[1], 1.0f, 1.0f})).normalize();
-	Vector3f direction = cutVector(prd.viewInverse * expandVector(target, 0.0f)).normalize();
+unsigned int PathTracer::getRaysPerPixel() const {
+	return raysPerPixel;
+}
 
+bool PathTracer::usesLightTree() const {
+	return nextEventEstimation && lightTree;
+}
+
+Vector3f PathTracer::renderPixel(const PixelRenderData& prd) const {
 	Vector3f finalColor({0.0f, 0.0f, 0.0f});
-	std::vector<HitPoint> visionPath(visionJumpCount);
-	Ray startVisionRay(prd.origin, direction);
-	for (unsigned int i = 0; i < raysPerPixel; ++i) {
-		uint visionPathDepth = traceSinglePath(prd, visionPath, startVisionRay, 0, visionJumpCount);
+	Ray startVisionRay = getStartRay(prd, prd.pixel);
+	Scene::RayHit primaryHit;
+	if (prd.sampleCount > 0 && visionJumpCount > 0) primaryHit = tracePrimaryRay(prd, startVisionRay);
+	PathState path;
+	for (unsigned int i = 0; i < prd.sampleCount; ++i) {
+		startPath(path, startVisionRay);
+
+		for (size_t depth = 0; depth < visionJumpCount && path.active; ++depth) {
+			if (depth == 0) {
+				if (primaryHit.obj == nullptr) break;
+				continuePath(prd, prd.rng, path, depth, primaryHit);
+				continue;
+			}
 
-		if (visionPathDepth == 0) continue;
-		if (!visionPath[visionPathDepth - 1].lightHit) continue;
+			Scene::RayHit hit;
+			RenderStats::add(RenderStats::SecondaryRays, 1);
+			if (!prd.scene->traceRay(path.ray, hit)) break;
+			continuePath(prd, prd.rng, path, depth, hit);
+		}
 
-		finalColor += visionPath[visionPathDepth - 1].cumulativeColor;
+		RenderStats::addPath(path.pathDepth);
+		finalColor += path.radiance;
 	}
 	
-	finalColor *= 2.0f * M_PI * (1.0f / float(raysPerPixel));
+	finalColor *= 2.0f * M_PI;
 
 	return finalColor;
 }
 
-size_t PathTracer::traceSinglePath(const PixelRenderData& prd, std::vector<HitPoint>& path, Ray ray, size_t startDepth, size_t maxDepth) const {
-	Vector3f color = Vector3f({1.0f, 1.0f, 1.0f});
-	size_t pathDepth = 0;
-
-	Mesh::Vertex hitVertex;
-	const GraphicsObject* obj;
-	bool backfaceCulling = true;
-
-	for (size_t i = startDepth; i < maxDepth; ++i) {
-		if (!prd.scene->traceRay(ray, hitVertex, obj)) {
-			break;
-		} else {
-			float ndotd = hitVertex.normal.dot(ray.direction);
-			if (backfaceCulling && ndotd > 0.0f) {
-				ray.origin = hitVertex.pos + SURFACE_DISTANCE_OFFSET * ray.direction;
+// Wavefront version of renderPixel: every bounce of all paths in the tile is traced as
+// one ray stream. Each pixel keeps its own random stream, so the image matches renderPixel.
+// The camera rays are traced once, the first bounce of every sample starts from their hits.
+void PathTracer::renderTile(const PixelRenderData& prd, const Vector2u& tileStart, const Vector2u& tileEnd, Vector3f* colors) const {
+	uint32_t tileWidth = tileEnd[0] - tileStart[0];
+	uint32_t pixelCount = tileWidth * (tileEnd[1] - tileStart[1]);
+
+	std::vector<RandomGenerator> rngs(pixelCount);
+	std::vector<Ray> startVisionRays(pixelCount);
+	std::vector<PathState> paths(pixelCount);
+	for (uint32_t p = 0; p < pixelCount; ++p) {
+		Vector2u pixel({tileStart[0] + p % tileWidth, tileStart[1] + p / tileWidth});
+		rngs[p].seed(prd.seed, getRandomStream(prd, pixel));
+		startVisionRays[p] = getStartRay(prd, pixel);
+		colors[p] = Vector3f({0.0f, 0.0f, 0.0f});
+	}
+
+	std::vector<Ray> rays;
+	std::vector<uint32_t> rayPaths;
+	std::vector<Scene::RayHit> hits;
+	std::vector<Scene::RayHit> primaryHits;
+	rays.reserve(pixelCount);
+	rayPaths.reserve(pixelCount);
+
+	if (prd.sampleCount > 0 && visionJumpCount > 0) {
+		// only the camera rays are known to be coherent in tile order
+		RenderStats::add(RenderStats::PrimaryRays, pixelCount);
+		prd.scene->traceRays(startVisionRays, primaryHits, true);
+	}
+
+	for (unsigned int i = 0; i < prd.sampleCount; ++i) {
+		for (uint32_t p = 0; p < pixelCount; ++p) startPath(paths[p], startVisionRays[p]);
+
+		for (size_t depth = 0; depth < visionJumpCount; ++depth) {
+			if (depth == 0) {
+				for (uint32_t p = 0; p < pixelCount; ++p) {
+					if (primaryHits[p].obj == nullptr) {
+						paths[p].active = false;
+						continue;
+					}
+					continuePath(prd, &rngs[p], paths[p], depth, primaryHits[p]);
+				}
 				continue;
 			}
-			backfaceCulling = false;
-
-			pathDepth = i + 1;
-			float rayHandlingValue = rng->rand();
-
-			Vector3f prevDirection = ray.direction;
-			if (rayHandlingValue <= obj->diffuseThreshold) {
-				ray.direction = rng->randomNormalDirection(hitVertex.normal);
-			} else if (rayHandlingValue <= obj->reflectThreshold) {
-				ray.direction = reflect(ray.direction, hitVertex.normal);
-			} else if (rayHandlingValue <= obj->transparentThreshold) {
-				ray.direction = customRefract(ray.direction, hitVertex.normal, obj->refractionIndex);
-			}
-			ray.origin = hitVertex.pos + SURFACE_DISTANCE_OFFSET * ray.direction;
-			ray.update();
-
-			if (rayHandlingValue <= obj->diffuseThreshold) {
-				color *= obj->color * hitVertex.normal.dot(ray.direction);
-				path[i].diffuse = true;
-			} else {
-				path[i].diffuse = false;
+
+			rays.clear();
+			rayPaths.clear();
+			for (uint32_t p = 0; p < pixelCount; ++p) {
+				if (!paths[p].active) continue;
+				rays.push_back(paths[p].ray);
+				rayPaths.push_back(p);
 			}
+			if (rays.empty()) break;
 
-			path[i].pos = hitVertex.pos;
-			path[i].normal = hitVertex.normal;
-			path[i].cumulativeColor = color;
-			path[i].lightHit = false;
+			RenderStats::add(RenderStats::SecondaryRays, rays.size());
+			prd.scene->traceRays(rays, hits, false);
 
-			if (obj->lightSource) {
-				if (hitVertex.normal.dot(prevDirection) <= 0.0f) {
-					path[i].lightHit = true;
-					break;
+			for (size_t r = 0; r < rays.size(); ++r) {
+				PathState& path = paths[rayPaths[r]];
+				if (hits[r].obj == nullptr) {
+					path.active = false;
+					continue;
 				}
+				continuePath(prd, &rngs[rayPaths[r]], path, depth, hits[r]);
 			}
 		}
+
+		for (uint32_t p = 0; p < pixelCount; ++p) {
+			RenderStats::addPath(paths[p].pathDepth);
+			colors[p] += paths[p].radiance;
+		}
+	}
+
+	for (uint32_t p = 0; p < pixelCount; ++p) {
+		colors[p] *= 2.0f * M_PI;
+	}
+}
+
+Ray PathTracer::getStartRay(const PixelRenderData& prd, const Vector2u& pixel) const {
+	Vector2f pixelCenter = Vector2f({(float) pixel[0], (float) pixel[1]}) + Vector2f({0.5f, 0.5f});
+	Vector2f inUV = Vector2f({pixelCenter[0] / (float) prd.imageSize[0], pixelCenter[1] / (float) prd.imageSize[1]});
+	Vector2f d = (2.0f * inUV) - Vector2f({1.0f, 1.0f});
+	Vector3f target = cutVector(prd.projInverse * Vector4f({d[0], d[1], 1.0f, 1.0f})).normalize();
+	Vector3f direction = cutVector(prd.viewInverse * expandVector(target, 0.0f)).normalize();
+
+	return Ray(prd.origin, direction);
+}
+
+void PathTracer::startPath(PathState& path, const Ray& ray) const {
+	path.ray = ray;
+	path.color = Vector3f({1.0f, 1.0f, 1.0f});
+	path.radiance = Vector3f({0.0f, 0.0f, 0.0f});
+	path.lightSampled = false;
+	path.pathDepth = 0;
+	path.backfaceCulling = true;
+	path.active = true;
+}
+
+SIMD_KERNEL void PathTracer::continuePath(const PixelRenderData& prd, RandomGenerator* rng, PathState& path, size_t depth, const Scene::RayHit& hit) const {
+	const Mesh::Vertex& hitVertex = hit.vertex;
+	const GraphicsObject* obj = hit.obj;
+	float ndotd = hitVertex.normal.dot(path.ray.direction);
+	if (path.backfaceCulling && ndotd > 0.0f) {
+		path.ray.origin = hitVertex.pos + SURFACE_DISTANCE_OFFSET * path.ray.direction;
+		return;
+	}
+	path.backfaceCulling = false;
+
+	path.pathDepth = depth + 1;
+	float rayHandlingValue = rng->rand();
+	bool diffuse = rayHandlingValue <= obj->diffuseThreshold;
+	bool lightHit = obj->lightSource && ndotd <= 0.0f;
+
+	if (diffuse) {
+		path.ray.direction = rng->randomNormalDirection(hitVertex.normal);
+	} else if (rayHandlingValue <= obj->reflectThreshold) {
+		path.ray.direction = reflect(path.ray.direction, hitVertex.normal);
+	} else if (rayHandlingValue <= obj->transparentThreshold) {
+		path.ray.direction = customRefract(path.ray.direction, hitVertex.normal, obj->refractionIndex);
+	}
+	path.ray.origin = hitVertex.pos + SURFACE_DISTANCE_OFFSET * path.ray.direction;
+	path.ray.update();
+
+	// the bounce after the last vertex is not traced, so it does not sample the lights either
+	bool sampleLights = nextEventEstimation && diffuse && !lightHit && depth + 1 < visionJumpCount && !prd.lightSampler->empty();
+	if (sampleLights) sampleLightSources(prd, rng, path, hitVertex, obj);
+
+	if (diffuse) {
+		path.color *= obj->color * hitVertex.normal.dot(path.ray.direction);
+	}
+
+	if (lightHit) {
+		float weight = 1.0f;
+		if (path.lightSampled) {
+			float cosLight = -ndotd;
+			float pdf = usesLightTree()
+				? prd.lightTree->getPdf(path.lightSamplePos, path.lightSampleNormal, obj, hit.triangleIndex)
+				: prd.lightSampler->getPdf(obj, hit.triangleIndex);
+			float lightPdf = pdf * hitVertex.pos.distanceSquared(path.lightSamplePos) / cosLight;
+			weight = cosLight > 0.0f ? powerHeuristic(DIFFUSE_DIRECTION_PDF, lightPdf) : 0.0f;
+		}
+		path.radiance += weight * path.color;
+		path.active = false;
 	}
 
-	return pathDepth;
+	path.lightSampled = sampleLights;
+	path.lightSamplePos = hitVertex.pos;
+	path.lightSampleNormal = hitVertex.normal;
+}
+
+// One shadow ray to a point on the light sources. The estimate is the same integral the diffuse
+// bounce samples with DIFFUSE_DIRECTION_PDF, so the light pdf is converted to solid angle.
+void PathTracer::sampleLightSources(const PixelRenderData& prd, RandomGenerator* rng, PathState& path, const Mesh::Vertex& hitVertex, const GraphicsObject* obj) const {
+	LightSampler::Sample light = usesLightTree() ? prd.lightTree->sample(rng, hitVertex.pos, hitVertex.normal) : prd.lightSampler->sample(rng);
+	if (light.pdf <= 0.0f) return;
+
+	Vector3f direction = light.pos - hitVertex.pos;
+	float distanceSquared = direction.magnitudeSquared();
+	direction.normalize();
+
+	float cosSurface = hitVertex.normal.dot(direction);
+	float cosLight = -light.normal.dot(direction);
+	if (distanceSquared <= 0.0f || cosSurface <= 0.0f || cosLight <= 0.0f) return;
+
+	Vector3f startPos = hitVertex.pos + SURFACE_DISTANCE_OFFSET * hitVertex.normal;
+	Vector3f endPos = light.pos + SURFACE_DISTANCE_OFFSET * light.normal;
+	RenderStats::add(RenderStats::ShadowRays, 1);
+	if (prd.scene->isOccluded(startPos, endPos)) return;
+
+	float lightPdf = light.pdf * distanceSquared / cosLight;
+	float weight = powerHeuristic(lightPdf, DIFFUSE_DIRECTION_PDF);
+	path.radiance += path.color * obj->color * getLightEmission(light.obj) * (cosSurface * DIFFUSE_DIRECTION_PDF * weight / lightPdf);
 }
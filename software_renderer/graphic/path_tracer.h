@@ -3,7 +3,6 @@
 #include <vector>
 
 #include "renderer.h"
-#include "../math/random.h"
 
 
 class PathTracer: public Renderer {
@@ -12,21 +11,37 @@ class PathTracer: public Renderer {
 		~PathTracer();
 
 		virtual void parseInput(const InputEntry& inputEntry) override;
+		virtual unsigned int getRaysPerPixel() const override;
 		virtual Vector3f renderPixel(const PixelRenderData& prd) const override;
+		virtual bool usesLightTree() const override;
+		virtual void renderTile(const PixelRenderData& prd, const Vector2u& tileStart, const Vector2u& tileEnd, Vector3f* colors) const override;
 	
 	private:
-		struct HitPoint {
-			Vector3f pos;
-			Vector3f normal;
-			Vector3f cumulativeColor;
-			bool diffuse;
-			bool lightHit;
+		struct PathState {
+			Ray ray;
+			Vector3f color;
+			// the light gathered so far, the sum over the samples is the pixel color
+			Vector3f radiance;
+			// the last vertex sampled the lights, so a light hit after it is weighted by MIS
+			Vector3f lightSamplePos;
+			Vector3f lightSampleNormal;
+			bool lightSampled;
+			size_t pathDepth;
+			bool backfaceCulling;
+			bool active;
 		};
 
-		RandomGenerator* rng;
-
 		unsigned int visionJumpCount;
 		unsigned int raysPerPixel;
-
-		size_t traceSinglePath(const PixelRenderData& prd, std::vector<HitPoint>& path, Ray ray, size_t startDepth, size_t maxDepth) const;
+		// next event estimation: every diffuse vertex also samples a point on the light sources,
+		// combined with the light hits of the diffuse bounces by multiple importance sampling
+		bool nextEventEstimation;
+		// next event estimation picks the lights through the light tree, by their estimated
+		// contribution to the vertex, instead of by power alone
+		bool lightTree;
+
+		Ray getStartRay(const PixelRenderData& prd, const Vector2u& pixel) const;
+		void startPath(PathState& path, const Ray& ray) const;
+		void continuePath(const PixelRenderData& prd, RandomGenerator* rng, PathState& path, size_t depth, const Scene::RayHit& hit) const;
+		void sampleLightSources(const PixelRenderData& prd, RandomGenerator* rng, PathState& path, const Mesh::Vertex& hitVertex, const GraphicsObject* obj) const;
 };
@@ -0,0 +1,42 @@
+#include "renderer.h"
+
+#include "../render_stats.h"
+
+
+void Renderer::renderTile(const PixelRenderData& prd, const Vector2u& tileStart, const Vector2u& tileEnd, Vector3f* colors) const {
+	renderTilePixels(prd, tileStart, tileEnd, colors);
+}
+
+void Renderer::renderTilePixels(const PixelRenderData& prd, const Vector2u& tileStart, const Vector2u& tileEnd, Vector3f* colors) const {
+	PixelRenderData pixelPrd = prd;
+	uint32_t tileWidth = tileEnd[0] - tileStart[0];
+
+	for (uint32_t y = tileStart[1]; y < tileEnd[1]; ++y) {
+		for (uint32_t x = tileStart[0]; x < tileEnd[0]; ++x) {
+			pixelPrd.pixel[0] = x;
+			pixelPrd.pixel[1] = y;
+			pixelPrd.rng->seed(prd.seed, getRandomStream(prd, pixelPrd.pixel));
+
+			colors[(x - tileStart[0]) + (y - tileStart[1]) * tileWidth] = renderPixel(pixelPrd);
+		}
+	}
+}
+
+Scene::RayHit Renderer::tracePrimaryRay(const PixelRenderData& prd, const Ray& ray) {
+	Scene::RayHit hit;
+	RenderStats::add(RenderStats::PrimaryRays, 1);
+	prd.scene->traceRay(ray, hit);
+	return hit;
+}
+
+// The light a path gathers when it ends in the light source, on average: the light bounces its
+// diffuse part like any surface, which halves it, and passes the rest on unchanged.
+Vector3f Renderer::getLightEmission(const GraphicsObject* lightSource) {
+	return lightSource->diffuseThreshold * 0.5f * lightSource->color + (1.0f - lightSource->diffuseThreshold);
+}
+
+// every pass and stage gets its own streams, a single pass keeps the plain pixel index
+uint64_t Renderer::getRandomStream(const PixelRenderData& prd, const Vector2u& pixel) {
+	uint64_t pixelIndex = pixel[0] + uint64_t(pixel[1]) * prd.imageSize[0];
+	return ((uint64_t(prd.stage) << 56) ^ (uint64_t(prd.sampleStart) << 32)) | pixelIndex;
+}
@@ -2,8 +2,11 @@
 
 #include "../math/vector.h"
 #include "../math/matrix.h"
+#include "../math/random.h"
 #include "../input_parser.h"
 #include "scene.h"
+#include "light_sampler.h"
+#include "light_tree.h"
 
 
 class Renderer {
@@ -12,6 +15,18 @@ class Renderer {
 			const Scene* scene;
 			const std::vector<GraphicsObject*>* objects;
 			const std::vector<GraphicsObject*>* lightSources;
+			const LightSampler* lightSampler;
+			// only built for renderers that return true from usesLightTree
+			const LightTree* lightTree;
+			RandomGenerator* rng;
+			uint64_t seed;
+
+			// renderers trace sampleCount samples per pixel and return their sum,
+			// sampleStart selects the random streams of the pass
+			unsigned int sampleStart;
+			unsigned int sampleCount;
+			// see getStageCount
+			unsigned int stage;
 
 			Vector2u imageSize;
 			Vector2u pixel;
@@ -24,5 +39,23 @@ class Renderer {
 		virtual ~Renderer() {}
 
 		virtual void parseInput(const InputEntry& inputEntry)=0;
+		virtual unsigned int getRaysPerPixel() const=0;
 		virtual Vector3f renderPixel(const PixelRenderData& prd) const=0;
+		virtual bool usesLightTree() const { return false; }
+		// Renderers that share data between pixels render one sample per pass in several stages,
+		// every stage runs over all tiles before the next one starts and only the colors of the
+		// last stage are kept. beginPass is called once before the stages of every pass.
+		virtual unsigned int getStageCount() const { return 1; }
+		virtual void beginPass(const PixelRenderData& /*prd*/) {}
+		// Renders the pixels in [tileStart, tileEnd) row by row into colors. Renderers
+		// that trace rays in batches override this, the default renders pixel by pixel.
+		virtual void renderTile(const PixelRenderData& prd, const Vector2u& tileStart, const Vector2u& tileEnd, Vector3f* colors) const;
+		void renderTilePixels(const PixelRenderData& prd, const Vector2u& tileStart, const Vector2u& tileEnd, Vector3f* colors) const;
+
+		static uint64_t getRandomStream(const PixelRenderData& prd, const Vector2u& pixel);
+		// The camera rays are not jittered, so all samples of a pixel share the first hit.
+		// Renderers trace it once per pixel and start every sample from it, obj is nullptr on a miss.
+		static Scene::RayHit tracePrimaryRay(const PixelRenderData& prd, const Ray& ray);
+		// the light of a light source that paths ending in it gather, see PathTracer
+		static Vector3f getLightEmission(const GraphicsObject* lightSource);
 };
@@ -1,5 +1,41 @@
 #include "scene.h"
 
+#include <numeric>
+#include <algorithm>
+
+#include "../binary_file.h"
+
+// an object test moves the ray into object space before its own BVH is traversed
+#define OBJECT_INTERSECTION_COST 4.0f
+
+
+static uint32_t expandBits(uint32_t x) {
+	x = (x | (x << 16)) & 0x030000FF;
+	x = (x | (x <<  8)) & 0x0300F00F;
+	x = (x | (x <<  4)) & 0x030C30C3;
+	x = (x | (x <<  2)) & 0x09249249;
+	return x;
+}
+
+// direction octant in the top bits, 30 bit Morton code of the origin below
+static uint64_t getRaySortKey(const Ray& ray, const AABB& bounds) {
+	uint64_t octant = 0;
+	for (size_t i = 0; i < 3; ++i) {
+		if (ray.direction[i] < 0.0f) octant |= uint64_t(1) << i;
+	}
+
+	Vector3f boundsMin = bounds.getMin();
+	Vector3f extent = bounds.getMax() - boundsMin;
+	uint32_t code = 0;
+	for (size_t i = 0; i < 3; ++i) {
+		float relative = extent[i] > 0.0f ? (ray.origin[i] - boundsMin[i]) / extent[i] : 0.0f;
+		uint32_t cell = uint32_t(std::clamp(relative * 1024.0f, 0.0f, 1023.0f));
+		code |= expandBits(cell) << i;
+	}
+
+	return (octant << 32) | code;
+}
+
 
 Scene::Scene()
 :objs() {}
@@ -10,74 +46,109 @@ void Scene::addObject(GraphicsObject* obj) {
 	objs.push_back(obj);
 }
 
-void Scene::init() {
+void Scene::init(BVH::BuildMethod buildMethod) {
 	std::vector<BVH::Data> inputs;
 	inputs.reserve(objs.size());
 	for (size_t i = 0; i < objs.size(); ++i) {
 		inputs.push_back({objs[i]->aabb, i});
 	}
-	bvh.init(inputs);
+	bvh.init(inputs, buildMethod, OBJECT_INTERSECTION_COST);
+}
+
+void Scene::write(BinaryWriter& writer) const {
+	bvh.write(writer);
+}
+
+void Scene::read(BinaryReader& reader) {
+	bvh.read(reader);
+	if (reader.isValid() && !bvh.isValid(objs.size())) reader.invalidate();
 }
 
 bool Scene::traceRay(const Ray& ray, Mesh::Vertex& hitVertex, const GraphicsObject*& currentObj) const {
-	std::vector<size_t> elems = bvh.getHits(ray);
-	if (elems.empty()) return false;
+	RayHit hit;
+	bool found = traceRay(ray, hit);
+	hitVertex = hit.vertex;
+	currentObj = hit.obj;
+	return found;
+}
 
-	std::vector<GraphicsObject*> potentialHits(elems.size());
-	for (size_t i = 0; i < elems.size(); ++i) {
-		potentialHits[i] = objs[elems[i]];
-	}
+SIMD_KERNEL bool Scene::traceRay(const Ray& ray, RayHit& hit) const {
+	float tMax = INFINITY;
+	hit.triangleIndex = 0;
+	hit.obj = nullptr;
 
-	float minDistance = INFINITY;
-	const Triangle* currentTriangle = nullptr;
-	currentObj = nullptr;
-	Vector3f hitPos;
-	for (const GraphicsObject* obj: potentialHits) {
-		if (obj->traceRay(ray, hitPos, currentTriangle, minDistance)) {
-			currentObj = obj;
+	bvh.traverse(ray, tMax, [this, &ray, &hit](size_t index, float& tMax) {
+		if (objs[index]->traceRay(ray, tMax, hit.triangleIndex)) {
+			hit.obj = objs[index];
+			return true;
 		}
-	}
+		return false;
+	});
+
+	if (hit.obj == nullptr) return false;
+
+	hit.obj->getHitVertex(ray, tMax, hit.triangleIndex, hit.vertex);
+	return true;
+}
 
-	if (currentObj == nullptr) return false;
+SIMD_KERNEL bool Scene::isOccluded(const Vector3f& startPos, const Vector3f& endPos) const {
+	Ray ray(startPos, endPos - startPos);
 
-	Vector3f barycentricCoords = currentTriangle->getBarycentricCoords(hitPos);
-	hitVertex.pos = hitPos;
+	return bvh.traverseAny(ray, 1.0f, [this, &ray](size_t index, float tMax) {
+		return objs[index]->isOccluded(ray, tMax);
+	});
+}
 
-	const Mesh::Vertex& vert0 = currentObj->vertices[currentTriangle->indices[0]];
-	const Mesh::Vertex& vert1 = currentObj->vertices[currentTriangle->indices[1]];
-	const Mesh::Vertex& vert2 = currentObj->vertices[currentTriangle->indices[2]];
-	hitVertex.normal = Vector3f({0.0f, 0.0f, 0.0f});
-	hitVertex.normal += barycentricCoords[0] * vert0.normal;
-	hitVertex.normal += barycentricCoords[1] * vert1.normal;
-	hitVertex.normal += barycentricCoords[2] * vert2.normal;
-	hitVertex.normal.normalize();
+SIMD_KERNEL void Scene::traceRayPacket(RayPacket& packet, RayHit* hits) const {
+	uint32_t triangleIndices[RAY_PACKET_SIZE];
+	for (size_t lane = 0; lane < RAY_PACKET_SIZE; ++lane) hits[lane].obj = nullptr;
 
-	return true;
+	bvh.traversePacket(packet, packet.activeMask, [this, &packet, hits, &triangleIndices](size_t index, uint32_t laneMask) {
+		uint32_t hitLanes = objs[index]->traceRayPacket(packet, laneMask, triangleIndices);
+		while (hitLanes != 0) {
+			size_t lane = __builtin_ctz(hitLanes);
+			hits[lane].obj = objs[index];
+			hitLanes &= hitLanes - 1;
+		}
+	});
+
+	for (size_t lane = 0; lane < RAY_PACKET_SIZE; ++lane) {
+		if (hits[lane].obj == nullptr) continue;
+		hits[lane].triangleIndex = triangleIndices[lane];
+		hits[lane].obj->getHitVertex(packet.getRay(lane), packet.tMax[lane], triangleIndices[lane], hits[lane].vertex);
+	}
 }
 
-bool Scene::isOccluded(const Vector3f& startPos, const Vector3f& endPos) const {
-	Vector3f direction = endPos - startPos;
-	float dist2 = direction.magnitudeSquared();
+void Scene::traceRays(const std::vector<Ray>& rays, std::vector<RayHit>& hits, bool coherent) const {
+	hits.resize(rays.size());
 
-	direction.normalize();
-	Ray ray(startPos, direction);
+	std::vector<uint32_t> order(rays.size());
+	std::iota(order.begin(), order.end(), 0);
 
-	std::vector<size_t> elems = bvh.getHits(ray);
-	if (elems.empty()) return false;
+	if (!coherent) {
+		AABB bounds = bvh.getBounds();
+		std::vector<uint64_t> keys(rays.size());
+		for (size_t i = 0; i < rays.size(); ++i) keys[i] = getRaySortKey(rays[i], bounds);
 
-	std::vector<GraphicsObject*> potentialHits(elems.size());
-	for (size_t i = 0; i < elems.size(); ++i) {
-		potentialHits[i] = objs[elems[i]];
+		std::sort(order.begin(), order.end(), [&keys](uint32_t a, uint32_t b) {
+			return keys[a] < keys[b];
+		});
 	}
 
-	float minDistance2 = INFINITY;
-	const Triangle* currentTriangle = nullptr;
-	Vector3f hitPos;
-	for (const GraphicsObject* obj: potentialHits) {
-		if (obj->traceRay(ray, hitPos, currentTriangle, minDistance2)) {
-			if (minDistance2 <= dist2) return true;
-		}
+	RayPacket packet;
+	RayHit packetHits[RAY_PACKET_SIZE];
+	for (size_t start = 0; start < rays.size(); start += RAY_PACKET_SIZE) {
+		size_t count = std::min(rays.size() - start, size_t(RAY_PACKET_SIZE));
+
+		packet.clear();
+		for (size_t lane = 0; lane < count; ++lane) packet.setRay(lane, rays[order[start + lane]]);
+
+		traceRayPacket(packet, packetHits);
+
+		for (size_t lane = 0; lane < count; ++lane) hits[order[start + lane]] = packetHits[lane];
 	}
+}
 
-	return false;
+BVH::Stats Scene::getBVHStats() const {
+	return bvh.getStats();
 }
@@ -4,18 +4,35 @@
 #include "triangle.h"
 
 #include "../math/ray.h"
+#include "../math/ray_packet.h"
 #include "../math/bounding_volume_hierachy.h"
 
 
 class Scene {
 	public:
+		struct RayHit {
+			Mesh::Vertex vertex;
+			const GraphicsObject* obj;
+			uint32_t triangleIndex;
+		};
+
 		Scene();
 		~Scene();
 
 		void addObject(GraphicsObject* obj);
-		void init();
+		void init(BVH::BuildMethod buildMethod=BVH::BuildMethod::BinnedSAH);
+		// only the object hierarchy, the same objects have to be added in the same order before reading
+		void write(BinaryWriter& writer) const;
+		void read(BinaryReader& reader);
 		bool traceRay(const Ray& ray, Mesh::Vertex& hitVertex, const GraphicsObject*& currentObj) const;
+		// hit.obj is nullptr on a miss
+		bool traceRay(const Ray& ray, RayHit& hit) const;
 		bool isOccluded(const Vector3f& startPos, const Vector3f& endPos) const;
+		// hits[lane].obj is nullptr for lanes that miss or are not active
+		void traceRayPacket(RayPacket& packet, RayHit* hits) const;
+		// traces a stream of rays in packets, incoherent streams get sorted by direction and origin first
+		void traceRays(const std::vector<Ray>& rays, std::vector<RayHit>& hits, bool coherent) const;
+		BVH::Stats getBVHStats() const;
 	
 	private:
 		std::vector<GraphicsObject*> objs;
@@ -1,26 +1,18 @@
 #include "triangle.h"
 
 
-Triangle::Triangle(const Vector3u& indices, const Vector3f& v0, const Vector3f& v1, const Vector3f& v2)
-:indices(indices), v0(v0), v1(v1), v2(v2) {
-	edge0 = v1 - v0;
-	edge1 = v2 - v0;
+static_assert(sizeof(Triangle) == 36, "Triangle should only hold v0, edge0 and edge1");
 
-	d00 = edge0.dot(edge0);
-	d01 = edge0.dot(edge1);
-	d11 = edge1.dot(edge1);
-	denom = d00 * d11 - d01 * d01;
 
-	aabb.addPoint(v0);
-	aabb.addPoint(v1);
-	aabb.addPoint(v2);
-}
+Triangle::Triangle(const Vector3f& v0, const Vector3f& v1, const Vector3f& v2)
+:v0(v0), edge0(v1 - v0), edge1(v2 - v0) {}
 
 Triangle::~Triangle() {}
 
-bool Triangle::rayIntersects(const Ray& ray, Vector3f& outIntersectionPoint) const {
-	constexpr float EPSILON = 0.0000001f;
+#define EPSILON 0.0000001f
+
 
+SIMD_KERNEL bool Triangle::rayIntersects(const Ray& ray, float& t) const {
 	Vector3f h = cross(ray.direction, edge1);
 	float a = edge0.dot(h);
 	if (a > -EPSILON && a < EPSILON) return false;
@@ -34,17 +26,137 @@ bool Triangle::rayIntersects(const Ray& ray, Vector3f& outIntersectionPoint) con
 	float v = f * ray.direction.dot(q);
 	if (v < 0.0f || u + v > 1.0f) return false;
 
-	float t = f * edge1.dot(q);
-	if (t > EPSILON) {
-		outIntersectionPoint = ray.origin + (t * ray.direction);
-		return true;
+	t = f * edge1.dot(q);
+	return t > EPSILON;
+}
+
+SIMD_KERNEL uint32_t Triangle::rayIntersects(const RayPacket& packet, uint32_t laneMask, float* t) const {
+	uint32_t hitMask = 0;
+
+	for (size_t g = 0; g < RAY_PACKET_GROUPS; ++g) {
+		size_t offset = g * SIMD_WIDTH;
+		if (((laneMask >> offset) & ((uint32_t(1) << SIMD_WIDTH) - 1)) == 0) continue;
+
+		SimdFloat dx = SimdFloat::load(packet.direction[0] + offset);
+		SimdFloat dy = SimdFloat::load(packet.direction[1] + offset);
+		SimdFloat dz = SimdFloat::load(packet.direction[2] + offset);
+
+		// same operation order as the single ray test, so both give the same t
+		SimdFloat hx = dy * SimdFloat(edge1[2]) - dz * SimdFloat(edge1[1]);
+		SimdFloat hy = dz * SimdFloat(edge1[0]) - dx * SimdFloat(edge1[2]);
+		SimdFloat hz = dx * SimdFloat(edge1[1]) - dy * SimdFloat(edge1[0]);
+		SimdFloat a = SimdFloat(edge0[0]) * hx + SimdFloat(edge0[1]) * hy + SimdFloat(edge0[2]) * hz;
+		SimdFloat valid = (a <= SimdFloat(-EPSILON)) | (SimdFloat(EPSILON) <= a);
+
+		SimdFloat f = SimdFloat(1.0f) / a;
+		SimdFloat sx = SimdFloat::load(packet.origin[0] + offset) - SimdFloat(v0[0]);
+		SimdFloat sy = SimdFloat::load(packet.origin[1] + offset) - SimdFloat(v0[1]);
+		SimdFloat sz = SimdFloat::load(packet.origin[2] + offset) - SimdFloat(v0[2]);
+		SimdFloat u = f * (sx * hx + sy * hy + sz * hz);
+		valid = valid & (SimdFloat(0.0f) <= u) & (u <= SimdFloat(1.0f));
+
+		SimdFloat qx = sy * SimdFloat(edge0[2]) - sz * SimdFloat(edge0[1]);
+		SimdFloat qy = sz * SimdFloat(edge0[0]) - sx * SimdFloat(edge0[2]);
+		SimdFloat qz = sx * SimdFloat(edge0[1]) - sy * SimdFloat(edge0[0]);
+		SimdFloat v = f * (dx * qx + dy * qy + dz * qz);
+		valid = valid & (SimdFloat(0.0f) <= v) & (u + v <= SimdFloat(1.0f));
+
+		SimdFloat tt = f * (SimdFloat(edge1[0]) * qx + SimdFloat(edge1[1]) * qy + SimdFloat(edge1[2]) * qz);
+		valid = valid & (SimdFloat(EPSILON) < tt) & (tt < SimdFloat::load(packet.tMax + offset));
+
+		tt.store(t + offset);
+		hitMask |= valid.mask() << offset;
+	}
+
+	return hitMask & laneMask;
+}
+
+TriangleBlock::TriangleBlock() {
+	for (size_t lane = 0; lane < SIMD_WIDTH; ++lane) {
+		for (size_t i = 0; i < 3; ++i) {
+			v0[i][lane] = 0.0f;
+			edge0[i][lane] = 0.0f;
+			edge1[i][lane] = 0.0f;
+		}
+		triangleIndex[lane] = 0;
+	}
+}
 
-	} else {
-		return false;
+void TriangleBlock::setTriangle(size_t lane, const Triangle& triangle, uint32_t index) {
+	for (size_t i = 0; i < 3; ++i) {
+		v0[i][lane] = triangle.v0[i];
+		edge0[i][lane] = triangle.edge0[i];
+		edge1[i][lane] = triangle.edge1[i];
 	}
+	triangleIndex[lane] = index;
+}
+
+SIMD_KERNEL int TriangleBlock::rayIntersects(const Ray& ray, float tMax, float& t) const {
+	alignas(SIMD_ALIGNMENT) float tLanes[SIMD_WIDTH];
+	uint32_t hitMask = getHitMask(ray, tMax, tLanes);
+
+	// the lowest lane wins ties, like the first triangle does in a scalar loop
+	int hitLane = -1;
+	while (hitMask != 0) {
+		int lane = __builtin_ctz(hitMask);
+		hitMask &= hitMask - 1;
+
+		if (tLanes[lane] < tMax) {
+			tMax = tLanes[lane];
+			hitLane = lane;
+		}
+	}
+
+	t = tMax;
+	return hitLane;
+}
+
+SIMD_KERNEL bool TriangleBlock::isOccluding(const Ray& ray, float tMax) const {
+	alignas(SIMD_ALIGNMENT) float tLanes[SIMD_WIDTH];
+	return getHitMask(ray, tMax, tLanes) != 0;
+}
+
+SIMD_KERNEL uint32_t TriangleBlock::getHitMask(const Ray& ray, float tMax, float* t) const {
+	SimdFloat dx(ray.direction[0]);
+	SimdFloat dy(ray.direction[1]);
+	SimdFloat dz(ray.direction[2]);
+	SimdFloat e0x = SimdFloat::load(edge0[0]), e0y = SimdFloat::load(edge0[1]), e0z = SimdFloat::load(edge0[2]);
+	SimdFloat e1x = SimdFloat::load(edge1[0]), e1y = SimdFloat::load(edge1[1]), e1z = SimdFloat::load(edge1[2]);
+
+	// same operation order as Triangle::rayIntersects, so both give the same t
+	SimdFloat hx = dy * e1z - dz * e1y;
+	SimdFloat hy = dz * e1x - dx * e1z;
+	SimdFloat hz = dx * e1y - dy * e1x;
+	SimdFloat a = e0x * hx + e0y * hy + e0z * hz;
+	SimdFloat valid = (a <= SimdFloat(-EPSILON)) | (SimdFloat(EPSILON) <= a);
+
+	SimdFloat f = SimdFloat(1.0f) / a;
+	SimdFloat sx = SimdFloat(ray.origin[0]) - SimdFloat::load(v0[0]);
+	SimdFloat sy = SimdFloat(ray.origin[1]) - SimdFloat::load(v0[1]);
+	SimdFloat sz = SimdFloat(ray.origin[2]) - SimdFloat::load(v0[2]);
+	SimdFloat u = f * (sx * hx + sy * hy + sz * hz);
+	valid = valid & (SimdFloat(0.0f) <= u) & (u <= SimdFloat(1.0f));
+
+	SimdFloat qx = sy * e0z - sz * e0y;
+	SimdFloat qy = sz * e0x - sx * e0z;
+	SimdFloat qz = sx * e0y - sy * e0x;
+	SimdFloat v = f * (dx * qx + dy * qy + dz * qz);
+	valid = valid & (SimdFloat(0.0f) <= v) & (u + v <= SimdFloat(1.0f));
+
+	SimdFloat tt = f * (e1x * qx + e1y * qy + e1z * qz);
+	valid = valid & (SimdFloat(EPSILON) < tt) & (tt < SimdFloat(tMax));
+
+	tt.store(t);
+	return valid.mask();
 }
 
 Vector3f Triangle::getBarycentricCoords(const Vector3f& outIntersectionPoint) const {
+	// only needed once per closest hit, so the dot products are not stored
+	float d00 = edge0.dot(edge0);
+	float d01 = edge0.dot(edge1);
+	float d11 = edge1.dot(edge1);
+	float denom = d00 * d11 - d01 * d01;
+
 	Vector3f edge2 = outIntersectionPoint - v0;
 	float d20 = edge2.dot(edge0);
 	float d21 = edge2.dot(edge1);
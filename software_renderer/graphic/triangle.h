@@ -1,32 +1,44 @@
 #pragma once
 
 #include "../math/ray.h"
+#include "../math/ray_packet.h"
 #include "../math/vector.h"
 #include "../math/matrix.h"
 #include "../math/aabb.h"
 
 
+// Intersection data only, the shading data stays in the Mesh and is
+// looked up by triangle index for the closest hit.
 class Triangle {
 	public:
-		Triangle(const Vector3u& indices, const Vector3f& v0, const Vector3f& v1, const Vector3f& v2);
+		Triangle(const Vector3f& v0, const Vector3f& v1, const Vector3f& v2);
 		~Triangle();
 
-		bool rayIntersects(const Ray& ray, Vector3f& outIntersectionPoint) const;
+		bool rayIntersects(const Ray& ray, float& t) const;
+		// returns the lanes of laneMask that hit closer than their tMax, t gets one entry per lane
+		uint32_t rayIntersects(const RayPacket& packet, uint32_t laneMask, float* t) const;
 		Vector3f getBarycentricCoords(const Vector3f& outIntersectionPoint) const;
 
-		const Vector3u indices;
-		const Vector3f v0;
-		const Vector3f v1;
-		const Vector3f v2;
-
-		AABB aabb;
-
-	private:
+		Vector3f v0;
 		Vector3f edge0;
 		Vector3f edge1;
+};
 
-		float d00;
-		float d01;
-		float d11;
-		float denom;
+// SIMD_WIDTH triangles laid out for the Moller-Trumbore test of a single ray,
+// unused lanes stay degenerate and never hit.
+struct alignas(SIMD_ALIGNMENT) TriangleBlock {
+	float v0[3][SIMD_WIDTH];
+	float edge0[3][SIMD_WIDTH];
+	float edge1[3][SIMD_WIDTH];
+	uint32_t triangleIndex[SIMD_WIDTH];
+
+	TriangleBlock();
+
+	void setTriangle(size_t lane, const Triangle& triangle, uint32_t index);
+	// returns the lane of the closest hit closer than tMax or -1
+	int rayIntersects(const Ray& ray, float tMax, float& t) const;
+	bool isOccluding(const Ray& ray, float tMax) const;
+
+	private:
+		uint32_t getHitMask(const Ray& ray, float tMax, float* t) const;
 };
@@ -1,38 +1,67 @@
 #pragma once
 
+#include <cmath>
 #include <string>
 #include <vector>
+#include <memory>
+#include <limits>
+#include <type_traits>
 #include <unordered_map>
-#include <fstream>
-#include <sstream>
 
 #include "init_exception.h"
 #include "math/vector.h"
 #include "math/rotation.h"
 
-#define RawInputEntry std::pair<std::string, std::vector<std::string>>
 
+// The key value pairs of one entry, the values are converted to numbers once when parsing.
+// Accessing a missing key or converting a value to a type it does not fit throws an
+// InitException naming the file and line of the key.
 class InputEntry {
 	public:
-		InputEntry(const std::string& name);
+		struct Value {
+			std::string text;
+			bool isNumber;
+			double number;
+			// parsed as float directly, so float values round the same as the text
+			float floatNumber;
+		};
+
+		struct Parameter {
+			unsigned int line;
+			std::vector<Value> values;
+		};
+
+		InputEntry(const std::string& name, std::shared_ptr<const std::string> path=nullptr, unsigned int line=0);
+		InputEntry(const InputEntry& other) = default;
+		InputEntry(InputEntry&& other) = default;
 		~InputEntry();
 
-		void insert(const RawInputEntry& rawInputEntry);
+		InputEntry& operator=(const InputEntry& other) = default;
+		InputEntry& operator=(InputEntry&& other) = default;
+
+		void insert(std::string&& key, Parameter&& parameter);
 		bool keyExists(const std::string& key) const;
+		size_t getValueCount(const std::string& key) const;
 
 		template <typename T>
 		T get(const std::string& key, size_t index=0) const {
-			T value;
-			std::stringstream(data.at(key).at(index)) >> value;
-			return value;
+			const Parameter& parameter = getParameter(key);
+			if (index >= parameter.values.size()) {
+				fail(parameter.line, key, std::string("has no value ") + std::to_string(index));
+			}
+			return convert<T>(parameter, key, parameter.values[index]);
 		}
 
 		template <size_t s, typename T>
 		Vector<s, T> getVector(const std::string& key) const {
-			Vector<s, T> vec;
+			const Parameter& parameter = getParameter(key);
+			if (parameter.values.size() < s) {
+				fail(parameter.line, key, std::string("needs ") + std::to_string(s) + " values");
+			}
 
+			Vector<s, T> vec;
 			for (size_t i = 0; i < s; ++i) {
-				vec[i] = get<T>(key, i);
+				vec[i] = convert<T>(parameter, key, parameter.values[i]);
 			}
 
 			return vec;
@@ -41,10 +70,46 @@ class InputEntry {
 		Rotation getRotation(const std::string& key) const;
 
 		std::string name;
+		unsigned int line;
+
 	private:
-		std::unordered_map<std::string, std::vector<std::string>> data;
+		const Parameter& getParameter(const std::string& key) const;
+		[[noreturn]] void fail(unsigned int line, const std::string& key, const std::string& message) const;
+
+		template <typename T>
+		T convert(const Parameter& parameter, const std::string& key, const Value& value) const {
+			if constexpr (std::is_same_v<T, std::string>) {
+				return value.text;
+			} else {
+				static_assert(std::is_arithmetic_v<T>, "input values are strings or numbers");
+				if (!value.isNumber) fail(parameter.line, key, std::string("value \"") + value.text + "\" is not a number");
+
+				if constexpr (std::is_same_v<T, float>) {
+					return value.floatNumber;
+				} else if constexpr (std::is_floating_point_v<T>) {
+					return T(value.number);
+				} else {
+					if (value.number < double(std::numeric_limits<T>::lowest()) ||
+						value.number > double(std::numeric_limits<T>::max()) ||
+						std::trunc(value.number) != value.number) {
+						fail(parameter.line, key, std::string("value \"") + value.text + "\" is not a valid integer here");
+					}
+					return T(value.number);
+				}
+			}
+		}
+
+		std::shared_ptr<const std::string> path;
+		std::unordered_map<std::string, Parameter> data;
 };
 
+// Reads the entry files (.scene, .renderer, .camera) in one pass over the mapped file:
+//
+// EntryName
+// 	key(value, value, ...)
+// # comment
+//
+// Keys are indented with a tab, everything else that is not empty or a comment starts a new entry.
 class InputParser {
 	public:
 		InputParser(const std::string& path);
@@ -55,9 +120,9 @@ class InputParser {
 		const InputEntry& getInputEntry(unsigned int index) const;
 
 	private:
-		RawInputEntry parseInputEntry(std::ifstream& istream);
+		void parseKey(const char* p, const char* end, unsigned int line);
+		[[noreturn]] void fail(unsigned int line, const std::string& message) const;
 
 		std::string path;
 		std::vector<InputEntry> inputEntries;
 };
-
@@ -1,5 +1,7 @@
 #include <iostream>
+#include <chrono>
 #include <filesystem>
+#include <fstream>
 
 #include "graphic/graphics_engine.h"
 #include "graphic/mesh.h"
@@ -8,35 +10,76 @@
 #include "graphic/renderer.h"
 #include "graphic/path_tracer.h"
 #include "graphic/bidirectional_path_tracer.h"
+#include "graphic/bitterli2020_renderer.h"
 
 #include "init_exception.h"
 #include "mesh_manager.h"
+#include "mesh_cache.h"
+#include "scene_bake.h"
+#include "render_stats.h"
 #include "input_parser.h"
 #include "camera.h"
 
 #include "math/vector.h"
 #include "math/matrix.h"
 #include "math/rotation.h"
+#include "math/simd.h"
 
 
+// The contents count, not the paths. raysPerPixel is left out of the renderer file, so a
+// checkpoint can be resumed with more samples.
+uint64_t getCheckpointKey(const std::string& rendererPath, const std::string& scenePath, const std::string& cameraPath) {
+	std::ifstream rendererFile(rendererPath);
+	std::string renderer;
+	std::string line;
+	while (std::getline(rendererFile, line)) {
+		if (line.find("raysPerPixel") == std::string::npos) renderer += line + "\n";
+	}
+
+	const uint64_t prime = 0x9E3779B97F4A7C15ull;
+	uint64_t key = MeshCache::hashData(renderer.data(), renderer.size());
+	key = (key ^ MeshCache::hashFile(scenePath)) * prime;
+	key = (key ^ MeshCache::hashFile(cameraPath)) * prime;
+	return key;
+}
+
 Renderer* getRenderer(const std::string& name) {
 	if (name == "PathTracer")              return new PathTracer();
 	if (name == "BidirectionalPathTracer") return new BidirectionalPathTracer();
+	if (name == "Bitterli2020")            return new Bitterli2020();
 	else throw InitException("getRenderer not found", name);
 }
 
 int main(int argc, char* argv[]) {
-	if (argc != 8) {
+	if (argc < 8) {
 		std::cout << "Error: wrong paramter count!" << std::endl;
-		std::cout << "Usage: SoftwareRenderer renderer scene image_width image_height thread_count camera resultimage" << std::endl;
+		std::cout << "Usage: SoftwareRenderer renderer scene image_width image_height thread_count camera resultimage [options]" << std::endl;
+		std::cout << "The scene can be a scene file or a scene written by --bake-scene." << std::endl;
+		std::cout << "Options:" << std::endl;
+		std::cout << "  --bvh-builder ClosestPair|BinnedSAH" << std::endl;
+		std::cout << "  --bvh-report" << std::endl;
+		std::cout << "  --seed number" << std::endl;
+		std::cout << "  --tile-size pixels" << std::endl;
+		std::cout << "  --scalar-rays" << std::endl;
+		std::cout << "  --samples-per-pass number" << std::endl;
+		std::cout << "  --time-budget seconds" << std::endl;
+		std::cout << "  --target-noise relative_error" << std::endl;
+		std::cout << "  --max-samples count" << std::endl;
+		std::cout << "  --checkpoint path" << std::endl;
+		std::cout << "  --checkpoint-interval seconds" << std::endl;
+		std::cout << "  --resume" << std::endl;
+		std::cout << "  --no-mesh-cache" << std::endl;
+		std::cout << "  --bake-scene path" << std::endl;
+		std::cout << "  --stats path" << std::endl;
 		return -1;
 	}
 
 	std::cout << argv[0];
-	for (unsigned int i = 1; i < 7; ++i) {
+	for (unsigned int i = 1; i < (unsigned int)(argc); ++i) {
 		std::cout << " " << argv[i];
 	}
 	std::cout << std::endl;
+	std::cout << "SIMD kernels: " << getSimdKernelName() << std::endl;
 
 	const std::string execpath = argv[0];
 	const std::string basepath = execpath.substr(0, execpath.size() - sizeof("SoftwareRenderer") + 1);
@@ -48,6 +91,47 @@ int main(int argc, char* argv[]) {
 	std::string cameraFilePath = argv[6];
 	std::string resultImagePath = argv[7];
 
+	BVH::BuildMethod bvhBuildMethod = BVH::BuildMethod::BinnedSAH;
+	bool bvhReport = false;
+	uint64_t seed = 0;
+	unsigned int tileSize = 16;
+	bool rayBatches = true;
+	unsigned int samplesPerPass = 0;
+	float timeBudget = 0.0f;
+	float targetNoise = 0.0f;
+	unsigned int maxSamples = 0;
+	std::string checkpointPath;
+	float checkpointInterval = 60.0f;
+	bool resume = false;
+	bool useMeshCache = true;
+	std::string bakeScenePath;
+	std::string statsPath;
+
+	for (int i = 8; i < argc; ++i) {
+		std::string option = argv[i];
+		bool hasValue = i + 1 < argc;
+
+		if      (option == "--bvh-builder" && hasValue)         bvhBuildMethod = BVH::parseBuildMethod(argv[++i]);
+		else if (option == "--bvh-report")                      bvhReport = true;
+		else if (option == "--seed" && hasValue)                seed = std::stoull(argv[++i]);
+		else if (option == "--tile-size" && hasValue)           tileSize = std::max(1, std::atoi(argv[++i]));
+		else if (option == "--scalar-rays")                     rayBatches = false;
+		else if (option == "--samples-per-pass" && hasValue)    samplesPerPass = std::max(1, std::atoi(argv[++i]));
+		else if (option == "--time-budget" && hasValue)         timeBudget = std::stof(argv[++i]);
+		else if (option == "--target-noise" && hasValue)        targetNoise = std::stof(argv[++i]);
+		else if (option == "--max-samples" && hasValue)         maxSamples = std::max(0, std::atoi(argv[++i]));
+		else if (option == "--checkpoint" && hasValue)          checkpointPath = argv[++i];
+		else if (option == "--checkpoint-interval" && hasValue) checkpointInterval = std::stof(argv[++i]);
+		else if (option == "--resume")                          resume = true;
+		else if (option == "--no-mesh-cache")                   useMeshCache = false;
+		else if (option == "--bake-scene" && hasValue)          bakeScenePath = argv[++i];
+		else if (option == "--stats" && hasValue)               statsPath = argv[++i];
+		else throw InitException("SoftwareRenderer", std::string("unknown option \"") + option + "\"!");
+	}
+
+	if (resume && checkpointPath.empty()) throw InitException("SoftwareRenderer", "--resume needs a --checkpoint path!");
+	RenderStats::enabled = !statsPath.empty();
+
 	size_t start = rendererPath.find_last_of('/') + 1;
 	size_t finish = rendererPath.find_last_of('.') - start;
 	std::string rendererName = rendererPath.substr(start, finish);
@@ -56,8 +140,54 @@ int main(int argc, char* argv[]) {
 	GraphicsEngine* engine = new GraphicsEngine();
 	engine->imageSize = imageSize;
 
+	engine->bvhBuildMethod = bvhBuildMethod;
+	engine->bvhReport = bvhReport;
+	engine->seed = seed;
+	engine->tileSize = tileSize;
+	engine->rayBatches = rayBatches;
+	engine->samplesPerPass = samplesPerPass;
+	engine->timeBudget = timeBudget;
+	engine->targetNoise = targetNoise;
+	engine->maxSamples = maxSamples;
+	engine->checkpointPath = checkpointPath;
+	engine->checkpointInterval = checkpointInterval;
+	if (!checkpointPath.empty()) engine->checkpointKey = getCheckpointKey(rendererPath, scenePath, cameraFilePath);
+	engine->imagePath = resultImagePath;
+
+	auto sceneStart = std::chrono::steady_clock::now();
 	MeshManager* meshManager = new MeshManager(basepath);
-	meshManager->createObjectsFromFile(scenePath);
+	SceneBake* sceneBake = new SceneBake();
+
+	if (SceneBake::isBakedScene(scenePath)) {
+		sceneBake->load(scenePath, engine->scene);
+		engine->objects = sceneBake->getObjects();
+		engine->lightSources = sceneBake->getLightSources();
+	} else {
+		meshManager->bvhBuildMethod = bvhBuildMethod;
+		meshManager->bvhReport = bvhReport;
+		meshManager->useMeshCache = useMeshCache;
+		meshManager->createObjectsFromFile(scenePath);
+
+		engine->objects = meshManager->getCreatedObjects();
+		engine->lightSources = meshManager->getCreatedLightSources();
+		engine->initScene();
+	}
+	float sceneSetupTime = std::chrono::duration<float>(std::chrono::steady_clock::now() - sceneStart).count();
+	float bvhBuildTime = meshManager->bvhBuildTime + engine->sceneBuildTime;
+	std::cout << "Scene setup time: " << sceneSetupTime << " s, ";
+	std::cout << engine->objects.size() << " objects" << std::endl;
+
+	if (!bakeScenePath.empty()) {
+		if (!SceneBake::save(bakeScenePath, engine->objects, engine->lightSources, engine->scene)) {
+			throw InitException("SoftwareRenderer", std::string("Could not write baked scene \"") + bakeScenePath + "\"!");
+		}
+		std::cout << "Baked scene to " << bakeScenePath << std::endl;
+
+		delete sceneBake;
+		delete meshManager;
+		delete engine;
+		return 0;
+	}
 
 	InputParser rendererParser(rendererPath);
 	rendererParser.parse();
@@ -65,11 +195,13 @@ int main(int argc, char* argv[]) {
 	Renderer* renderer = getRenderer(rendererParser.getInputEntry(0).name);
 	renderer->parseInput(rendererParser.getInputEntry(0));
 
-	engine->objects = meshManager->getCreatedObjects();
-	engine->lightSources = meshManager->getCreatedLightSources();
-
 	engine->init(renderer, threadCount);
 
+	if (resume && std::filesystem::exists(checkpointPath)) {
+		engine->loadCheckpoint(checkpointPath);
+		std::cout << "Resuming from " << checkpointPath << std::endl;
+	}
+
 	Camera* camera = new Camera();
 	InputParser cameraParser(cameraFilePath);
 	cameraParser.parse();
@@ -77,9 +209,18 @@ int main(int argc, char* argv[]) {
 	engine->camera = camera;
 
 	engine->render();
+
+	auto writeStart = std::chrono::steady_clock::now();
 	engine->saveImage(resultImagePath);
+	float writeTime = std::chrono::duration<float>(std::chrono::steady_clock::now() - writeStart).count();
+
+	if (!statsPath.empty()) {
+		engine->writeStatsReport(statsPath, scenePath, sceneSetupTime - bvhBuildTime, bvhBuildTime, writeTime);
+		std::cout << "Stats written to " << statsPath << std::endl;
+	}
 
 	delete camera;
+	delete sceneBake;
 	delete meshManager;
 	delete engine;
 
@@ -0,0 +1,57 @@
+#include "mapped_file.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+
+MappedFile::MappedFile()
+:mapping(nullptr), mappingSize(0) {}
+
+MappedFile::~MappedFile() {
+	close();
+}
+
+bool MappedFile::open(const std::string& path) {
+	close();
+
+	int fd = ::open(path.c_str(), O_RDONLY);
+	if (fd < 0) return false;
+
+	struct stat fileStat;
+	if (fstat(fd, &fileStat) != 0) {
+		::close(fd);
+		return false;
+	}
+
+	mappingSize = size_t(fileStat.st_size);
+	if (mappingSize > 0) {
+		void* address = mmap(nullptr, mappingSize, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (address == MAP_FAILED) {
+			::close(fd);
+			mappingSize = 0;
+			return false;
+		}
+		madvise(address, mappingSize, MADV_SEQUENTIAL);
+		mapping = static_cast<const char*>(address);
+	}
+
+	// the mapping stays valid after closing the descriptor
+	::close(fd);
+	return true;
+}
+
+void MappedFile::close() {
+	if (mapping != nullptr) munmap(const_cast<char*>(mapping), mappingSize);
+	mapping = nullptr;
+	mappingSize = 0;
+}
+
+const char* MappedFile::data() const {
+	return mapping;
+}
+
+size_t MappedFile::size() const {
+	return mappingSize;
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <string>
+#include <cstddef>
+
+
+// Read only view of a whole file, mapped into memory so loaders can parse it
+// in place without copying it through a stream first.
+class MappedFile {
+	public:
+		MappedFile();
+		~MappedFile();
+
+		MappedFile(const MappedFile&) = delete;
+		MappedFile& operator=(const MappedFile&) = delete;
+
+		bool open(const std::string& path);
+		void close();
+
+		const char* data() const;
+		size_t size() const;
+
+	private:
+		const char* mapping;
+		size_t mappingSize;
+};
@@ -1,5 +1,7 @@
 #include "aabb.h"
 
+#include "simd.h"
+
 
 #define STARTING_OFFSET 0.0001f
 
@@ -36,7 +38,20 @@ void AABB::addPoint(const Vector3f& point) {
 	}
 }
 
-bool AABB::doesRayIntersect(const Ray& ray) const {
+void AABB::addAABB(const AABB& other) {
+	if (other.empty) return;
+
+	if (empty) {
+		*this = other;
+	} else {
+		for (size_t i = 0; i < 3; ++i) {
+			aabbMin[i] = std::min(aabbMin[i], other.aabbMin[i]);
+			aabbMax[i] = std::max(aabbMax[i], other.aabbMax[i]);
+		}
+	}
+}
+
+SIMD_KERNEL bool AABB::doesRayIntersect(const Ray& ray) const {
 	if (empty) return false;
 
 	float tmin = 0.0, tmax = INFINITY;
@@ -55,3 +70,22 @@ bool AABB::doesRayIntersect(const Ray& ray) const {
 Vector3f AABB::getCenter() const {
 	return 0.5f * (aabbMin + aabbMax);
 }
+
+float AABB::getSurfaceArea() const {
+	if (empty) return 0.0f;
+
+	Vector3f extent = aabbMax - aabbMin;
+	return 2.0f * (extent[0] * extent[1] + extent[1] * extent[2] + extent[2] * extent[0]);
+}
+
+bool AABB::isEmpty() const {
+	return empty;
+}
+
+const Vector3f& AABB::getMin() const {
+	return aabbMin;
+}
+
+const Vector3f& AABB::getMax() const {
+	return aabbMax;
+}
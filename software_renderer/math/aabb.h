@@ -13,9 +13,15 @@ class AABB {
 		~AABB();
 
 		void addPoint(const Vector3f& point);
+		void addAABB(const AABB& other);
 
 		bool doesRayIntersect(const Ray& ray) const;
 		Vector3f getCenter() const;
+		float getSurfaceArea() const;
+
+		bool isEmpty() const;
+		const Vector3f& getMin() const;
+		const Vector3f& getMax() const;
 
 	private:
 		bool empty;
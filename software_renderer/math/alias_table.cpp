@@ -0,0 +1,59 @@
+#include "alias_table.h"
+
+#include <algorithm>
+
+
+AliasTable::AliasTable()
+:thresholds(), aliases(), probabilities() {}
+
+AliasTable::~AliasTable() {}
+
+void AliasTable::init(const std::vector<float>& weights) {
+	size_t count = weights.size();
+	thresholds.assign(count, 1.0f);
+	aliases.resize(count);
+	probabilities.resize(count);
+
+	double sum = 0.0;
+	for (float weight: weights) sum += weight;
+
+	// scaled so the average bucket is 1, the small buckets are filled up by the large ones
+	std::vector<double> scaled(count);
+	std::vector<uint32_t> small;
+	std::vector<uint32_t> large;
+	for (uint32_t i = 0; i < count; ++i) {
+		probabilities[i] = sum > 0.0 ? float(weights[i] / sum) : 1.0f / float(count);
+		scaled[i] = sum > 0.0 ? weights[i] * double(count) / sum : 1.0;
+		aliases[i] = i;
+		(scaled[i] < 1.0 ? small : large).push_back(i);
+	}
+
+	while (!small.empty() && !large.empty()) {
+		uint32_t s = small.back();
+		uint32_t l = large.back();
+		small.pop_back();
+
+		thresholds[s] = float(scaled[s]);
+		aliases[s] = l;
+		scaled[l] -= 1.0 - scaled[s];
+		if (scaled[l] < 1.0) {
+			large.pop_back();
+			small.push_back(l);
+		}
+	}
+	// whatever is left is 1 up to rounding and keeps its threshold of 1
+}
+
+uint32_t AliasTable::sample(float u) const {
+	float scaled = u * float(thresholds.size());
+	uint32_t index = std::min(uint32_t(scaled), uint32_t(thresholds.size() - 1));
+	return scaled - float(index) < thresholds[index] ? index : aliases[index];
+}
+
+float AliasTable::getProbability(uint32_t index) const {
+	return probabilities[index];
+}
+
+size_t AliasTable::size() const {
+	return thresholds.size();
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+
+// Walker/Vose alias table: samples an index with a probability proportional to its weight in
+// constant time. One uniform number picks the bucket and decides between it and its alias.
+class AliasTable {
+	public:
+		AliasTable();
+		~AliasTable();
+
+		// all weights have to be >= 0, a table without any weight samples uniformly
+		void init(const std::vector<float>& weights);
+		// u in [0, 1)
+		uint32_t sample(float u) const;
+		float getProbability(uint32_t index) const;
+		size_t size() const;
+
+	private:
+		std::vector<float> thresholds;
+		std::vector<uint32_t> aliases;
+		std::vector<float> probabilities;
+};
@@ -1,17 +1,33 @@
 #include "bounding_volume_hierachy.h"
 
+#include <chrono>
+#include <algorithm>
+
+#include "../task_pool.h"
+#include "../init_exception.h"
+#include "../binary_file.h"
+
+#define SAH_BIN_COUNT 16
+#define SAH_TRAVERSAL_COST 1.0f
+#define PARALLEL_BUILD_THRESHOLD 4096
+#define MAX_LEAF_SIZE 8
+// the root has depth 1, a traversal never holds more nodes than the tree has levels
+#define MAX_TREE_DEPTH (BVH_STACK_SIZE - 1)
+
+static_assert(sizeof(BVH::Node) == 32, "BVH nodes should fill half a cache line");
+
 
 struct ClosestPair {
-	std::list<BVH::Node*>::iterator left, right;
+	std::list<BVH::BuildNode*>::iterator left, right;
 	float distance2;
 };
 
-ClosestPair findClosestPair(std::list<BVH::Node*>& nodes) {
+ClosestPair findClosestPair(std::list<BVH::BuildNode*>& nodes) {
 	ClosestPair cp;
 	cp.distance2 = INFINITY;
 
-	for (std::list<BVH::Node*>::iterator i = nodes.begin(); i != nodes.end(); ++i) {
-		for (std::list<BVH::Node*>::iterator j = i; j != nodes.end(); ++j) {
+	for (std::list<BVH::BuildNode*>::iterator i = nodes.begin(); i != nodes.end(); ++i) {
+		for (std::list<BVH::BuildNode*>::iterator j = i; j != nodes.end(); ++j) {
 			if (i == j) continue;
 
 			float d2 = (*i)->aabb.getCenter().distanceSquared((*j)->aabb.getCenter());
@@ -26,114 +42,458 @@ ClosestPair findClosestPair(std::list<BVH::Node*>& nodes) {
 	return cp;
 }
 
+static size_t getHeight(const BVH::BuildNode* buildNode) {
+	if (buildNode->count > 0) return 1;
+	return 1 + std::max(getHeight(buildNode->left), getHeight(buildNode->right));
+}
 
-BVH::BVH()
-:root(nullptr) {}
+static BVH::SubtreeSize measureSubtrees(const BVH::BuildNode* buildNode, BVH::SubtreeSizes& sizes) {
+	BVH::SubtreeSize size = {1, 1};
+	if (buildNode->count == 0) {
+		BVH::SubtreeSize left = measureSubtrees(buildNode->left, sizes);
+		BVH::SubtreeSize right = measureSubtrees(buildNode->right, sizes);
+		size.height = 1 + std::max(left.height, right.height);
+		size.leafCount = left.leafCount + right.leafCount;
+	}
+	sizes[buildNode] = size;
+	return size;
+}
 
-BVH::BVH(const BVH& other) {
-	root = copyNode(other.root);
+// height of a median split hierarchy over leafCount leaves
+static size_t getBalancedHeight(size_t leafCount) {
+	size_t height = 1;
+	while ((size_t(1) << (height - 1)) < leafCount) ++height;
+	return height;
 }
 
-BVH& BVH::operator=(const BVH& other) {
-	if (root != nullptr) deleteNodes(root);
-	root = copyNode(other.root);
-	return *this;
+static uint8_t getSeparationAxis(const AABB& left, const AABB& right) {
+	Vector3f separation = right.getCenter() - left.getCenter();
+	uint8_t axis = 0;
+	for (uint8_t i = 1; i < 3; ++i) {
+		if (std::abs(separation[i]) > std::abs(separation[axis])) axis = i;
+	}
+	return axis;
 }
 
-BVH::~BVH() {
-	if (root != nullptr) deleteNodes(root);
+static void collectLeaves(const BVH::BuildNode* buildNode, std::vector<const BVH::BuildNode*>& leaves) {
+	if (buildNode->count > 0) {
+		leaves.push_back(buildNode);
+		return;
+	}
+	collectLeaves(buildNode->left, leaves);
+	collectLeaves(buildNode->right, leaves);
 }
 
-void BVH::init(const std::vector<Data>& inputs) {
-	std::list<Node*> nodes;
+
+BVH::BVH()
+:nodes(), elemIndices(), buildMethod(BuildMethod::BinnedSAH), intersectionCost(SAH_INTERSECTION_COST), buildTime(0.0f) {}
+
+BVH::~BVH() {}
+
+void BVH::init(const std::vector<Data>& inputs, BuildMethod buildMethod, float intersectionCost) {
+	nodes.clear();
+	elemIndices.clear();
+	this->buildMethod = buildMethod;
+	this->intersectionCost = intersectionCost;
+
+	auto start = std::chrono::high_resolution_clock::now();
+
+	if (!inputs.empty()) {
+		BuildNode* root = nullptr;
+		switch (buildMethod) {
+			case BuildMethod::ClosestPair: root = initClosestPair(inputs); break;
+			case BuildMethod::BinnedSAH:   root = initBinnedSAH(inputs);   break;
+		}
+
+		// ClosestPair and degenerate inputs can give chains much deeper than log2 of the
+		// element count, those subtrees are flattened as median splits over their leaves
+		SubtreeSizes sizes;
+		if (getHeight(root) > MAX_TREE_DEPTH) measureSubtrees(root, sizes);
+		flatten(root, 1, sizes);
+		deleteBuildNodes(root);
+	}
+
+	auto stop = std::chrono::high_resolution_clock::now();
+	buildTime = std::chrono::duration<float, std::milli>(stop - start).count();
+}
+
+BVH::BuildNode* BVH::initClosestPair(const std::vector<Data>& inputs) {
+	std::list<BuildNode*> buildNodes;
+	elemIndices.reserve(inputs.size());
 	for (const Data& data: inputs) {
-		Node* node = new Node();
-		node->left  = nullptr;
-		node->right = nullptr;
-		node->aabb = data.aabb;
-		node->elemIndex = data.elemIndex;
-		nodes.push_back(node);
+		BuildNode* buildNode = new BuildNode();
+		buildNode->left  = nullptr;
+		buildNode->right = nullptr;
+		buildNode->aabb = data.aabb;
+		buildNode->offset = elemIndices.size();
+		buildNode->count = 1;
+		buildNodes.push_back(buildNode);
+		elemIndices.push_back(data.elemIndex);
 	}
 
-	while (nodes.size() > 1) {
-		Node* node = new Node();
+	while (buildNodes.size() > 1) {
+		BuildNode* buildNode = new BuildNode();
+		buildNode->count = 0;
 
-		ClosestPair cp = findClosestPair(nodes);
+		ClosestPair cp = findClosestPair(buildNodes);
 
-		std::list<Node*>::iterator left = cp.left;
-		node->left = *left;
-		nodes.erase(left);
+		std::list<BuildNode*>::iterator left = cp.left;
+		buildNode->left = *left;
+		buildNodes.erase(left);
 
-		std::list<Node*>::iterator right = cp.right;
-		node->right = *right;
-		nodes.erase(right);
+		std::list<BuildNode*>::iterator right = cp.right;
+		buildNode->right = *right;
+		buildNodes.erase(right);
 
-		node->aabb = AABB(node->left->aabb, node->right->aabb);
-		nodes.push_back(node);
+		buildNode->aabb = AABB(buildNode->left->aabb, buildNode->right->aabb);
+		buildNodes.push_back(buildNode);
 	}
-	root = nodes.front();
+	return buildNodes.front();
 }
 
-void BVH::rebuild(std::function<AABB(size_t)> getAABB) {
-	rebuildNode(root, getAABB);
-}
+BVH::BuildNode* BVH::initBinnedSAH(const std::vector<Data>& inputs) {
+	std::vector<BuildData> buildData;
+	buildData.reserve(inputs.size());
+	for (const Data& data: inputs) {
+		buildData.push_back({data.aabb, data.aabb.getCenter(), data.elemIndex});
+	}
+
+	BuildNode* root;
+	if (inputs.size() < PARALLEL_BUILD_THRESHOLD) {
+		root = buildBinnedSAH(buildData, 0, buildData.size(), nullptr);
+	} else {
+		TaskPool pool(std::max(1u, std::thread::hardware_concurrency()) - 1);
+		root = buildBinnedSAH(buildData, 0, buildData.size(), &pool);
+		pool.wait();
+	}
 
-std::vector<size_t> BVH::getHits(const Ray& ray) const {
-	return getIntersections(root, ray);
+	elemIndices.reserve(buildData.size());
+	for (const BuildData& data: buildData) {
+		elemIndices.push_back(data.elemIndex);
+	}
+
+	return root;
 }
 
-std::vector<size_t> BVH::getIntersections(const Node* node, const Ray& ray) const {
-	bool hit = node->aabb.doesRayIntersect(ray);
-	if (!hit) return {};
+BVH::BuildNode* BVH::buildBinnedSAH(std::vector<BuildData>& buildData, size_t begin, size_t end, TaskPool* pool) {
+	BuildNode* buildNode = new BuildNode();
+	buildNode->left  = nullptr;
+	buildNode->right = nullptr;
+	buildNode->offset = begin;
+	buildNode->count = end - begin;
+
+	AABB centerBounds;
+	for (size_t i = begin; i < end; ++i) {
+		buildNode->aabb.addAABB(buildData[i].aabb);
+		centerBounds.addPoint(buildData[i].center);
+	}
+
+	size_t count = end - begin;
+	if (count == 1) return buildNode;
+
+	struct Bin {
+		AABB aabb;
+		size_t count;
+	};
+
+	const Vector3f& centerMin = centerBounds.getMin();
+	Vector3f centerExtent = centerBounds.getMax() - centerMin;
+	auto getBinIndex = [&centerMin, &centerExtent](const Vector3f& center, size_t axis) {
+		size_t bin = size_t(SAH_BIN_COUNT * ((center[axis] - centerMin[axis]) / centerExtent[axis]));
+		return std::min(bin, size_t(SAH_BIN_COUNT - 1));
+	};
+
+	float bestCost = INFINITY;
+	size_t bestAxis = 0;
+	size_t bestSplit = 0;
+
+	for (size_t axis = 0; axis < 3; ++axis) {
+		if (centerExtent[axis] <= 0.0f) continue;
+
+		Bin bins[SAH_BIN_COUNT] = {};
+		for (size_t i = begin; i < end; ++i) {
+			Bin& bin = bins[getBinIndex(buildData[i].center, axis)];
+			bin.aabb.addAABB(buildData[i].aabb);
+			++bin.count;
+		}
+
+		float rightCosts[SAH_BIN_COUNT] = {};
+		AABB rightAABB;
+		size_t rightCount = 0;
+		for (size_t b = SAH_BIN_COUNT - 1; b > 0; --b) {
+			rightAABB.addAABB(bins[b].aabb);
+			rightCount += bins[b].count;
+			rightCosts[b] = float(rightCount) * rightAABB.getSurfaceArea();
+		}
+
+		AABB leftAABB;
+		size_t leftCount = 0;
+		for (size_t b = 0; b < SAH_BIN_COUNT - 1; ++b) {
+			leftAABB.addAABB(bins[b].aabb);
+			leftCount += bins[b].count;
+			if (leftCount == 0 || leftCount == count) continue;
 
-	bool leaf = node->left == nullptr;
-	if (leaf) return { node->elemIndex };
+			float cost = float(leftCount) * leftAABB.getSurfaceArea() + rightCosts[b + 1];
+			if (cost < bestCost) {
+				bestCost = cost;
+				bestAxis = axis;
+				bestSplit = b;
+			}
+		}
+	}
 
-	std::vector<size_t> ret;
-	
-	std::vector<size_t> leftRes  = getIntersections(node->left,  ray);
-	std::vector<size_t> rightRes = getIntersections(node->right, ray);
+	size_t middle;
+	if (bestCost == INFINITY) {
+		// all centers are identical, so any split is as good as any other
+		if (count <= MAX_LEAF_SIZE) return buildNode;
+		middle = begin + count / 2;
+	} else {
+		float leafCost = intersectionCost * float(count);
+		float splitCost = SAH_TRAVERSAL_COST + intersectionCost * bestCost / buildNode->aabb.getSurfaceArea();
+		if (count <= MAX_LEAF_SIZE && leafCost <= splitCost) return buildNode;
+
+		middle = std::partition(
+			buildData.begin() + begin, buildData.begin() + end,
+			[&getBinIndex, bestAxis, bestSplit](const BuildData& data) {
+				return getBinIndex(data.center, bestAxis) <= bestSplit;
+			}
+		) - buildData.begin();
+	}
 
-	ret.insert(ret.end(), leftRes.begin(),  leftRes.end() );
-	ret.insert(ret.end(), rightRes.begin(), rightRes.end());
+	buildNode->count = 0;
+	if (pool != nullptr && count >= PARALLEL_BUILD_THRESHOLD) {
+		pool->submit([this, buildNode, &buildData, middle, end, pool]() {
+			buildNode->right = buildBinnedSAH(buildData, middle, end, pool);
+		});
+	} else {
+		buildNode->right = buildBinnedSAH(buildData, middle, end, pool);
+	}
+	buildNode->left = buildBinnedSAH(buildData, begin, middle, pool);
 
-	return ret;
+	return buildNode;
 }
 
-BVH::Node* BVH::copyNode(Node* oldNode) {
-	Node* newNode = new Node();
+size_t BVH::flatten(const BuildNode* buildNode, size_t depth, const SubtreeSizes& sizes) {
+	if (buildNode->count == 0 && !sizes.empty() && depth + sizes.at(buildNode).height - 1 > MAX_TREE_DEPTH) {
+		// Rebalances as low as possible: here only when a child cannot do it itself.
+		auto fitsBalanced = [&sizes](const BuildNode* node, size_t nodeDepth) {
+			return nodeDepth + getBalancedHeight(sizes.at(node).leafCount) - 1 <= MAX_TREE_DEPTH;
+		};
+		auto fits = [&sizes, &fitsBalanced](const BuildNode* node, size_t nodeDepth) {
+			return nodeDepth + sizes.at(node).height - 1 <= MAX_TREE_DEPTH || fitsBalanced(node, nodeDepth);
+		};
+
+		if (!fits(buildNode->left, depth + 1) || !fits(buildNode->right, depth + 1)) {
+			if (!fitsBalanced(buildNode, depth)) throw InitException("BVH", "tree is too deep for traversal!");
+
+			std::vector<const BuildNode*> leaves;
+			collectLeaves(buildNode, leaves);
+			AABB aabb;
+			return flattenBalanced(leaves, 0, leaves.size(), depth, sizes, aabb);
+		}
+	}
+
+	size_t index = nodes.size();
+	nodes.emplace_back();
+	setNodeAABB(nodes[index], buildNode->aabb);
 
-	bool leaf = oldNode->left == nullptr;
-	if (leaf) {
-		newNode->aabb = oldNode->aabb;
-		newNode->elemIndex = oldNode->elemIndex;
-		newNode->left  = nullptr;
-		newNode->right = nullptr;
+	if (buildNode->count > 0) {
+		nodes[index].offset = buildNode->offset;
+		nodes[index].count = buildNode->count;
+		nodes[index].axis = 0;
 	} else {
-		newNode->aabb = oldNode->aabb;
-		newNode->left  = copyNode(oldNode->left );
-		newNode->right = copyNode(oldNode->right);
+		flatten(buildNode->left, depth + 1, sizes);
+		size_t second = flatten(buildNode->right, depth + 1, sizes);
+		nodes[index].offset = second;
+		nodes[index].count = 0;
+		nodes[index].axis = getSeparationAxis(buildNode->left->aabb, buildNode->right->aabb);
 	}
+	nodes[index].padding = 0;
 
-	return newNode;
+	return index;
 }
 
-void BVH::deleteNodes(Node* node) {
-	bool leaf = node->left == nullptr;
-	if (!leaf) {
-		deleteNodes(node->left );
-		deleteNodes(node->right);
+size_t BVH::flattenBalanced(std::vector<const BuildNode*>& leaves, size_t begin, size_t end, size_t depth, const SubtreeSizes& sizes, AABB& aabb) {
+	if (end - begin == 1) {
+		aabb = leaves[begin]->aabb;
+		return flatten(leaves[begin], depth, sizes);
 	}
-	delete node;
+
+	AABB centerBounds;
+	for (size_t i = begin; i < end; ++i) {
+		centerBounds.addPoint(leaves[i]->aabb.getCenter());
+	}
+	Vector3f centerExtent = centerBounds.getMax() - centerBounds.getMin();
+	size_t axis = 0;
+	for (size_t i = 1; i < 3; ++i) {
+		if (centerExtent[i] > centerExtent[axis]) axis = i;
+	}
+
+	size_t middle = begin + (end - begin) / 2;
+	std::nth_element(
+		leaves.begin() + begin, leaves.begin() + middle, leaves.begin() + end,
+		[axis](const BuildNode* a, const BuildNode* b) {
+			return a->aabb.getCenter()[axis] < b->aabb.getCenter()[axis];
+		}
+	);
+
+	size_t index = nodes.size();
+	nodes.emplace_back();
+
+	AABB leftAABB, rightAABB;
+	flattenBalanced(leaves, begin, middle, depth + 1, sizes, leftAABB);
+	size_t second = flattenBalanced(leaves, middle, end, depth + 1, sizes, rightAABB);
+	aabb = AABB(leftAABB, rightAABB);
+
+	setNodeAABB(nodes[index], aabb);
+	nodes[index].offset = second;
+	nodes[index].count = 0;
+	nodes[index].axis = getSeparationAxis(leftAABB, rightAABB);
+	nodes[index].padding = 0;
+
+	return index;
 }
 
-void BVH::rebuildNode(Node* node, std::function<AABB(size_t)> getAABB) {
-	bool leaf = node->left == nullptr;
-	if (leaf) {
-		node->aabb = getAABB(node->elemIndex);
-	} else {
-		rebuildNode(node->left,  getAABB);
-		rebuildNode(node->right, getAABB);
-		node->aabb = AABB(node->left->aabb, node->right->aabb);
+void BVH::deleteBuildNodes(BuildNode* buildNode) {
+	if (buildNode->count == 0) {
+		deleteBuildNodes(buildNode->left );
+		deleteBuildNodes(buildNode->right);
+	}
+	delete buildNode;
+}
+
+void BVH::setNodeAABB(Node& node, const AABB& aabb) {
+	node.aabbMin = aabb.getMin();
+	node.aabbMax = aabb.getMax();
+}
+
+void BVH::rebuild(std::function<AABB(size_t)> getAABB) {
+	// children always come after their parent, so a reverse sweep refits bottom up
+	for (size_t i = nodes.size(); i > 0; --i) {
+		Node& node = nodes[i - 1];
+
+		AABB aabb;
+		if (node.count > 0) {
+			for (uint32_t e = node.offset; e < node.offset + node.count; ++e) {
+				aabb.addAABB(getAABB(elemIndices[e]));
+			}
+		} else {
+			const Node& first = nodes[i];
+			const Node& second = nodes[node.offset];
+			aabb = AABB(AABB(first.aabbMin, first.aabbMax), AABB(second.aabbMin, second.aabbMax));
+		}
+		setNodeAABB(node, aabb);
+	}
+}
+
+void BVH::write(BinaryWriter& writer) const {
+	writer.write(uint32_t(buildMethod));
+	writer.write(intersectionCost);
+	writer.writeArray(nodes);
+	writer.writeArray(elemIndices);
+}
+
+void BVH::read(BinaryReader& reader) {
+	buildMethod = BuildMethod(reader.read<uint32_t>());
+	intersectionCost = reader.read<float>();
+	reader.readArray(nodes);
+	reader.readArray(elemIndices);
+	buildTime = 0.0f;
+}
+
+bool BVH::isValid(size_t elemCount) const {
+	for (uint32_t elemIndex: elemIndices) {
+		if (elemIndex >= elemCount) return false;
+	}
+
+	// children always come after their parent, so one pass sees every parent of a node first
+	std::vector<uint32_t> depths(nodes.size(), 1);
+	for (size_t i = 0; i < nodes.size(); ++i) {
+		const Node& node = nodes[i];
+		if (depths[i] >= BVH_STACK_SIZE) return false;
+
+		if (node.count > 0) {
+			if (size_t(node.offset) + node.count > elemIndices.size()) return false;
+			continue;
+		}
+
+		if (i + 1 >= nodes.size() || node.offset <= i + 1 || node.offset >= nodes.size()) return false;
+		depths[i + 1] = std::max(depths[i + 1], depths[i] + 1);
+		depths[node.offset] = std::max(depths[node.offset], depths[i] + 1);
+	}
+	return true;
+}
+
+AABB BVH::getBounds() const {
+	if (nodes.empty()) return AABB();
+	return AABB(nodes[0].aabbMin, nodes[0].aabbMax);
+}
+
+const std::vector<BVH::Node>& BVH::getNodes() const {
+	return nodes;
+}
+
+const std::vector<uint32_t>& BVH::getElemIndices() const {
+	return elemIndices;
+}
+
+BVH::Stats BVH::getStats() const {
+	Stats stats{};
+	stats.buildMethod = buildMethod;
+	stats.buildTime = buildTime;
+
+	if (nodes.empty()) return stats;
+
+	std::vector<std::pair<uint32_t, size_t>> stack = {{0, 1}};
+	while (!stack.empty()) {
+		uint32_t index = stack.back().first;
+		size_t depth = stack.back().second;
+		stack.pop_back();
+
+		const Node& node = nodes[index];
+		float area = AABB(node.aabbMin, node.aabbMax).getSurfaceArea();
+
+		++stats.nodeCount;
+		stats.maxDepth = std::max(stats.maxDepth, depth);
+
+		if (node.count > 0) {
+			++stats.leafCount;
+			stats.elemCount += node.count;
+			stats.sahCost += intersectionCost * float(node.count) * area;
+		} else {
+			stats.sahCost += SAH_TRAVERSAL_COST * area;
+			stack.push_back({index + 1, depth + 1});
+			stack.push_back({node.offset, depth + 1});
+		}
+	}
+
+	stats.sahCost /= AABB(nodes[0].aabbMin, nodes[0].aabbMax).getSurfaceArea();
+
+	return stats;
+}
+
+BVH::BuildMethod BVH::parseBuildMethod(const std::string& name) {
+	if (name == "ClosestPair") return BuildMethod::ClosestPair;
+	if (name == "BinnedSAH")   return BuildMethod::BinnedSAH;
+	else throw InitException("BVH", std::string("unknown build method \"") + name + "\"!");
+}
+
+std::string BVH::getBuildMethodName(BuildMethod buildMethod) {
+	switch (buildMethod) {
+		case BuildMethod::ClosestPair: return "ClosestPair";
+		case BuildMethod::BinnedSAH:   return "BinnedSAH";
 	}
+	return "";
+}
+
+std::ostream& operator<<(std::ostream& out, const BVH::Stats& stats) {
+	out << BVH::getBuildMethodName(stats.buildMethod);
+	out << ": " << stats.elemCount << " elements";
+	out << ", " << stats.nodeCount << " nodes";
+	out << ", " << stats.leafCount << " leaves";
+	out << ", depth " << stats.maxDepth;
+	out << ", SAH cost " << stats.sahCost;
+	out << ", build time " << stats.buildTime << " ms";
+
+	return out;
 }
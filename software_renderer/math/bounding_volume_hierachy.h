@@ -2,40 +2,300 @@
 
 #include <vector>
 #include <list>
+#include <string>
+#include <ostream>
+#include <cstdint>
 #include <functional>
+#include <unordered_map>
 
 #include "ray.h"
+#include "ray_packet.h"
 #include "aabb.h"
+#include "../render_stats.h"
 
+#define BVH_STACK_SIZE 64
+#define SAH_INTERSECTION_COST 1.0f
+
+
+class TaskPool;
+class BinaryWriter;
+class BinaryReader;
 
 class BVH {
 	public:
+		enum class BuildMethod {
+			ClosestPair,
+			BinnedSAH
+		};
+
 		struct Data {
 			AABB aabb;
 			size_t elemIndex;
 		};
 
-		struct Node {
+		struct BuildNode {
 			AABB aabb;
-			Node* left;
-			Node* right;
-			size_t elemIndex;
+			BuildNode* left;
+			BuildNode* right;
+			size_t offset;
+			size_t count;
+		};
+
+		// levels below a build node including itself and its number of leaves
+		struct SubtreeSize {
+			size_t height;
+			size_t leafCount;
+		};
+		typedef std::unordered_map<const BuildNode*, SubtreeSize> SubtreeSizes;
+
+		// Depth first layout: the first child directly follows its parent,
+		// inner nodes store the index of the second child in offset,
+		// leaves store their range into elemIndices in offset and count.
+		// axis is the axis along which the children are separated the most.
+		struct Node {
+			Vector3f aabbMin;
+			uint32_t offset;
+			Vector3f aabbMax;
+			uint16_t count;
+			uint8_t axis;
+			uint8_t padding;
+		};
+
+		struct Stats {
+			BuildMethod buildMethod;
+			size_t elemCount;
+			size_t nodeCount;
+			size_t leafCount;
+			size_t maxDepth;
+			float sahCost;
+			float buildTime;
 		};
 
 		BVH();
-		BVH(const BVH& other);
-		BVH& operator=(const BVH& other);
 		~BVH();
 
-		void init(const std::vector<Data>& inputs);
+		// intersectionCost is the cost of testing one element relative to a node test
+		void init(const std::vector<Data>& inputs, BuildMethod buildMethod=BuildMethod::BinnedSAH, float intersectionCost=SAH_INTERSECTION_COST);
 		void rebuild(std::function<AABB(size_t)> getAABB);
-		std::vector<size_t> getHits(const Ray& ray) const;
-	
+		Stats getStats() const;
+
+		// the flattened hierarchy as it is, a read BVH reports a build time of 0
+		void write(BinaryWriter& writer) const;
+		void read(BinaryReader& reader);
+		// Checks that a read hierarchy stays within its arrays, elemCount and the traversal stack.
+		// Offsets and indices of a corrupt file would make the traversal crash.
+		bool isValid(size_t elemCount) const;
+
+		// Closest hit traversal, intersect(elemIndex, tMax) has to return true
+		// and shrink tMax when it found a closer hit.
+		template<typename IntersectFunc>
+		bool traverse(const Ray& ray, float& tMax, IntersectFunc intersect) const {
+			if (nodes.empty()) return false;
+
+			uint32_t stack[BVH_STACK_SIZE];
+			float stackEntry[BVH_STACK_SIZE];
+			size_t stackSize = 0;
+			bool hit = false;
+			uint64_t visitedNodes = 0;
+
+			float tEntry;
+			if (!intersectNode(nodes[0], ray, tMax, tEntry)) {
+				RenderStats::add(RenderStats::NodesVisited, 1);
+				return false;
+			}
+			stack[stackSize] = 0;
+			stackEntry[stackSize] = tEntry;
+			++stackSize;
+
+			while (stackSize > 0) {
+				--stackSize;
+				if (stackEntry[stackSize] > tMax) continue;
+				uint32_t current = stack[stackSize];
+
+				while (true) {
+					const Node& node = nodes[current];
+					++visitedNodes;
+
+					if (node.count > 0) {
+						for (uint32_t i = node.offset; i < node.offset + node.count; ++i) {
+							if (intersect(size_t(elemIndices[i]), tMax)) hit = true;
+						}
+						break;
+					}
+
+					uint32_t near = current + 1;
+					uint32_t far = node.offset;
+					float tNear, tFar;
+					bool hitNear = intersectNode(nodes[near], ray, tMax, tNear);
+					bool hitFar  = intersectNode(nodes[far],  ray, tMax, tFar );
+
+					if (hitNear && hitFar) {
+						if (tFar < tNear) {
+							std::swap(near, far);
+							std::swap(tNear, tFar);
+						}
+						stack[stackSize] = far;
+						stackEntry[stackSize] = tFar;
+						++stackSize;
+						current = near;
+					} else if (hitNear) {
+						current = near;
+					} else if (hitFar) {
+						current = far;
+					} else {
+						break;
+					}
+				}
+			}
+
+			RenderStats::add(RenderStats::NodesVisited, visitedNodes);
+			return hit;
+		}
+
+		// Any hit traversal, stops as soon as intersect(elemIndex, tMax) returns true.
+		template<typename IntersectFunc>
+		bool traverseAny(const Ray& ray, float tMax, IntersectFunc intersect) const {
+			if (nodes.empty()) return false;
+
+			uint32_t stack[BVH_STACK_SIZE];
+			size_t stackSize = 0;
+			uint64_t visitedNodes = 0;
+
+			float tEntry;
+			if (!intersectNode(nodes[0], ray, tMax, tEntry)) {
+				RenderStats::add(RenderStats::NodesVisited, 1);
+				return false;
+			}
+			stack[stackSize++] = 0;
+
+			bool hit = false;
+			while (stackSize > 0 && !hit) {
+				const Node& node = nodes[stack[--stackSize]];
+				++visitedNodes;
+
+				if (node.count > 0) {
+					for (uint32_t i = node.offset; i < node.offset + node.count && !hit; ++i) {
+						hit = intersect(size_t(elemIndices[i]), tMax);
+					}
+					continue;
+				}
+
+				uint32_t first = uint32_t(&node - nodes.data()) + 1;
+				uint32_t second = node.offset;
+				if (intersectNode(nodes[second], ray, tMax, tEntry)) stack[stackSize++] = second;
+				if (intersectNode(nodes[first],  ray, tMax, tEntry)) stack[stackSize++] = first;
+			}
+
+			RenderStats::add(RenderStats::NodesVisited, visitedNodes);
+			return hit;
+		}
+
+		// Packet traversal, intersect(elemIndex, laneMask) gets the lanes of the packet
+		// whose rays reach the leaf and has to shrink their tMax on closer hits.
+		template<typename IntersectFunc>
+		void traversePacket(const RayPacket& packet, uint32_t laneMask, IntersectFunc intersect) const {
+			if (nodes.empty() || laneMask == 0) return;
+
+			uint32_t stack[BVH_STACK_SIZE];
+			size_t stackSize = 0;
+			stack[stackSize++] = 0;
+			uint64_t visitedNodes = 0;
+
+			while (stackSize > 0) {
+				uint32_t current = stack[--stackSize];
+				const Node& node = nodes[current];
+
+				// once per packet, not per lane
+				++visitedNodes;
+				uint32_t nodeMask = intersectNodePacket(node, packet) & laneMask;
+				if (nodeMask == 0) continue;
+
+				if (node.count > 0) {
+					for (uint32_t i = node.offset; i < node.offset + node.count; ++i) {
+						intersect(size_t(elemIndices[i]), nodeMask);
+					}
+					continue;
+				}
+
+				// the first active ray decides which child is near for the whole packet
+				uint32_t first = current + 1;
+				uint32_t second = node.offset;
+				if (packet.direction[node.axis][__builtin_ctz(nodeMask)] < 0.0f) std::swap(first, second);
+				stack[stackSize++] = second;
+				stack[stackSize++] = first;
+			}
+
+			RenderStats::add(RenderStats::NodesVisited, visitedNodes);
+		}
+
+		AABB getBounds() const;
+		const std::vector<Node>& getNodes() const;
+		const std::vector<uint32_t>& getElemIndices() const;
+
+		static BuildMethod parseBuildMethod(const std::string& name);
+		static std::string getBuildMethodName(BuildMethod buildMethod);
+
 	private:
-		std::vector<size_t> getIntersections(const Node* node, const Ray& ray) const;
-		Node* copyNode(Node* oldNode);
-		void deleteNodes(Node* node);
-		void rebuildNode(Node* node, std::function<AABB(size_t)> getAABB);
+		struct BuildData {
+			AABB aabb;
+			Vector3f center;
+			size_t elemIndex;
+		};
+
+		static bool intersectNode(const Node& node, const Ray& ray, float tMax, float& tEntry) {
+			float tMin = 0.0f;
+
+			for (size_t i = 0; i < 3; ++i) {
+				float t1 = (node.aabbMin[i] - ray.origin[i]) * ray.directionInv[i];
+				float t2 = (node.aabbMax[i] - ray.origin[i]) * ray.directionInv[i];
+
+				tMin = std::max(tMin, std::min(t1, t2));
+				tMax = std::min(tMax, std::max(t1, t2));
+			}
+
+			tEntry = tMin;
+			return tMin <= tMax;
+		}
+
+		static uint32_t intersectNodePacket(const Node& node, const RayPacket& packet) {
+			uint32_t mask = 0;
+
+			for (size_t g = 0; g < RAY_PACKET_GROUPS; ++g) {
+				size_t offset = g * SIMD_WIDTH;
+				SimdFloat tMin(0.0f);
+				SimdFloat tMax = SimdFloat::load(packet.tMax + offset);
 
-		Node* root;
+				for (size_t i = 0; i < 3; ++i) {
+					SimdFloat origin = SimdFloat::load(packet.origin[i] + offset);
+					SimdFloat directionInv = SimdFloat::load(packet.directionInv[i] + offset);
+					SimdFloat t1 = (SimdFloat(node.aabbMin[i]) - origin) * directionInv;
+					SimdFloat t2 = (SimdFloat(node.aabbMax[i]) - origin) * directionInv;
+
+					tMin = SimdFloat::max(tMin, SimdFloat::min(t1, t2));
+					tMax = SimdFloat::min(tMax, SimdFloat::max(t1, t2));
+				}
+
+				mask |= (tMin <= tMax).mask() << offset;
+			}
+
+			return mask;
+		}
+
+		BuildNode* initClosestPair(const std::vector<Data>& inputs);
+		BuildNode* initBinnedSAH(const std::vector<Data>& inputs);
+		BuildNode* buildBinnedSAH(std::vector<BuildData>& buildData, size_t begin, size_t end, TaskPool* pool);
+
+		// sizes is only filled when the build tree is deeper than the traversal stack
+		size_t flatten(const BuildNode* buildNode, size_t depth, const SubtreeSizes& sizes);
+		size_t flattenBalanced(std::vector<const BuildNode*>& leaves, size_t begin, size_t end, size_t depth, const SubtreeSizes& sizes, AABB& aabb);
+		void deleteBuildNodes(BuildNode* buildNode);
+		void setNodeAABB(Node& node, const AABB& aabb);
+
+		std::vector<Node> nodes;
+		std::vector<uint32_t> elemIndices;
+		BuildMethod buildMethod;
+		float intersectionCost;
+		float buildTime;
 };
+
+std::ostream& operator<<(std::ostream& out, const BVH::Stats& stats);
@@ -6,8 +6,11 @@
 
 #include "vector.h"
 
+// Like Vector the loops are unrolled at compile time, Matrix4f is 16 byte aligned and multiplies
+// whole rows with SSE. The 4x4 inverse expands the cofactors without building sub matrices.
+
 template <size_t s, typename T>
-class Matrix {
+class alignas(isSseVector<s, T>() ? 16 : alignof(T)) Matrix {
 	public:
 		// Class Definitions
 
@@ -39,26 +42,7 @@ class Matrix {
 		// Constructors
 
 		Matrix(): m{0} {
-			for (size_t i = 0; i < s; ++i) {
-				m[i][i] = 1.0f;
-			}
-		}
-
-		Matrix(const Matrix& other) {
-			for (size_t i = 0; i < s; ++i) {
-				for (size_t j = 0; j < s; ++j) {
-					this->m[i][j] = other.m[i][j];
-				}
-			}
-		}
-
-		Matrix& operator=(const Matrix& other) {
-			for (size_t i = 0; i < s; ++i) {
-				for (size_t j = 0; j < s; ++j) {
-					this->m[i][j] = other.m[i][j];
-				}
-			}
-			return *this;
+			unroll<s>([&](size_t i) { m[i][i] = 1.0f; });
 		}
 
 		// Access Operators
@@ -79,49 +63,29 @@ class Matrix {
 
 		Matrix operator+(const Matrix& other) const {
 			Matrix ret(*this);
-			for (size_t i = 0; i < s; ++i) {
-				for (size_t j = 0; j < s; ++j) {
-					ret.m[i][j] += other.m[i][j];
-				}
-			}
+			ret += other;
 			return ret;
 		}
 
 		Matrix operator-(const Matrix& other) const {
 			Matrix ret(*this);
-			for (size_t i = 0; i < s; ++i) {
-				for (size_t j = 0; j < s; ++j) {
-					ret.m[i][j] -= other.m[i][j];
-				}
-			}
+			ret -= other;
 			return ret;
 		}
 
 		Matrix& operator+=(const Matrix& other) {
-			for (size_t i = 0; i < s; ++i) {
-				for (size_t j = 0; j < s; ++j) {
-					this->m[i][j] += other.m[i][j];
-				}
-			}
+			unroll<s * s>([&](size_t k) { this->m[k / s][k % s] += other.m[k / s][k % s]; });
 			return *this;
 		}
 
 		Matrix& operator-=(const Matrix& other) {
-			for (size_t i = 0; i < s; ++i) {
-				for (size_t j = 0; j < s; ++j) {
-					this->m[i][j] -= other.m[i][j];
-				}
-			}
+			unroll<s * s>([&](size_t k) { this->m[k / s][k % s] -= other.m[k / s][k % s]; });
 			return *this;
 		}
 
 		template<typename S>
 		Matrix& operator*=(const S scalar) {
-			for (size_t i = 0; i < s; ++i) {
-				for (size_t j = 0; j < s; ++j) {
-					this->m[i][j] *= scalar;
-				}
-			}
+			unroll<s * s>([&](size_t k) { this->m[k / s][k % s] *= scalar; });
 			return *this;
 		}
 
@@ -210,33 +174,48 @@ class Matrix {
 		}
 
 		Matrix inverseMatrix() {
-			return (T(1.0) / this->det()) * this->cofactorMatrix();
+			if constexpr (s == 4) {
+				// same operations in the same order as det() and cofactorMatrix() below
+				T minors[4][4];
+				unroll<16>([&](size_t k) { minors[k / 4][k % 4] = minor3(k / 4, k % 4); });
+
+				T det = T(0) + m[0][0] * minors[0][0] - m[0][1] * minors[0][1] + m[0][2] * minors[0][2] - m[0][3] * minors[0][3];
+				T factor = T(1.0) / det;
+
+				Matrix ret;
+				unroll<16>([&](size_t k) {
+					size_t i = k / 4;
+					size_t j = k % 4;
+					T cofactor = (i + j) % 2 == 1 ? -minors[j][i] : minors[j][i];
+					ret.m[i][j] = cofactor * factor;
+				});
+				return ret;
+			} else {
+				return (T(1.0) / this->det()) * this->cofactorMatrix();
+			}
 		}
 
 		Matrix operator*(const Matrix& other) const {
 			Matrix ret;
-			for (size_t i = 0; i < s; ++i) {
-				ret.m[i][i] = 0.0f;
-				for (size_t j = 0; j < s; ++j) {
-					for (size_t n = 0; n < s; ++n) {
-						ret.m[i][j] += this->m[i][n] * other.m[n][j];
-					}
-				}
+#if defined(__SSE__)
+			if constexpr (isSseVector<s, T>()) {
+				unroll<4>([&](size_t i) {
+					__m128 row = _mm_setzero_ps();
+					unroll<4>([&](size_t n) { row = _mm_add_ps(row, _mm_mul_ps(_mm_set1_ps(this->m[i][n]), _mm_load_ps(other.m[n]))); });
+					_mm_store_ps(ret.m[i], row);
+				});
+				return ret;
 			}
+#endif
+			unroll<s>([&](size_t i) {
+				ret.m[i][i] = 0.0f;
+				unroll<s * s>([&](size_t k) { ret.m[i][k / s] += this->m[i][k % s] * other.m[k % s][k / s]; });
+			});
 			return ret;
 		}
 
 		Matrix& operator*=(const Matrix& other) {
-			Matrix ret;
-			for (size_t i = 0; i < s; ++i) {
-				ret.m[i][i] = 0.0f;
-				for (size_t j = 0; j < s; ++j) {
-					for (size_t n = 0; n < s; ++n) {
-						ret.m[i][j] += this->m[i][n] * other.m[n][j];
-					}
-				}
-			}
-			*this = ret;
+			*this = *this * other;
 			return *this;
 		}
 
@@ -244,25 +223,43 @@ class Matrix {
 
 		Vector<s, T> operator*(const Vector<s, T>& vector) const {
 			Vector<s, T> ret;
-			for (size_t i = 0; i < s; ++i) {
-				for (size_t j = 0; j < s; ++j) {
-					ret[j] += this->m[i][j] * vector[i];
-				}
+#if defined(__SSE__)
+			if constexpr (isSseVector<s, T>()) {
+				__m128 sum = _mm_setzero_ps();
+				unroll<4>([&](size_t i) { sum = _mm_add_ps(sum, _mm_mul_ps(_mm_load_ps(this->m[i]), _mm_set1_ps(vector[i]))); });
+				return ret.store(sum);
 			}
+#endif
+			unroll<s * s>([&](size_t k) { ret[k % s] += this->m[k / s][k % s] * vector[k / s]; });
 			return ret;
 		}
+
+	private:
+		T det2(size_t r0, size_t r1, size_t c0, size_t c1) const {
+			return m[r0][c0] * m[r1][c1] - m[r0][c1] * m[r1][c0];
+		}
+
+		// determinant of the 3x3 matrix without row ri and column rj, expanded along its first row
+		T minor3(size_t ri, size_t rj) const {
+			size_t r[3];
+			size_t c[3];
+			for (size_t i = 0, n = 0; i < 4; ++i) if (i != ri) r[n++] = i;
+			for (size_t j = 0, n = 0; j < 4; ++j) if (j != rj) c[n++] = j;
+
+			return T(0) + m[r[0]][c[0]] * det2(r[1], r[2], c[1], c[2])
+			            - m[r[0]][c[1]] * det2(r[1], r[2], c[0], c[2])
+			            + m[r[0]][c[2]] * det2(r[1], r[2], c[0], c[1]);
+		}
 };
 
+static_assert(std::is_trivially_copyable_v<Matrix<4, float>>, "matrices are copied and stored as plain bytes");
+
 // Special functions
 
 template<size_t s, typename T, typename S>
 Matrix<s, T> operator*(const S scalar, const Matrix<s, T>& matrix) {
 	Matrix<s, T> ret(matrix);
-	for (size_t i = 0; i < s; ++i) {
-		for (size_t j = 0; j < s; ++j) {
-			ret.m[i][j] *= scalar;
-		}
-	}
+	ret *= scalar;
 	return ret;
 }
 
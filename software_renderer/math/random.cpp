@@ -1,16 +1,48 @@
 #include "random.h"
 
+#define PCG_MULTIPLIER 6364136223846793005ULL
+
+
+// splitmix64 finalizer, neighbouring pixels would otherwise get nearly identical increments
+static uint64_t mixBits(uint64_t value) {
+	value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	value = (value ^ (value >> 27)) * 0x94d049bb133111ebULL;
+	return value ^ (value >> 31);
+}
+
 
 RandomGenerator::RandomGenerator()
-:rng(std::random_device()()), distribution(0.0f, 1.0f) {}
+:state(0), increment(1) {
+	seed(0, 0);
+}
+
+RandomGenerator::RandomGenerator(uint64_t seed, uint64_t stream)
+:state(0), increment(1) {
+	this->seed(seed, stream);
+}
 
 RandomGenerator::~RandomGenerator() {}
 
+void RandomGenerator::seed(uint64_t seed, uint64_t stream) {
+	state = 0;
+	increment = (mixBits(stream) << 1) | 1;
+	randUInt();
+	state += seed;
+	randUInt();
+}
+
+uint32_t RandomGenerator::randUInt() {
+	uint64_t oldState = state;
+	state = oldState * PCG_MULTIPLIER + increment;
+
+	uint32_t xorShifted = uint32_t(((oldState >> 18) ^ oldState) >> 27);
+	uint32_t rotation = uint32_t(oldState >> 59);
+	return (xorShifted >> rotation) | (xorShifted << ((-rotation) & 31));
+}
+
 float RandomGenerator::rand() {
-	mutex.lock();
-	float ret = distribution(rng);
-	mutex.unlock();
-	return ret;
+	// upper 24 bits fit exactly into the float mantissa, so the result stays below 1
+	return float(randUInt() >> 8) * (1.0f / 16777216.0f);
 }
 
 Vector3f RandomGenerator::randomNormal() {
@@ -1,22 +1,26 @@
 #pragma once
 
-#include <random>
-#include <mutex>
+#include <cstdint>
 
 #include "vector.h"
 
 
+// PCG32 generator (pcg-random.org), every pixel gets its own stream
+// so results do not depend on which thread renders it.
 class RandomGenerator {
 	public:
 		RandomGenerator();
+		RandomGenerator(uint64_t seed, uint64_t stream);
 		~RandomGenerator();
 
+		void seed(uint64_t seed, uint64_t stream);
+
+		uint32_t randUInt();
 		float rand();
 		Vector3f randomNormal();
 		Vector3f randomNormalDirection(const Vector3f& normal);
 
 	private:
-		std::mt19937 rng;
-		std::uniform_real_distribution<float> distribution;
-		std::mutex mutex;
+		uint64_t state;
+		uint64_t increment;
 };
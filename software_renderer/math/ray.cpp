@@ -1,6 +1,9 @@
 #include "ray.h"
 
 
+Ray::Ray()
+:origin(), direction(), directionInv() {}
+
 Ray::Ray(const Vector3f& origin, const Vector3f& direction)
 :origin(origin), direction(direction), directionInv(1.0f / direction) {}
 
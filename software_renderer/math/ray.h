@@ -5,6 +5,7 @@
 
 class Ray {
 	public:
+		Ray();
 		Ray(const Vector3f& origin, const Vector3f& direction);
 		~Ray();
 
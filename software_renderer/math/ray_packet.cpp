@@ -0,0 +1,38 @@
+#include "ray_packet.h"
+
+
+RayPacket::RayPacket()
+:activeMask(0) {
+	clear();
+}
+
+RayPacket::~RayPacket() {}
+
+void RayPacket::clear() {
+	for (size_t lane = 0; lane < RAY_PACKET_SIZE; ++lane) {
+		for (size_t i = 0; i < 3; ++i) {
+			origin[i][lane] = 0.0f;
+			direction[i][lane] = 1.0f;
+			directionInv[i][lane] = 1.0f;
+		}
+		tMax[lane] = -1.0f;
+	}
+	activeMask = 0;
+}
+
+void RayPacket::setRay(size_t lane, const Ray& ray, float tMax) {
+	for (size_t i = 0; i < 3; ++i) {
+		origin[i][lane] = ray.origin[i];
+		direction[i][lane] = ray.direction[i];
+		directionInv[i][lane] = ray.directionInv[i];
+	}
+	this->tMax[lane] = tMax;
+	activeMask |= uint32_t(1) << lane;
+}
+
+Ray RayPacket::getRay(size_t lane) const {
+	return Ray(
+		Vector3f({origin[0][lane], origin[1][lane], origin[2][lane]}),
+		Vector3f({direction[0][lane], direction[1][lane], direction[2][lane]})
+	);
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+
+#include "simd.h"
+#include "ray.h"
+
+#ifndef RAY_PACKET_SIZE
+	#define RAY_PACKET_SIZE SIMD_WIDTH
+#endif
+
+#define RAY_PACKET_GROUPS (RAY_PACKET_SIZE / SIMD_WIDTH)
+#define RAY_PACKET_FULL_MASK uint32_t((uint64_t(1) << RAY_PACKET_SIZE) - 1)
+
+static_assert(RAY_PACKET_SIZE % SIMD_WIDTH == 0, "RAY_PACKET_SIZE has to be a multiple of SIMD_WIDTH");
+static_assert(RAY_PACKET_SIZE <= 32, "lane masks are stored in 32 bits");
+
+
+// Structure of arrays ray layout, lanes without a ray get a negative tMax so they never hit.
+class RayPacket {
+	public:
+		RayPacket();
+		~RayPacket();
+
+		void clear();
+		void setRay(size_t lane, const Ray& ray, float tMax=INFINITY);
+		Ray getRay(size_t lane) const;
+
+		alignas(SIMD_ALIGNMENT) float origin[3][RAY_PACKET_SIZE];
+		alignas(SIMD_ALIGNMENT) float direction[3][RAY_PACKET_SIZE];
+		alignas(SIMD_ALIGNMENT) float directionInv[3][RAY_PACKET_SIZE];
+		alignas(SIMD_ALIGNMENT) float tMax[RAY_PACKET_SIZE];
+		uint32_t activeMask;
+};
@@ -0,0 +1,130 @@
+#pragma once
+
+#include <cstdint>
+#include <algorithm>
+
+// The instruction set is picked at build time through the compiler flags
+// (see SOFTWARE_RENDERER_SIMD in CMakeLists.txt): AVX2 works on 8 floats,
+// SSE on 4 and the portable fallback emulates 4 lanes.
+
+#if defined(__AVX2__)
+	#include <immintrin.h>
+	#define SIMD_WIDTH 8
+	#define SIMD_NAME "AVX2"
+#elif defined(__SSE2__)
+	#include <emmintrin.h>
+	#define SIMD_WIDTH 4
+	#define SIMD_NAME "SSE"
+#else
+	#define SIMD_WIDTH 4
+	#define SIMD_NAME "none"
+#endif
+
+#define SIMD_ALIGNMENT (SIMD_WIDTH * 4)
+
+// SIMD_KERNEL marks the hot intersection and shading functions. With SIMD_DISPATCH (see
+// SOFTWARE_RENDERER_DISPATCH in CMakeLists.txt) they are compiled for AVX-512, AVX2, SSE4.2 and
+// the build target, and the dynamic loader picks the best one the CPU supports. flatten pulls the
+// BVH traversal templates into every clone. The data layout keeps the SIMD_WIDTH above, the
+// clones gain the VEX encoding, more registers and BMI.
+#if defined(SIMD_DISPATCH) && defined(__x86_64__) && defined(__linux__) && !defined(__AVX2__)
+	#define SIMD_KERNEL __attribute__((target_clones("arch=skylake-avx512", "arch=haswell", "sse4.2", "default"), flatten))
+#else
+	#define SIMD_KERNEL
+#endif
+
+// the instruction set of the SIMD_KERNEL clones this CPU runs
+inline const char* getSimdKernelName() {
+#if defined(SIMD_DISPATCH) && defined(__x86_64__) && defined(__linux__) && !defined(__AVX2__)
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw") && __builtin_cpu_supports("avx512vl")) return "AVX-512";
+	if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) return "AVX2";
+	if (__builtin_cpu_supports("sse4.2")) return "SSE4.2";
+#endif
+	return SIMD_NAME;
+}
+
+
+class SimdFloat {
+	public:
+#if defined(__AVX2__)
+		__m256 v;
+
+		SimdFloat() {}
+		SimdFloat(__m256 v): v(v) {}
+		SimdFloat(float f): v(_mm256_set1_ps(f)) {}
+
+		static SimdFloat load(const float* p) { return _mm256_load_ps(p); }
+		void store(float* p) const { _mm256_store_ps(p, v); }
+
+		SimdFloat operator+(const SimdFloat& o) const { return _mm256_add_ps(v, o.v); }
+		SimdFloat operator-(const SimdFloat& o) const { return _mm256_sub_ps(v, o.v); }
+		SimdFloat operator*(const SimdFloat& o) const { return _mm256_mul_ps(v, o.v); }
+		SimdFloat operator/(const SimdFloat& o) const { return _mm256_div_ps(v, o.v); }
+
+		SimdFloat operator< (const SimdFloat& o) const { return _mm256_cmp_ps(v, o.v, _CMP_LT_OQ); }
+		SimdFloat operator<=(const SimdFloat& o) const { return _mm256_cmp_ps(v, o.v, _CMP_LE_OQ); }
+		SimdFloat operator> (const SimdFloat& o) const { return _mm256_cmp_ps(v, o.v, _CMP_GT_OQ); }
+		SimdFloat operator&(const SimdFloat& o) const { return _mm256_and_ps(v, o.v); }
+		SimdFloat operator|(const SimdFloat& o) const { return _mm256_or_ps(v, o.v); }
+
+		static SimdFloat min(const SimdFloat& a, const SimdFloat& b) { return _mm256_min_ps(a.v, b.v); }
+		static SimdFloat max(const SimdFloat& a, const SimdFloat& b) { return _mm256_max_ps(a.v, b.v); }
+		static SimdFloat select(const SimdFloat& mask, const SimdFloat& a, const SimdFloat& b) { return _mm256_blendv_ps(b.v, a.v, mask.v); }
+
+		uint32_t mask() const { return uint32_t(_mm256_movemask_ps(v)); }
+#elif defined(__SSE2__)
+		__m128 v;
+
+		SimdFloat() {}
+		SimdFloat(__m128 v): v(v) {}
+		SimdFloat(float f): v(_mm_set1_ps(f)) {}
+
+		static SimdFloat load(const float* p) { return _mm_load_ps(p); }
+		void store(float* p) const { _mm_store_ps(p, v); }
+
+		SimdFloat operator+(const SimdFloat& o) const { return _mm_add_ps(v, o.v); }
+		SimdFloat operator-(const SimdFloat& o) const { return _mm_sub_ps(v, o.v); }
+		SimdFloat operator*(const SimdFloat& o) const { return _mm_mul_ps(v, o.v); }
+		SimdFloat operator/(const SimdFloat& o) const { return _mm_div_ps(v, o.v); }
+
+		SimdFloat operator< (const SimdFloat& o) const { return _mm_cmplt_ps(v, o.v); }
+		SimdFloat operator<=(const SimdFloat& o) const { return _mm_cmple_ps(v, o.v); }
+		SimdFloat operator> (const SimdFloat& o) const { return _mm_cmpgt_ps(v, o.v); }
+		SimdFloat operator&(const SimdFloat& o) const { return _mm_and_ps(v, o.v); }
+		SimdFloat operator|(const SimdFloat& o) const { return _mm_or_ps(v, o.v); }
+
+		static SimdFloat min(const SimdFloat& a, const SimdFloat& b) { return _mm_min_ps(a.v, b.v); }
+		static SimdFloat max(const SimdFloat& a, const SimdFloat& b) { return _mm_max_ps(a.v, b.v); }
+		static SimdFloat select(const SimdFloat& mask, const SimdFloat& a, const SimdFloat& b) {
+			return _mm_or_ps(_mm_and_ps(mask.v, a.v), _mm_andnot_ps(mask.v, b.v));
+		}
+
+		uint32_t mask() const { return uint32_t(_mm_movemask_ps(v)); }
+#else
+		float v[SIMD_WIDTH];
+
+		SimdFloat() {}
+		SimdFloat(float f) { for (int i = 0; i < SIMD_WIDTH; ++i) v[i] = f; }
+
+		static SimdFloat load(const float* p) { SimdFloat r; for (int i = 0; i < SIMD_WIDTH; ++i) r.v[i] = p[i]; return r; }
+		void store(float* p) const { for (int i = 0; i < SIMD_WIDTH; ++i) p[i] = v[i]; }
+
+		SimdFloat operator+(const SimdFloat& o) const { SimdFloat r; for (int i = 0; i < SIMD_WIDTH; ++i) r.v[i] = v[i] + o.v[i]; return r; }
+		SimdFloat operator-(const SimdFloat& o) const { SimdFloat r; for (int i = 0; i < SIMD_WIDTH; ++i) r.v[i] = v[i] - o.v[i]; return r; }
+		SimdFloat operator*(const SimdFloat& o) const { SimdFloat r; for (int i = 0; i < SIMD_WIDTH; ++i) r.v[i] = v[i] * o.v[i]; return r; }
+		SimdFloat operator/(const SimdFloat& o) const { SimdFloat r; for (int i = 0; i < SIMD_WIDTH; ++i) r.v[i] = v[i] / o.v[i]; return r; }
+
+		SimdFloat operator< (const SimdFloat& o) const { SimdFloat r; for (int i = 0; i < SIMD_WIDTH; ++i) r.v[i] = v[i] <  o.v[i] ? 1.0f : 0.0f; return r; }
+		SimdFloat operator<=(const SimdFloat& o) const { SimdFloat r; for (int i = 0; i < SIMD_WIDTH; ++i) r.v[i] = v[i] <= o.v[i] ? 1.0f : 0.0f; return r; }
+		SimdFloat operator> (const SimdFloat& o) const { SimdFloat r; for (int i = 0; i < SIMD_WIDTH; ++i) r.v[i] = v[i] >  o.v[i] ? 1.0f : 0.0f; return r; }
+		SimdFloat operator&(const SimdFloat& o) const { SimdFloat r; for (int i = 0; i < SIMD_WIDTH; ++i) r.v[i] = (v[i] != 0.0f && o.v[i] != 0.0f) ? 1.0f : 0.0f; return r; }
+		SimdFloat operator|(const SimdFloat& o) const { SimdFloat r; for (int i = 0; i < SIMD_WIDTH; ++i) r.v[i] = (v[i] != 0.0f || o.v[i] != 0.0f) ? 1.0f : 0.0f; return r; }
+
+		static SimdFloat min(const SimdFloat& a, const SimdFloat& b) { SimdFloat r; for (int i = 0; i < SIMD_WIDTH; ++i) r.v[i] = a.v[i] < b.v[i] ? a.v[i] : b.v[i]; return r; }
+		static SimdFloat max(const SimdFloat& a, const SimdFloat& b) { SimdFloat r; for (int i = 0; i < SIMD_WIDTH; ++i) r.v[i] = a.v[i] > b.v[i] ? a.v[i] : b.v[i]; return r; }
+		static SimdFloat select(const SimdFloat& mask, const SimdFloat& a, const SimdFloat& b) { SimdFloat r; for (int i = 0; i < SIMD_WIDTH; ++i) r.v[i] = mask.v[i] != 0.0f ? a.v[i] : b.v[i]; return r; }
+
+		uint32_t mask() const { uint32_t m = 0; for (int i = 0; i < SIMD_WIDTH; ++i) m |= uint32_t(v[i] != 0.0f) << i; return m; }
+#endif
+};
@@ -5,9 +5,39 @@
 #include <algorithm>
 #include <vector>
 #include <iostream>
+#include <utility>
+#include <type_traits>
+#include <initializer_list>
+
+#if defined(__SSE__)
+	#include <xmmintrin.h>
+#endif
+
+// All operations are unrolled at compile time over the vector size. Vector4f is 16 byte aligned
+// and its element wise operations use SSE, sums keep the order of the scalar code so the results
+// are bit for bit the same.
+
+template<typename F, size_t... I>
+inline void unrollIndices(F&& f, std::index_sequence<I...>) {
+	(f(std::integral_constant<size_t, I>()), ...);
+}
+
+template<size_t s, typename F>
+inline void unroll(F&& f) {
+	unrollIndices(f, std::make_index_sequence<s>());
+}
+
+template<size_t s, typename T>
+constexpr bool isSseVector() {
+#if defined(__SSE__)
+	return s == 4 && std::is_same_v<T, float>;
+#else
+	return false;
+#endif
+}
 
 template <size_t s, typename T>
-class Vector {
+class alignas(isSseVector<s, T>() ? 16 : alignof(T)) Vector {
 	public:
 		// Vector itself
 		T v[s];
@@ -16,27 +46,16 @@ class Vector {
 
 		Vector() : v{0} {}
 		Vector(const T* vec) : v{0} {
-			for (size_t i = 0; i < s; ++i) {
-				this->v[i] = vec[i];
-			}
+			unroll<s>([&](size_t i) { this->v[i] = vec[i]; });
 		}
 		Vector(const std::vector<T>& vec) : v{0} {
 			for (size_t i = 0; i < s && i < vec.size(); ++i) {
 				this->v[i] = vec[i];
 			}
 		}
-
-		Vector(const Vector& other) {
-			for (size_t i = 0; i < s; ++i) {
-				this->v[i] = other.v[i];
-			}
-		}
-
-		Vector& operator=(const Vector& other) {
-			for (size_t i = 0; i < s; ++i) {
-				this->v[i] = other.v[i];
-			}
-			return *this;
+		// Vector3f({x, y, z}) used to build a temporary std::vector, this takes the list directly
+		Vector(std::initializer_list<T> list) : v{0} {
+			std::copy_n(list.begin(), std::min(s, list.size()), v);
 		}
 
 		// Access Operators
@@ -58,68 +77,64 @@ class Vector {
 		template<typename S>
 		Vector operator+(const S scalar) const {
 			Vector ret(*this);
-			for (size_t i = 0; i < s; ++i) {
-				ret.v[i] += scalar;
-			}
+			ret += scalar;
 			return ret;
 		}
 
 		template<typename S>
 		Vector operator-(const S scalar) const {
 			Vector ret(*this);
-			for (size_t i = 0; i < s; ++i) {
-				ret.v[i] -= scalar;
-			}
+			ret -= scalar;
 			return ret;
 		}
 
 		template<typename S>
 		Vector operator*(const S scalar) const {
 			Vector ret(*this);
-			for (size_t i = 0; i < s; ++i) {
-				ret.v[i] *= scalar;
-			}
+			ret *= scalar;
 			return ret;
 		}
 
 		template<typename S>
 		Vector operator/(const S scalar) const {
 			Vector ret(*this);
-			for (size_t i = 0; i < s; ++i) {
-				ret.v[i] /= scalar;
-			}
+			ret /= scalar;
 			return ret;
 		}
 
 		template<typename S>
 		Vector& operator+=(const S scalar) {
-			for (size_t i = 0; i < s; ++i) {
-				this->v[i] += scalar;
-			}
+#if defined(__SSE__)
+			if constexpr (isSseVector<s, T>() && std::is_same_v<S, float>) return store(_mm_add_ps(load(), _mm_set1_ps(scalar)));
+#endif
+			unroll<s>([&](size_t i) { this->v[i] += scalar; });
 			return *this;
 		}
 
 		template<typename S>
 		Vector& operator-=(const S scalar) {
-			for (size_t i = 0; i < s; ++i) {
-				this->v[i] -= scalar;
-			}
+#if defined(__SSE__)
+			if constexpr (isSseVector<s, T>() && std::is_same_v<S, float>) return store(_mm_sub_ps(load(), _mm_set1_ps(scalar)));
+#endif
+			unroll<s>([&](size_t i) { this->v[i] -= scalar; });
 			return *this;
 		}
 
 		template<typename S>
 		Vector& operator*=(const S scalar) {
-			for (size_t i = 0; i < s; ++i) {
-				this->v[i] *= scalar;
-			}
+#if defined(__SSE__)
+			if constexpr (isSseVector<s, T>() && std::is_same_v<S, float>) return store(_mm_mul_ps(load(), _mm_set1_ps(scalar)));
+#endif
+			unroll<s>([&](size_t i) { this->v[i] *= scalar; });
 			return *this;
 		}
 
 		template<typename S>
 		Vector& operator/=(const S scalar) {
-			for (size_t i = 0; i < s; ++i) {
-				this->v[i] /= scalar;
-			}
+#if defined(__SSE__)
+			if constexpr (isSseVector<s, T>() && std::is_same_v<S, float>) return store(_mm_div_ps(load(), _mm_set1_ps(scalar)));
+#endif
+			unroll<s>([&](size_t i) { this->v[i] /= scalar; });
 			return *this;
 		}
 
@@ -127,61 +142,57 @@ class Vector {
 
 		Vector operator+(const Vector& other) const {
 			Vector ret(*this);
-			for (size_t i = 0; i < s; ++i) {
-				ret.v[i] += other.v[i];
-			}
+			ret += other;
 			return ret;
 		}
 
 		Vector operator-(const Vector& other) const {
 			Vector ret(*this);
-			for (size_t i = 0; i < s; ++i) {
-				ret.v[i] -= other.v[i];
-			}
+			ret -= other;
 			return ret;
 		}
 
 		Vector operator*(const Vector& other) const {
 			Vector ret(*this);
-			for (size_t i = 0; i < s; ++i) {
-				ret.v[i] *= other.v[i];
-			}
+			ret *= other;
 			return ret;
 		}
 
 		Vector operator/(const Vector& other) const {
 			Vector ret(*this);
-			for (size_t i = 0; i < s; ++i) {
-				ret.v[i] /= other.v[i];
-			}
+			ret /= other;
 			return ret;
 		}
 
 		Vector& operator+=(const Vector& other) {
-			for (size_t i = 0; i < s; ++i) {
-				this->v[i] += other.v[i];
-			}
+#if defined(__SSE__)
+			if constexpr (isSseVector<s, T>()) return store(_mm_add_ps(load(), other.load()));
+#endif
+			unroll<s>([&](size_t i) { this->v[i] += other.v[i]; });
 			return *this;
 		}
 
 		Vector& operator-=(const Vector& other) {
-			for (size_t i = 0; i < s; ++i) {
-				this->v[i] -= other.v[i];
-			}
+#if defined(__SSE__)
+			if constexpr (isSseVector<s, T>()) return store(_mm_sub_ps(load(), other.load()));
+#endif
+			unroll<s>([&](size_t i) { this->v[i] -= other.v[i]; });
 			return *this;
 		}
 
 		Vector& operator*=(const Vector& other) {
-			for (size_t i = 0; i < s; ++i) {
-				this->v[i] *= other.v[i];
-			}
+#if defined(__SSE__)
+			if constexpr (isSseVector<s, T>()) return store(_mm_mul_ps(load(), other.load()));
+#endif
+			unroll<s>([&](size_t i) { this->v[i] *= other.v[i]; });
 			return *this;
 		}
 
 		Vector& operator/=(const Vector& other) {
-			for (size_t i = 0; i < s; ++i) {
-				this->v[i] /= other.v[i];
-			}
+#if defined(__SSE__)
+			if constexpr (isSseVector<s, T>()) return store(_mm_div_ps(load(), other.load()));
+#endif
+			unroll<s>([&](size_t i) { this->v[i] /= other.v[i]; });
 			return *this;
 		}
 
@@ -189,22 +200,14 @@ class Vector {
 
 		bool operator==(const Vector& other) const {
 			bool equal = true;
-
-			for (size_t i = 0; i < s; ++i) {
-				equal = equal && (this->v[i] == other.v[i]);
-			}
-
+			unroll<s>([&](size_t i) { equal = equal && (this->v[i] == other.v[i]); });
 			return equal;
 		}
 
 		// additional math operators
 
 		T magnitudeSquared() const {
-			T sum = 0;
-			for (size_t i = 0; i < s; ++i) {
-				sum += this->v[i] * this->v[i];
-			}
-			return sum;
+			return this->dot(*this);
 		}
 
 		double magnitude() const {
@@ -216,9 +219,7 @@ class Vector {
 
 			if (magnitude != 0) {
 				double factor = 1.0 / magnitude;
-				for (size_t i = 0; i < s; ++i) {
-					this->v[i] *= factor;
-				}
+				unroll<s>([&](size_t i) { this->v[i] *= factor; });
 			}
 
 			return *this;
@@ -234,52 +235,56 @@ class Vector {
 
 		T dot(const Vector& other) const {
 			T sum = 0;
-			for (size_t i = 0; i < s; ++i) {
-				sum += this->v[i] * other.v[i];
-			}
+			unroll<s>([&](size_t i) { sum += this->v[i] * other.v[i]; });
 			return sum;
 		}
 
 		double angle(const Vector& other) const {
 			return acos( std::clamp(double(this->dot(other)) / (this->magnitude() * other.magnitude()), -1.0, 1.0) );
 		}
+
+#if defined(__SSE__)
+		__m128 load() const {
+			return _mm_load_ps(v);
+		}
+
+		Vector& store(__m128 value) {
+			_mm_store_ps(v, value);
+			return *this;
+		}
+#endif
 };
 
+static_assert(std::is_trivially_copyable_v<Vector<3, float>>, "vectors are copied and stored as plain bytes");
+static_assert(std::is_trivially_copyable_v<Vector<4, float>>, "vectors are copied and stored as plain bytes");
+
 // Math Operators with Scalar
 
 template<size_t s, typename T, typename S>
 Vector<s, T> operator+(const S scalar, const Vector<s, T>& vector) {
 	Vector<s, T> ret;
-	for (size_t i = 0; i < s; ++i) {
-		ret.v[i] = scalar + vector.v[i];
-	}
+	unroll<s>([&](size_t i) { ret.v[i] = scalar + vector.v[i]; });
 	return ret;
 }
 
 template<size_t s, typename T, typename S>
 Vector<s, T> operator-(const S scalar, const Vector<s, T>& vector) {
 	Vector<s, T> ret;
-	for (size_t i = 0; i < s; ++i) {
-		ret.v[i] = scalar - vector.v[i];
-	}
+	unroll<s>([&](size_t i) { ret.v[i] = scalar - vector.v[i]; });
 	return ret;
 }
 
 template<size_t s, typename T, typename S>
 Vector<s, T> operator*(const S scalar, const Vector<s, T>& vector) {
 	Vector<s, T> ret;
-	for (size_t i = 0; i < s; ++i) {
-		ret.v[i] = scalar * vector.v[i];
-	}
+	unroll<s>([&](size_t i) { ret.v[i] = scalar * vector.v[i]; });
 	return ret;
 }
 
 template<size_t s, typename T, typename S>
 Vector<s, T> operator/(const S scalar, const Vector<s, T>& vector) {
 	Vector<s, T> ret;
-	for (size_t i = 0; i < s; ++i) {
-		ret.v[i] = scalar / vector.v[i];
-	}
+	unroll<s>([&](size_t i) { ret.v[i] = scalar / vector.v[i]; });
 	return ret;
 }
 
@@ -306,11 +311,7 @@ T lerp(T v0, T v1, float t) {
 template<size_t s, typename T>
 Vector<s, T> lerp(const Vector<s, T>& v0, const Vector<s, T>& v1, float t) {
 	Vector<s, T> res;
-
-	for (size_t i = 0; i < s; ++i) {
-		res[i] = lerp(v0[i], v1[i], t);
-	}
-
+	unroll<s>([&](size_t i) { res[i] = lerp(v0[i], v1[i], t); });
 	return res;
 }
 
@@ -0,0 +1,156 @@
+#include "wide_bvh.h"
+
+#include <algorithm>
+
+#include "../init_exception.h"
+#include "../binary_file.h"
+
+
+WideBVH::WideBVH()
+:nodes(), elemIndices() {}
+
+WideBVH::~WideBVH() {}
+
+void WideBVH::init(const BVH& bvh) {
+	nodes.clear();
+	elemIndices.clear();
+
+	if (bvh.getNodes().empty()) return;
+	collapse(bvh, 0, 1);
+}
+
+size_t WideBVH::getNodeCount() const {
+	return nodes.size();
+}
+
+size_t WideBVH::getBlockCount() const {
+	return elemIndices.size() / WIDE_BVH_WIDTH;
+}
+
+const std::vector<uint32_t>& WideBVH::getElemIndices() const {
+	return elemIndices;
+}
+
+void WideBVH::write(BinaryWriter& writer) const {
+	writer.writeArray(nodes);
+	writer.writeArray(elemIndices);
+}
+
+void WideBVH::read(BinaryReader& reader) {
+	reader.readArray(nodes);
+	reader.readArray(elemIndices);
+}
+
+bool WideBVH::isValid(size_t elemCount) const {
+	if (elemIndices.size() % WIDE_BVH_WIDTH != 0) return false;
+	for (uint32_t elemIndex: elemIndices) {
+		if (elemIndex != WIDE_BVH_EMPTY_ELEM && elemIndex >= elemCount) return false;
+	}
+
+	size_t blockCount = getBlockCount();
+	std::vector<uint32_t> depths(nodes.size(), 1);
+	for (size_t i = 0; i < nodes.size(); ++i) {
+		const Node& node = nodes[i];
+		if (depths[i] >= BVH_STACK_SIZE) return false;
+		if ((uint64_t(node.childMask) >> WIDE_BVH_WIDTH) != 0) return false;
+
+		for (size_t c = 0; c < WIDE_BVH_WIDTH; ++c) {
+			if ((node.childMask & (uint32_t(1) << c)) == 0) continue;
+
+			if (node.count[c] > 0) {
+				if (size_t(node.offset[c]) + node.count[c] > blockCount) return false;
+				continue;
+			}
+
+			// inner nodes are stored before their children
+			if (node.offset[c] <= i || node.offset[c] >= nodes.size()) return false;
+			depths[node.offset[c]] = std::max(depths[node.offset[c]], depths[i] + 1);
+		}
+	}
+	return true;
+}
+
+size_t WideBVH::collapse(const BVH& bvh, uint32_t binaryIndex, size_t depth) {
+	if (depth >= BVH_STACK_SIZE) throw InitException("WideBVH", "tree is too deep for traversal!");
+
+	const std::vector<BVH::Node>& binaryNodes = bvh.getNodes();
+
+	// open the inner child with the largest surface area until all slots are used
+	uint32_t children[WIDE_BVH_WIDTH];
+	size_t childCount = 0;
+	if (binaryNodes[binaryIndex].count > 0) {
+		children[childCount++] = binaryIndex;
+	} else {
+		children[childCount++] = binaryIndex + 1;
+		children[childCount++] = binaryNodes[binaryIndex].offset;
+	}
+
+	while (childCount < WIDE_BVH_WIDTH) {
+		size_t largest = childCount;
+		float largestArea = -1.0f;
+		for (size_t c = 0; c < childCount; ++c) {
+			const BVH::Node& child = binaryNodes[children[c]];
+			if (child.count > 0) continue;
+
+			float area = AABB(child.aabbMin, child.aabbMax).getSurfaceArea();
+			if (area > largestArea) {
+				largest = c;
+				largestArea = area;
+			}
+		}
+		if (largest == childCount) break;
+
+		uint32_t opened = children[largest];
+		children[largest] = opened + 1;
+		children[childCount++] = binaryNodes[opened].offset;
+	}
+
+	size_t index = nodes.size();
+	nodes.emplace_back();
+	nodes[index].childMask = (uint32_t(1) << childCount) - 1;
+
+	for (size_t c = 0; c < WIDE_BVH_WIDTH; ++c) {
+		Node& node = nodes[index];
+		if (c >= childCount) {
+			for (size_t i = 0; i < 3; ++i) {
+				node.aabbMin[i][c] = 0.0f;
+				node.aabbMax[i][c] = 0.0f;
+			}
+			node.offset[c] = 0;
+			node.count[c] = 0;
+			continue;
+		}
+
+		const BVH::Node& child = binaryNodes[children[c]];
+		for (size_t i = 0; i < 3; ++i) {
+			node.aabbMin[i][c] = child.aabbMin[i];
+			node.aabbMax[i][c] = child.aabbMax[i];
+		}
+
+		uint32_t offset, count;
+		if (child.count > 0) {
+			addLeaf(bvh, child, offset, count);
+		} else {
+			offset = collapse(bvh, children[c], depth + 1);
+			count = 0;
+		}
+		nodes[index].offset[c] = offset;
+		nodes[index].count[c] = count;
+	}
+
+	return index;
+}
+
+void WideBVH::addLeaf(const BVH& bvh, const BVH::Node& binaryNode, uint32_t& offset, uint32_t& count) {
+	const std::vector<uint32_t>& binaryElemIndices = bvh.getElemIndices();
+
+	offset = elemIndices.size() / WIDE_BVH_WIDTH;
+	count = (binaryNode.count + WIDE_BVH_WIDTH - 1) / WIDE_BVH_WIDTH;
+
+	elemIndices.insert(
+		elemIndices.end(),
+		binaryElemIndices.begin() + binaryNode.offset,
+		binaryElemIndices.begin() + binaryNode.offset + binaryNode.count
+	);
+	elemIndices.resize((offset + count) * WIDE_BVH_WIDTH, WIDE_BVH_EMPTY_ELEM);
+}
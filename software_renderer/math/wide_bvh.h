@@ -0,0 +1,158 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+#include "simd.h"
+#include "ray.h"
+#include "bounding_volume_hierachy.h"
+#include "../render_stats.h"
+
+#define WIDE_BVH_WIDTH SIMD_WIDTH
+#define WIDE_BVH_STACK_SIZE (BVH_STACK_SIZE * WIDE_BVH_WIDTH)
+#define WIDE_BVH_EMPTY_ELEM UINT32_MAX
+
+class BinaryWriter;
+class BinaryReader;
+
+// SIMD_WIDTH-ary BVH collapsed from a binary BVH, one SIMD test checks a ray against all children.
+// Leaves reference blocks of WIDE_BVH_WIDTH elements, the unused slots of a block are WIDE_BVH_EMPTY_ELEM.
+class WideBVH {
+	public:
+		// Children bounds are stored structure of arrays. Inner children store their node index in
+		// offset and have a count of 0, leaf children store their range of blocks in offset and count.
+		struct alignas(SIMD_ALIGNMENT) Node {
+			float aabbMin[3][WIDE_BVH_WIDTH];
+			float aabbMax[3][WIDE_BVH_WIDTH];
+			uint32_t offset[WIDE_BVH_WIDTH];
+			uint32_t count[WIDE_BVH_WIDTH];
+			uint32_t childMask;
+		};
+
+		WideBVH();
+		~WideBVH();
+
+		void init(const BVH& bvh);
+		size_t getNodeCount() const;
+		size_t getBlockCount() const;
+		const std::vector<uint32_t>& getElemIndices() const;
+
+		void write(BinaryWriter& writer) const;
+		void read(BinaryReader& reader);
+		// see BVH::isValid
+		bool isValid(size_t elemCount) const;
+
+		// Closest hit traversal, intersect(blockIndex, tMax) has to return true
+		// and shrink tMax when it found a closer hit.
+		template<typename IntersectFunc>
+		bool traverse(const Ray& ray, float& tMax, IntersectFunc intersect) const {
+			if (nodes.empty()) return false;
+
+			StackEntry stack[WIDE_BVH_STACK_SIZE];
+			size_t stackSize = 0;
+			bool hit = false;
+			stack[stackSize++] = {0, 0, 0.0f};
+			uint64_t visitedNodes = 0;
+
+			alignas(SIMD_ALIGNMENT) float tEntries[WIDE_BVH_WIDTH];
+			while (stackSize > 0) {
+				const StackEntry entry = stack[--stackSize];
+				if (entry.tEntry > tMax) continue;
+				++visitedNodes;
+
+				if (entry.count > 0) {
+					for (uint32_t b = entry.offset; b < entry.offset + entry.count; ++b) {
+						if (intersect(size_t(b), tMax)) hit = true;
+					}
+					continue;
+				}
+
+				const Node& node = nodes[entry.offset];
+				uint32_t hitMask = intersectChildren(node, ray, tMax, tEntries);
+
+				// sorted by entry distance, the nearest child ends up on top of the stack
+				size_t first = stackSize;
+				while (hitMask != 0) {
+					size_t c = __builtin_ctz(hitMask);
+					hitMask &= hitMask - 1;
+
+					size_t i = stackSize++;
+					while (i > first && stack[i - 1].tEntry < tEntries[c]) {
+						stack[i] = stack[i - 1];
+						--i;
+					}
+					stack[i] = {node.offset[c], node.count[c], tEntries[c]};
+				}
+			}
+
+			RenderStats::add(RenderStats::NodesVisited, visitedNodes);
+			return hit;
+		}
+
+		// Any hit traversal, stops as soon as intersect(blockIndex, tMax) returns true.
+		template<typename IntersectFunc>
+		bool traverseAny(const Ray& ray, float tMax, IntersectFunc intersect) const {
+			if (nodes.empty()) return false;
+
+			StackEntry stack[WIDE_BVH_STACK_SIZE];
+			size_t stackSize = 0;
+			stack[stackSize++] = {0, 0, 0.0f};
+			uint64_t visitedNodes = 0;
+			bool hit = false;
+
+			alignas(SIMD_ALIGNMENT) float tEntries[WIDE_BVH_WIDTH];
+			while (stackSize > 0 && !hit) {
+				const StackEntry entry = stack[--stackSize];
+				++visitedNodes;
+
+				if (entry.count > 0) {
+					for (uint32_t b = entry.offset; b < entry.offset + entry.count && !hit; ++b) {
+						hit = intersect(size_t(b), tMax);
+					}
+					continue;
+				}
+
+				const Node& node = nodes[entry.offset];
+				uint32_t hitMask = intersectChildren(node, ray, tMax, tEntries);
+				while (hitMask != 0) {
+					size_t c = __builtin_ctz(hitMask);
+					hitMask &= hitMask - 1;
+					stack[stackSize++] = {node.offset[c], node.count[c], tEntries[c]};
+				}
+			}
+
+			RenderStats::add(RenderStats::NodesVisited, visitedNodes);
+			return hit;
+		}
+
+	private:
+		struct StackEntry {
+			uint32_t offset;
+			uint32_t count;
+			float tEntry;
+		};
+
+		static uint32_t intersectChildren(const Node& node, const Ray& ray, float tMax, float* tEntries) {
+			SimdFloat tMinChildren(0.0f);
+			SimdFloat tMaxChildren(tMax);
+
+			for (size_t i = 0; i < 3; ++i) {
+				SimdFloat origin(ray.origin[i]);
+				SimdFloat directionInv(ray.directionInv[i]);
+				SimdFloat t1 = (SimdFloat::load(node.aabbMin[i]) - origin) * directionInv;
+				SimdFloat t2 = (SimdFloat::load(node.aabbMax[i]) - origin) * directionInv;
+
+				tMinChildren = SimdFloat::max(tMinChildren, SimdFloat::min(t1, t2));
+				tMaxChildren = SimdFloat::min(tMaxChildren, SimdFloat::max(t1, t2));
+			}
+
+			tMinChildren.store(tEntries);
+			return (tMinChildren <= tMaxChildren).mask() & node.childMask;
+		}
+
+		size_t collapse(const BVH& bvh, uint32_t binaryIndex, size_t depth);
+		void addLeaf(const BVH& bvh, const BVH::Node& binaryNode, uint32_t& offset, uint32_t& count);
+
+		std::vector<Node> nodes;
+		std::vector<uint32_t> elemIndices;
+};
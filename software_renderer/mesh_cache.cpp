@@ -0,0 +1,100 @@
+#include "mesh_cache.h"
+
+#include <cstring>
+#include <filesystem>
+
+#include "mapped_file.h"
+#include "binary_file.h"
+
+#define MESH_CACHE_PATH std::string("../res/mesh/")
+#define MESH_CACHE_SUFFIX std::string(".mesh")
+#define MESH_CACHE_MAGIC 0x434d5253 // "SRMC"
+// has to be increased whenever the loaders, the BVH builders or the stored layout change
+#define MESH_CACHE_VERSION 1
+
+
+MeshCache::MeshCache(const std::string& basepath)
+:basepath(basepath) {}
+
+MeshCache::~MeshCache() {}
+
+Mesh* MeshCache::load(const std::string& name, uint64_t sourceHash, BVH::BuildMethod buildMethod) const {
+	MappedFile file;
+	if (!file.open(getCachePath(name))) return nullptr;
+
+	BinaryReader reader(file.data(), file.size());
+	Header header = reader.read<Header>();
+	Header expected = getHeader(sourceHash, buildMethod);
+	if (!reader.isValid() || std::memcmp(&header, &expected, sizeof(Header)) != 0) return nullptr;
+
+	Mesh* mesh = new Mesh();
+	mesh->read(reader);
+	if (!reader.isValid()) {
+		delete mesh;
+		return nullptr;
+	}
+
+	return mesh;
+}
+
+bool MeshCache::save(const std::string& name, uint64_t sourceHash, BVH::BuildMethod buildMethod, const Mesh& mesh) const {
+	std::string path = getCachePath(name);
+
+	// a read only res directory only costs the speedup
+	std::error_code error;
+	std::filesystem::create_directories(std::filesystem::path(path).parent_path(), error);
+	if (error) return false;
+
+	BinaryWriter writer(path);
+	if (!writer.isOpen()) return false;
+
+	writer.write(getHeader(sourceHash, buildMethod));
+	mesh.write(writer);
+	return writer.commit();
+}
+
+// 64 bit multiply xor hash over four independent lanes, reads the source at memory speed
+uint64_t MeshCache::hashData(const char* data, size_t size) {
+	const uint64_t prime = 0x9E3779B97F4A7C15ull;
+	uint64_t lanes[4] = {size, prime, ~size, ~prime};
+
+	size_t i = 0;
+	for (; i + 32 <= size; i += 32) {
+		for (size_t l = 0; l < 4; ++l) {
+			uint64_t word;
+			std::memcpy(&word, data + i + 8 * l, 8);
+			lanes[l] = (lanes[l] ^ word) * prime;
+			lanes[l] ^= lanes[l] >> 29;
+		}
+	}
+	for (; i < size; ++i) {
+		lanes[i % 4] = (lanes[i % 4] ^ uint8_t(data[i])) * prime;
+	}
+
+	uint64_t h = 0;
+	for (size_t l = 0; l < 4; ++l) {
+		h = (h ^ lanes[l]) * prime;
+		h ^= h >> 32;
+	}
+	return h;
+}
+
+uint64_t MeshCache::hashFile(const std::string& path) {
+	MappedFile file;
+	if (!file.open(path)) return 0;
+	return hashData(file.data(), file.size());
+}
+
+std::string MeshCache::getCachePath(const std::string& name) const {
+	return basepath + MESH_CACHE_PATH + name + MESH_CACHE_SUFFIX;
+}
+
+MeshCache::Header MeshCache::getHeader(uint64_t sourceHash, BVH::BuildMethod buildMethod) {
+	Header header{};
+	header.magic = MESH_CACHE_MAGIC;
+	header.version = MESH_CACHE_VERSION;
+	header.sourceHash = sourceHash;
+	header.buildMethod = uint32_t(buildMethod);
+	header.wideBvhWidth = WIDE_BVH_WIDTH;
+	return header;
+}
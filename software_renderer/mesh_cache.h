@@ -0,0 +1,39 @@
+#pragma once
+
+#include <string>
+#include <cstdint>
+
+#include "graphic/mesh.h"
+#include "math/bounding_volume_hierachy.h"
+
+
+// Preprocessed meshes in res/mesh, one file per source file holding the welded vertices,
+// the indices and both BVHs. Entries are keyed by a hash of the source file and the build
+// settings, an entry that does not match is rebuilt and overwritten.
+class MeshCache {
+	public:
+		struct Header {
+			uint32_t magic;
+			uint32_t version;
+			uint64_t sourceHash;
+			uint32_t buildMethod;
+			uint32_t wideBvhWidth;
+		};
+
+		MeshCache(const std::string& basepath);
+		~MeshCache();
+
+		// returns nullptr if there is no matching entry
+		Mesh* load(const std::string& name, uint64_t sourceHash, BVH::BuildMethod buildMethod) const;
+		bool save(const std::string& name, uint64_t sourceHash, BVH::BuildMethod buildMethod, const Mesh& mesh) const;
+
+		static uint64_t hashData(const char* data, size_t size);
+		// 0 if the file cannot be read
+		static uint64_t hashFile(const std::string& path);
+
+	private:
+		std::string getCachePath(const std::string& name) const;
+		static Header getHeader(uint64_t sourceHash, BVH::BuildMethod buildMethod);
+
+		std::string basepath;
+};
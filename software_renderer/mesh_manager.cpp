@@ -1,5 +1,7 @@
 #include "mesh_manager.h"
 
+#include <chrono>
+
 inline bool ends_with(std::string const & value, std::string const & ending) {
 	if (ending.size() > value.size()) return false;
 	return std::equal(ending.rbegin(), ending.rend(), value.rbegin());
@@ -7,7 +9,8 @@ inline bool ends_with(std::string const & value, std::string const & ending) {
 
 
 MeshManager::MeshManager(const std::string& basepath)
-:basepath(basepath), meshes(), createdObjects() {}
+:bvhBuildMethod(BVH::BuildMethod::BinnedSAH), bvhReport(false), useMeshCache(true), bvhBuildTime(0.0f),
+basepath(basepath), meshCache(basepath), meshes(), createdObjects() {}
 
 MeshManager::~MeshManager() {
 	for (GraphicsObject* obj: createdObjects) delete obj;
@@ -19,9 +22,24 @@ Mesh* MeshManager::getMesh(const std::string& name) {
 		return meshes[name];
 	} else {
 		Mesh* mesh = nullptr;
-		if      (ends_with(name, ".obj")) mesh = loadObj(name);
-		else if (ends_with(name, ".stl")) mesh = loadStl(name);
-		mesh->init();
+		uint64_t sourceHash = 0;
+		if (useMeshCache) {
+			sourceHash = MeshCache::hashFile(getSourcePath(name));
+			mesh = meshCache.load(name, sourceHash, bvhBuildMethod);
+		}
+
+		if (mesh == nullptr) {
+			if      (ends_with(name, ".obj")) mesh = loadObj(name);
+			else if (ends_with(name, ".stl")) mesh = loadStl(name);
+
+			auto initStart = std::chrono::steady_clock::now();
+			mesh->init(bvhBuildMethod);
+			bvhBuildTime += std::chrono::duration<float>(std::chrono::steady_clock::now() - initStart).count();
+
+			if (useMeshCache) meshCache.save(name, sourceHash, bvhBuildMethod, *mesh);
+		}
+
+		if (bvhReport) std::cout << "BVH " << name << " " << mesh->bvh.getStats() << std::endl;
 		meshes[name] = mesh;
 		return mesh;
 	}
@@ -74,6 +92,11 @@ Mesh* MeshManager::loadObj(const std::string& filename) {
 	return mesh;
 }
 
+std::string MeshManager::getSourcePath(const std::string& filename) const {
+	if (ends_with(filename, ".stl")) return STLLoader(basepath).getFilePath(filename);
+	return ObjLoader(basepath).getFilePath(filename);
+}
+
 Mesh* MeshManager::loadStl(const std::string& filename) {
 	STLLoader loader(basepath);
 	loader.load(filename);
@@ -11,6 +11,7 @@
 #include "input_parser.h"
 #include "stl_loader.h"
 #include "obj_loader.h"
+#include "mesh_cache.h"
 
 #include "math/vector.h"
 #include "math/matrix.h"
@@ -30,11 +31,19 @@ class MeshManager {
 		std::vector<GraphicsObject*> getCreatedObjects() const;
 		std::vector<GraphicsObject*> getCreatedLightSources() const;
 
+		BVH::BuildMethod bvhBuildMethod;
+		bool bvhReport;
+		bool useMeshCache;
+		// seconds spent in Mesh::init of the meshes not found in the cache
+		float bvhBuildTime;
+
 	private:
 		Mesh* loadObj(const std::string& filename);
 		Mesh* loadStl(const std::string& filename);
+		std::string getSourcePath(const std::string& filename) const;
 
 		std::string basepath;
+		MeshCache meshCache;
 
 		std::unordered_map<std::string, Mesh*> meshes;
 		std::vector<GraphicsObject*> createdObjects;
@@ -0,0 +1,46 @@
+#include "render_stats.h"
+
+#include <string>
+#include <algorithm>
+
+
+bool RenderStats::enabled = false;
+thread_local RenderStats RenderStats::local;
+
+void RenderStats::add(const RenderStats& other) {
+	for (size_t i = 0; i < CounterCount; ++i) counters[i] += other.counters[i];
+	maxPathDepth = std::max(maxPathDepth, other.maxPathDepth);
+}
+
+uint64_t RenderStats::getRayCount() const {
+	return counters[PrimaryRays] + counters[SecondaryRays] + counters[ShadowRays];
+}
+
+void RenderStats::writeJson(std::ostream& out, const std::string& indent) const {
+	out << "{\n";
+	for (size_t i = 0; i < CounterCount; ++i) {
+		out << indent << "\t\"" << getCounterName(Counter(i)) << "\": " << counters[i] << ",\n";
+	}
+
+	double paths = double(std::max(counters[Paths], uint64_t(1)));
+	double rays = double(std::max(getRayCount(), uint64_t(1)));
+	out << indent << "\t\"rays\": " << getRayCount() << ",\n";
+	out << indent << "\t\"nodesPerRay\": " << double(counters[NodesVisited]) / rays << ",\n";
+	out << indent << "\t\"triangleTestsPerRay\": " << double(counters[TriangleTests]) / rays << ",\n";
+	out << indent << "\t\"averagePathDepth\": " << double(counters[PathDepthSum]) / paths << ",\n";
+	out << indent << "\t\"maxPathDepth\": " << maxPathDepth << "\n";
+	out << indent << "}";
+}
+
+const char* RenderStats::getCounterName(Counter counter) {
+	switch (counter) {
+		case PrimaryRays:   return "primaryRays";
+		case SecondaryRays: return "secondaryRays";
+		case ShadowRays:    return "shadowRays";
+		case NodesVisited:  return "nodesVisited";
+		case TriangleTests: return "triangleTests";
+		case Paths:         return "paths";
+		case PathDepthSum:  return "pathDepthSum";
+		default:            return "unknown";
+	}
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <string>
+#include <cstdint>
+#include <ostream>
+
+
+// Opt-in counters of the render threads. Every thread adds to its own thread_local instance,
+// traversals count in locals and add once per call, so nothing on the hot path is atomic.
+// The counters cost one branch per call while disabled.
+struct alignas(64) RenderStats {
+	enum Counter {
+		PrimaryRays,
+		SecondaryRays,
+		ShadowRays,
+		NodesVisited,
+		// per SIMD lane, the padding lanes of a TriangleBlock included
+		TriangleTests,
+		Paths,
+		PathDepthSum,
+		CounterCount
+	};
+
+	uint64_t counters[CounterCount] = {};
+	uint64_t maxPathDepth = 0;
+
+	static inline void add(Counter counter, uint64_t count) {
+		if (enabled) local.counters[counter] += count;
+	}
+
+	static inline void addPath(uint64_t depth) {
+		if (!enabled) return;
+		local.counters[Paths] += 1;
+		local.counters[PathDepthSum] += depth;
+		if (depth > local.maxPathDepth) local.maxPathDepth = depth;
+	}
+
+	void add(const RenderStats& other);
+	uint64_t getRayCount() const;
+	void writeJson(std::ostream& out, const std::string& indent) const;
+
+	static const char* getCounterName(Counter counter);
+
+	static bool enabled;
+	static thread_local RenderStats local;
+};
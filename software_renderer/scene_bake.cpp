@@ -0,0 +1,116 @@
+#include "scene_bake.h"
+
+#include <unordered_map>
+
+#include "init_exception.h"
+#include "mapped_file.h"
+#include "binary_file.h"
+
+#define SCENE_BAKE_MAGIC 0x42535253 // "SRSB"
+// has to be increased whenever the stored layout of the scene, the meshes or the BVHs changes
+#define SCENE_BAKE_VERSION 1
+
+
+SceneBake::SceneBake()
+:meshes(), objects(), lightSources() {}
+
+SceneBake::~SceneBake() {
+	for (GraphicsObject* obj: objects) delete obj;
+	for (Mesh* mesh: meshes) delete mesh;
+}
+
+bool SceneBake::save(const std::string& path, const std::vector<GraphicsObject*>& objects, const std::vector<GraphicsObject*>& lightSources, const Scene& scene) {
+	// objects share meshes, each one is stored once in the order of first use
+	std::vector<const Mesh*> meshes;
+	std::unordered_map<const Mesh*, uint32_t> meshIndices;
+	std::unordered_map<const GraphicsObject*, uint32_t> objectIndices;
+	for (size_t i = 0; i < objects.size(); ++i) {
+		if (meshIndices.emplace(objects[i]->mesh, meshes.size()).second) meshes.push_back(objects[i]->mesh);
+		objectIndices[objects[i]] = i;
+	}
+
+	BinaryWriter writer(path);
+	if (!writer.isOpen()) return false;
+
+	Header header{};
+	header.magic = SCENE_BAKE_MAGIC;
+	header.version = SCENE_BAKE_VERSION;
+	header.wideBvhWidth = WIDE_BVH_WIDTH;
+	header.meshCount = meshes.size();
+	header.objectCount = objects.size();
+	header.lightSourceCount = lightSources.size();
+	writer.write(header);
+
+	for (const Mesh* mesh: meshes) mesh->write(writer);
+
+	for (const GraphicsObject* obj: objects) {
+		writer.write(meshIndices[obj->mesh]);
+		obj->write(writer);
+	}
+
+	for (const GraphicsObject* obj: lightSources) writer.write(objectIndices.at(obj));
+
+	scene.write(writer);
+	return writer.commit();
+}
+
+bool SceneBake::isBakedScene(const std::string& path) {
+	MappedFile file;
+	if (!file.open(path)) return false;
+
+	BinaryReader reader(file.data(), file.size());
+	uint32_t magic = reader.read<uint32_t>();
+	return reader.isValid() && magic == SCENE_BAKE_MAGIC;
+}
+
+void SceneBake::load(const std::string& path, Scene& scene) {
+	MappedFile file;
+	if (!file.open(path)) {
+		throw InitException("SceneBake", std::string("Could not load baked scene \"") + path + "\"!");
+	}
+
+	BinaryReader reader(file.data(), file.size());
+	Header header = reader.read<Header>();
+	if (!reader.isValid() || header.magic != SCENE_BAKE_MAGIC) {
+		throw InitException("SceneBake", std::string("\"") + path + "\" is not a baked scene!");
+	}
+	if (header.version != SCENE_BAKE_VERSION || header.wideBvhWidth != WIDE_BVH_WIDTH) {
+		throw InitException("SceneBake", std::string("baked scene \"") + path + "\" was written by another version, bake it again!");
+	}
+
+	meshes.reserve(header.meshCount);
+	for (uint32_t i = 0; i < header.meshCount && reader.isValid(); ++i) {
+		meshes.push_back(new Mesh());
+		meshes.back()->read(reader);
+	}
+
+	objects.reserve(header.objectCount);
+	for (uint32_t i = 0; i < header.objectCount && reader.isValid(); ++i) {
+		uint32_t meshIndex = reader.read<uint32_t>();
+		if (meshIndex >= meshes.size()) break;
+
+		GraphicsObject* obj = new GraphicsObject(meshes[meshIndex], Vector3f({0.0f, 0.0f, 0.0f}));
+		obj->read(reader);
+		objects.push_back(obj);
+		scene.addObject(obj);
+	}
+
+	for (uint32_t i = 0; i < header.lightSourceCount && reader.isValid(); ++i) {
+		uint32_t objectIndex = reader.read<uint32_t>();
+		if (objectIndex >= objects.size()) break;
+		lightSources.push_back(objects[objectIndex]);
+	}
+
+	scene.read(reader);
+	if (!reader.isValid() || objects.size() != header.objectCount || lightSources.size() != header.lightSourceCount) {
+		throw InitException("SceneBake", std::string("baked scene \"") + path + "\" is truncated!");
+	}
+}
+
+std::vector<GraphicsObject*> SceneBake::getObjects() const {
+	return objects;
+}
+
+std::vector<GraphicsObject*> SceneBake::getLightSources() const {
+	return lightSources;
+}
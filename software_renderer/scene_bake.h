@@ -0,0 +1,41 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include "graphic/mesh.h"
+#include "graphic/graphics_object.h"
+#include "graphic/scene.h"
+
+
+// A fully initialized scene in one file: the meshes with their hierarchies, the objects with
+// their matrices and bounds, the light source list and the object hierarchy. Loading one
+// skips the scene file, the mesh loaders and every BVH build.
+class SceneBake {
+	public:
+		struct Header {
+			uint32_t magic;
+			uint32_t version;
+			uint32_t wideBvhWidth;
+			uint32_t meshCount;
+			uint32_t objectCount;
+			uint32_t lightSourceCount;
+		};
+
+		SceneBake();
+		~SceneBake();
+
+		// the objects have to be initialized and added to the scene in this order
+		static bool save(const std::string& path, const std::vector<GraphicsObject*>& objects, const std::vector<GraphicsObject*>& lightSources, const Scene& scene);
+		static bool isBakedScene(const std::string& path);
+		void load(const std::string& path, Scene& scene);
+
+		std::vector<GraphicsObject*> getObjects() const;
+		std::vector<GraphicsObject*> getLightSources() const;
+
+	private:
+		std::vector<Mesh*> meshes;
+		std::vector<GraphicsObject*> objects;
+		std::vector<GraphicsObject*> lightSources;
+};
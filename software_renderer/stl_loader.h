@@ -4,13 +4,11 @@
 
 #include <cmath>
 #include <cstdint>
-#include <fstream>
 #include <vector>
 #include <string>
-#include <map>
-#include <unordered_map>
 
 #include "init_exception.h"
+#include "mapped_file.h"
 
 #include "graphic/mesh.h"
 #include "math/vector.h"
@@ -22,6 +20,8 @@ class STLLoader {
 		~STLLoader();
 
 		void load(const std::string& path);
+		void loadFile(const std::string& filePath);
+		std::string getFilePath(const std::string& path) const;
 		Mesh* get_mesh() const;
 
 		struct RawTriangle {
@@ -30,26 +30,18 @@ class STLLoader {
 			uint16_t attrib;
 		} __attribute__((packed));
 
-		struct Triangle {
-			Vector3f normal;
-			Vector3f vertex[3];
+		struct PositionHash {
+			size_t operator()(const Vector3f& pos) const;
 		};
 
-		struct TrianglePoint {
-			const Triangle* triangle;
-			Vector3f pos;
-			unsigned int vertex_index;
-			unsigned int triangle_index;
-		};
-
-		struct IndexedTriangle {
-			const Triangle* triangle;
-			Vector3u indexes;
-		};
+		// the records are read in place from the mapped file, y and z are swapped on access
+		Vector3f getNormal(size_t triangle_index) const;
+		Vector3f getVertex(size_t triangle_index, unsigned int vertex_index) const;
 
 	private:
 		uint8_t header[80];
 		uint32_t triangle_count;
-		std::vector<Triangle> triangles;
+		MappedFile file;
+		const RawTriangle* raw_triangles;
 		std::string basepath;
 };
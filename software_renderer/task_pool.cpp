@@ -0,0 +1,64 @@
+#include "task_pool.h"
+
+
+TaskPool::TaskPool(unsigned int threadCount)
+:threads(), tasks(), mutex(), taskAvailable(), tasksDone(), pendingTasks(0), stopping(false) {
+	threads.reserve(threadCount);
+	for (unsigned int t = 0; t < threadCount; ++t) {
+		threads.push_back(std::thread(&TaskPool::work, this));
+	}
+}
+
+TaskPool::~TaskPool() {
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	taskAvailable.notify_all();
+
+	for (std::thread& th: threads) th.join();
+}
+
+void TaskPool::submit(std::function<void()> task) {
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		tasks.push_back(std::move(task));
+		++pendingTasks;
+	}
+	taskAvailable.notify_one();
+}
+
+void TaskPool::wait() {
+	std::unique_lock<std::mutex> lock(mutex);
+
+	// the waiting thread helps out instead of idling, so a pool without workers still finishes
+	while (pendingTasks > 0) {
+		if (!runNextTask(lock)) tasksDone.wait(lock);
+	}
+}
+
+bool TaskPool::runNextTask(std::unique_lock<std::mutex>& lock) {
+	if (tasks.empty()) return false;
+
+	std::function<void()> task = std::move(tasks.front());
+	tasks.pop_front();
+
+	lock.unlock();
+	task();
+	lock.lock();
+
+	--pendingTasks;
+	if (pendingTasks == 0) tasksDone.notify_all();
+
+	return true;
+}
+
+void TaskPool::work() {
+	std::unique_lock<std::mutex> lock(mutex);
+
+	while (true) {
+		if (runNextTask(lock)) continue;
+		if (stopping) break;
+		taskAvailable.wait(lock);
+	}
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+
+class TaskPool {
+	public:
+		TaskPool(unsigned int threadCount);
+		~TaskPool();
+
+		void submit(std::function<void()> task);
+		void wait();
+
+	private:
+		bool runNextTask(std::unique_lock<std::mutex>& lock);
+		void work();
+
+		std::vector<std::thread> threads;
+		std::deque<std::function<void()>> tasks;
+		std::mutex mutex;
+		std::condition_variable taskAvailable;
+		std::condition_variable tasksDone;
+		size_t pendingTasks;
+		bool stopping;
+};
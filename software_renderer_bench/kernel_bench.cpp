@@ -0,0 +1,121 @@
+#include "kernel_bench.h"
+
+#include <chrono>
+#include <regex>
+#include <iomanip>
+#include <algorithm>
+
+#include "../software_renderer/math/simd.h"
+#include "../software_renderer/math/ray_packet.h"
+
+#define KERNEL_BENCH_VERSION 1
+#define FNV_PRIME 0x100000001b3ull
+
+
+KernelBench::KernelBench()
+:minTime(0.2f), repetitions(5), benchmarks(), results() {}
+
+KernelBench::~KernelBench() {}
+
+void KernelBench::add(const std::string& name, size_t itemCount, Kernel kernel) {
+	benchmarks.push_back({name, itemCount, kernel});
+}
+
+void KernelBench::run(const std::string& filter) {
+	std::regex filterRegex(filter);
+	results.clear();
+
+	for (const Benchmark& benchmark: benchmarks) {
+		if (!std::regex_search(benchmark.name, filterRegex)) continue;
+		results.push_back(measure(benchmark));
+	}
+}
+
+KernelBench::Result KernelBench::measure(const Benchmark& benchmark) const {
+	Result result;
+	result.name = benchmark.name;
+	result.itemCount = benchmark.itemCount;
+
+	// warm up the caches and find the pass count that takes about minTime / repetitions
+	auto start = std::chrono::steady_clock::now();
+	result.checksum = benchmark.kernel();
+	double passTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	uint64_t passes = std::max(uint64_t(1), uint64_t(minTime / repetitions / std::max(passTime, 1e-9)));
+
+	std::vector<double> times;
+	for (unsigned int r = 0; r < repetitions; ++r) {
+		uint64_t checksum = 0;
+		auto repetitionStart = std::chrono::steady_clock::now();
+		for (uint64_t p = 0; p < passes; ++p) checksum += benchmark.kernel();
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - repetitionStart).count();
+
+		// every pass sees the same data, the sum only keeps the compiler from dropping passes
+		if (checksum != passes * result.checksum) result.checksum = 0;
+		times.push_back(1e9 * seconds / double(passes * benchmark.itemCount));
+	}
+
+	std::sort(times.begin(), times.end());
+	result.iterations = passes * repetitions * benchmark.itemCount;
+	result.nanosecondsPerItem = times[times.size() / 2];
+	result.minNanosecondsPerItem = times.front();
+	return result;
+}
+
+void KernelBench::printTable(std::ostream& out) const {
+	out << std::left << std::setw(32) << "kernel" << std::right << std::setw(14) << "ns/item" << std::setw(14) << "min ns/item";
+	out << std::setw(16) << "Mitems/s" << std::setw(14) << "iterations" << "  checksum" << std::endl;
+	out << std::string(112, '-') << std::endl;
+
+	for (const Result& result: results) {
+		out << std::left << std::setw(32) << result.name << std::right << std::fixed << std::setprecision(3);
+		out << std::setw(14) << result.nanosecondsPerItem << std::setw(14) << result.minNanosecondsPerItem;
+		out << std::setw(16) << 1e3 / result.nanosecondsPerItem << std::setw(14) << result.iterations;
+		out << "  " << std::hex << std::setw(16) << std::setfill('0') << result.checksum << std::dec << std::setfill(' ') << std::endl;
+		out << std::defaultfloat;
+	}
+}
+
+void KernelBench::writeJson(std::ostream& out) const {
+	out << "{\n";
+	out << "\t\"version\": " << KERNEL_BENCH_VERSION << ",\n";
+	out << "\t\"context\": {\n";
+	out << "\t\t\"simd\": \"" << SIMD_NAME << "\",\n";
+	out << "\t\t\"simdKernels\": \"" << getSimdKernelName() << "\",\n";
+	out << "\t\t\"simdWidth\": " << SIMD_WIDTH << ",\n";
+	out << "\t\t\"rayPacketSize\": " << RAY_PACKET_SIZE << ",\n";
+#ifdef __OPTIMIZE__
+	out << "\t\t\"optimized\": true,\n";
+#else
+	out << "\t\t\"optimized\": false,\n";
+#endif
+	out << "\t\t\"minTime\": " << minTime << ",\n";
+	out << "\t\t\"repetitions\": " << repetitions << "\n";
+	out << "\t},\n";
+	out << "\t\"benchmarks\": [";
+
+	for (size_t i = 0; i < results.size(); ++i) {
+		const Result& result = results[i];
+		out << (i == 0 ? "\n" : ",\n") << "\t\t{\n";
+		out << "\t\t\t\"name\": \"" << result.name << "\",\n";
+		out << "\t\t\t\"itemCount\": " << result.itemCount << ",\n";
+		out << "\t\t\t\"iterations\": " << result.iterations << ",\n";
+		out << "\t\t\t\"nanosecondsPerItem\": " << result.nanosecondsPerItem << ",\n";
+		out << "\t\t\t\"minNanosecondsPerItem\": " << result.minNanosecondsPerItem << ",\n";
+		out << "\t\t\t\"itemsPerSecond\": " << 1e9 / result.nanosecondsPerItem << ",\n";
+		out << "\t\t\t\"checksum\": \"" << std::hex << std::setw(16) << std::setfill('0') << result.checksum << std::dec << std::setfill(' ') << "\"\n";
+		out << "\t\t}";
+	}
+
+	out << "\n\t]\n";
+	out << "}\n";
+}
+
+uint64_t KernelBench::hash(uint64_t hash, uint64_t value) {
+	return (hash ^ value) * FNV_PRIME;
+}
+
+uint64_t KernelBench::hash(uint64_t hash, float value) {
+	uint32_t bits;
+	std::memcpy(&bits, &value, sizeof(bits));
+	return KernelBench::hash(hash, uint64_t(bits));
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <ostream>
+#include <functional>
+
+
+// Microbenchmarks of the inner loop kernels in the style of Google Benchmark. Every kernel runs
+// over a fixed data set created from a fixed seed, repeated until minTime has passed, and the
+// median of the repetitions is reported. The checksum of the results tells whether two builds
+// still compute the same thing.
+class KernelBench {
+	public:
+		// processes the whole data set once and returns a checksum of the results
+		typedef std::function<uint64_t()> Kernel;
+
+		struct Result {
+			std::string name;
+			size_t itemCount;
+			uint64_t iterations;
+			double nanosecondsPerItem;
+			double minNanosecondsPerItem;
+			uint64_t checksum;
+		};
+
+		KernelBench();
+		~KernelBench();
+
+		// itemCount is the number of kernel calls of one pass over the data set
+		void add(const std::string& name, size_t itemCount, Kernel kernel);
+		void run(const std::string& filter);
+
+		void printTable(std::ostream& out) const;
+		void writeJson(std::ostream& out) const;
+
+		static uint64_t hash(uint64_t hash, uint64_t value);
+		static uint64_t hash(uint64_t hash, float value);
+
+		float minTime;
+		unsigned int repetitions;
+
+	private:
+		struct Benchmark {
+			std::string name;
+			size_t itemCount;
+			Kernel kernel;
+		};
+
+		Result measure(const Benchmark& benchmark) const;
+
+		std::vector<Benchmark> benchmarks;
+		std::vector<Result> results;
+};
+
+// registers the Vector, Matrix, Triangle, AABB, RandomGenerator and AliasTable kernels, the _legacy kernels
+// run the same code with the templates of legacy_math.h
+void addKernelBenchmarks(KernelBench& bench);
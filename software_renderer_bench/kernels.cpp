@@ -0,0 +1,305 @@
+#include "kernel_bench.h"
+
+#include <random>
+#include <vector>
+
+#include "../software_renderer/graphic/triangle.h"
+
+#include "../software_renderer/math/vector.h"
+#include "../software_renderer/math/matrix.h"
+#include "../software_renderer/math/ray.h"
+#include "../software_renderer/math/ray_packet.h"
+#include "../software_renderer/math/aabb.h"
+#include "../software_renderer/math/random.h"
+#include "../software_renderer/math/alias_table.h"
+
+#include "legacy_math.h"
+
+#define KERNEL_SEED 42
+#define KERNEL_DATA_SIZE 4096
+#define KERNEL_MATRIX_COUNT 1024
+#define KERNEL_RAY_DISTANCE 4.0f
+// the camera rays of a KERNEL_IMAGE_SIZE x KERNEL_IMAGE_SIZE image, one per item of KERNEL_DATA_SIZE
+#define KERNEL_IMAGE_SIZE 64
+
+
+// The data sets only depend on KERNEL_SEED, so every build benchmarks the same inputs.
+struct KernelData {
+	std::vector<Vector3f> a;
+	std::vector<Vector3f> b;
+	std::vector<Vector3f> c;
+	std::vector<Vector4f> v;
+	std::vector<Matrix4f> matrices;
+	std::vector<Triangle> triangles;
+	std::vector<AABB> boxes;
+	// rays[i] aims at triangles[i] completed to a parallelogram, about half of them hit
+	std::vector<Ray> rays;
+	std::vector<TriangleBlock> blocks;
+	std::vector<RayPacket> packets;
+	AliasTable aliasTable;
+	std::vector<float> uniforms;
+	Matrix4f viewInverse;
+	Matrix4f projInverse;
+
+	// the same inputs for the templates in legacy_math.h
+	std::vector<legacy::Vector4f> legacyV;
+	std::vector<legacy::Matrix4f> legacyMatrices;
+	legacy::Matrix4f legacyViewInverse;
+	legacy::Matrix4f legacyProjInverse;
+};
+
+Vector3f randomVector(std::mt19937& rng, float range) {
+	std::uniform_real_distribution<float> distribution(-range, range);
+	return Vector3f({distribution(rng), distribution(rng), distribution(rng)});
+}
+
+Ray createRayAt(std::mt19937& rng, const Triangle& triangle) {
+	std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+	Vector3f target = triangle.v0 + unit(rng) * triangle.edge0 + unit(rng) * triangle.edge1;
+	Vector3f origin = target + KERNEL_RAY_DISTANCE * randomVector(rng, 1.0f).normalize();
+	return Ray(origin, (target - origin).normalize());
+}
+
+legacy::Matrix4f toLegacy(const Matrix4f& matrix) {
+	legacy::Matrix4f ret;
+	for (size_t i = 0; i < 4; ++i) {
+		for (size_t j = 0; j < 4; ++j) ret[i][j] = matrix[i][j];
+	}
+	return ret;
+}
+
+// the direction part of PathTracer::getStartRay, written against either Vector and Matrix version
+template<typename V2, typename V3, typename V4, typename M4>
+static V3 getCameraRayDirection(const M4& viewInverse, const M4& projInverse, size_t index) {
+	V2 pixelCenter = V2({(float) (index % KERNEL_IMAGE_SIZE), (float) (index / KERNEL_IMAGE_SIZE)}) + V2({0.5f, 0.5f});
+	V2 inUV = V2({pixelCenter[0] / (float) KERNEL_IMAGE_SIZE, pixelCenter[1] / (float) KERNEL_IMAGE_SIZE});
+	V2 d = (2.0f * inUV) - V2({1.0f, 1.0f});
+	V3 target = cutVector(projInverse * V4({d[0], d[1], 1.0f, 1.0f})).normalize();
+	return cutVector(viewInverse * expandVector(target, 0.0f)).normalize();
+}
+
+static KernelData* createKernelData() {
+	std::mt19937 rng(KERNEL_SEED);
+	KernelData* data = new KernelData();
+
+	for (size_t i = 0; i < KERNEL_DATA_SIZE; ++i) {
+		data->a.push_back(randomVector(rng, 1.0f));
+		data->b.push_back(randomVector(rng, 1.0f));
+		data->c.push_back(randomVector(rng, 1.0f));
+		Vector3f p = randomVector(rng, 1.0f);
+		data->v.push_back(Vector4f({p[0], p[1], p[2], 1.0f}));
+		data->legacyV.push_back(legacy::Vector4f({p[0], p[1], p[2], 1.0f}));
+	}
+
+	for (size_t i = 0; i < KERNEL_MATRIX_COUNT; ++i) {
+		Matrix4f matrix;
+		for (size_t r = 0; r < 4; ++r) {
+			Vector3f row = randomVector(rng, 1.0f);
+			for (size_t c = 0; c < 3; ++c) matrix[r][c] = row[c];
+			matrix[r][3] = r == 3 ? 1.0f : 0.0f;
+		}
+		// a dominant diagonal keeps the random matrices well conditioned
+		for (size_t d = 0; d < 4; ++d) matrix[d][d] += 2.0f;
+		data->matrices.push_back(matrix);
+		data->legacyMatrices.push_back(toLegacy(matrix));
+	}
+
+	data->viewInverse = getLookAtMatrix(Vector3f({0.0f, 1.0f, 4.0f}), Vector3f({0.0f, 0.5f, 0.0f}), Vector3f({0.0f, 1.0f, 0.0f})).inverseMatrix();
+	data->projInverse = getPerspectiveMatrix(1.0f, 1.0f, 0.1f, 100.0f).inverseMatrix();
+	data->legacyViewInverse = toLegacy(data->viewInverse);
+	data->legacyProjInverse = toLegacy(data->projInverse);
+
+	for (size_t i = 0; i < KERNEL_DATA_SIZE; ++i) {
+		Vector3f v0 = randomVector(rng, 1.0f);
+		data->triangles.push_back(Triangle(v0, v0 + randomVector(rng, 0.5f), v0 + randomVector(rng, 0.5f)));
+
+		const Triangle& triangle = data->triangles.back();
+		AABB box(triangle.v0);
+		box.addPoint(triangle.v0 + triangle.edge0);
+		box.addPoint(triangle.v0 + triangle.edge1);
+		data->boxes.push_back(box);
+
+		data->rays.push_back(createRayAt(rng, triangle));
+	}
+
+	std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+	std::vector<float> weights;
+	for (size_t i = 0; i < KERNEL_DATA_SIZE; ++i) {
+		weights.push_back(data->triangles[i].edge0.magnitude());
+		data->uniforms.push_back(unit(rng));
+	}
+	data->aliasTable.init(weights);
+
+	for (size_t i = 0; i < KERNEL_DATA_SIZE; i += SIMD_WIDTH) {
+		TriangleBlock block;
+		for (size_t lane = 0; lane < SIMD_WIDTH; ++lane) block.setTriangle(lane, data->triangles[i + lane], uint32_t(i + lane));
+		data->blocks.push_back(block);
+	}
+
+	// every packet aims at one triangle, like the coherent camera rays of a tile
+	for (size_t i = 0; i < KERNEL_DATA_SIZE / RAY_PACKET_SIZE; ++i) {
+		RayPacket packet;
+		packet.clear();
+		for (size_t lane = 0; lane < RAY_PACKET_SIZE; ++lane) packet.setRay(lane, createRayAt(rng, data->triangles[i]));
+		data->packets.push_back(packet);
+	}
+
+	return data;
+}
+
+void addKernelBenchmarks(KernelBench& bench) {
+	// shared by all kernels and never freed, the benchmarks run until the process exits
+	static KernelData* data = createKernelData();
+
+	bench.add("vector3f_multiply_add", KERNEL_DATA_SIZE, []() {
+		uint64_t checksum = 0;
+		for (size_t i = 0; i < KERNEL_DATA_SIZE; ++i) {
+			Vector3f result = 0.5f * data->a[i] + data->b[i] * data->c[i];
+			checksum = KernelBench::hash(checksum, result[0] + result[1] + result[2]);
+		}
+		return checksum;
+	});
+
+	bench.add("vector3f_cross_dot", KERNEL_DATA_SIZE, []() {
+		uint64_t checksum = 0;
+		for (size_t i = 0; i < KERNEL_DATA_SIZE; ++i) {
+			checksum = KernelBench::hash(checksum, cross(data->a[i], data->b[i]).dot(data->c[i]));
+		}
+		return checksum;
+	});
+
+	bench.add("vector3f_normalize", KERNEL_DATA_SIZE, []() {
+		uint64_t checksum = 0;
+		for (size_t i = 0; i < KERNEL_DATA_SIZE; ++i) {
+			Vector3f result = data->a[i];
+			result.normalize();
+			checksum = KernelBench::hash(checksum, result[0] + result[1] + result[2]);
+		}
+		return checksum;
+	});
+
+	bench.add("matrix4f_vector_multiply", KERNEL_DATA_SIZE, []() {
+		uint64_t checksum = 0;
+		for (size_t i = 0; i < KERNEL_DATA_SIZE; ++i) {
+			Vector4f result = data->matrices[i % KERNEL_MATRIX_COUNT] * data->v[i];
+			checksum = KernelBench::hash(checksum, result[0] + result[1] + result[2] + result[3]);
+		}
+		return checksum;
+	});
+
+	bench.add("matrix4f_vector_multiply_legacy", KERNEL_DATA_SIZE, []() {
+		uint64_t checksum = 0;
+		for (size_t i = 0; i < KERNEL_DATA_SIZE; ++i) {
+			legacy::Vector4f result = data->legacyMatrices[i % KERNEL_MATRIX_COUNT] * data->legacyV[i];
+			checksum = KernelBench::hash(checksum, result[0] + result[1] + result[2] + result[3]);
+		}
+		return checksum;
+	});
+
+	bench.add("matrix4f_multiply", KERNEL_MATRIX_COUNT, []() {
+		uint64_t checksum = 0;
+		for (size_t i = 0; i < KERNEL_MATRIX_COUNT; ++i) {
+			Matrix4f result = data->matrices[i] * data->matrices[(i + 1) % KERNEL_MATRIX_COUNT];
+			checksum = KernelBench::hash(checksum, result[0][0] + result[1][1] + result[2][2] + result[3][3]);
+		}
+		return checksum;
+	});
+
+	bench.add("matrix4f_inverse", KERNEL_MATRIX_COUNT, []() {
+		uint64_t checksum = 0;
+		for (size_t i = 0; i < KERNEL_MATRIX_COUNT; ++i) {
+			Matrix4f matrix = data->matrices[i];
+			Matrix4f result = matrix.inverseMatrix();
+			checksum = KernelBench::hash(checksum, result[0][0] + result[1][1] + result[2][2] + result[3][3]);
+		}
+		return checksum;
+	});
+
+	bench.add("matrix4f_inverse_legacy", KERNEL_MATRIX_COUNT, []() {
+		uint64_t checksum = 0;
+		for (size_t i = 0; i < KERNEL_MATRIX_COUNT; ++i) {
+			legacy::Matrix4f matrix = data->legacyMatrices[i];
+			legacy::Matrix4f result = matrix.inverseMatrix();
+			checksum = KernelBench::hash(checksum, result[0][0] + result[1][1] + result[2][2] + result[3][3]);
+		}
+		return checksum;
+	});
+
+	// the _legacy variants must report the same checksum
+	bench.add("camera_ray_setup", KERNEL_DATA_SIZE, []() {
+		uint64_t checksum = 0;
+		for (size_t i = 0; i < KERNEL_DATA_SIZE; ++i) {
+			Vector3f direction = getCameraRayDirection<Vector2f, Vector3f, Vector4f>(data->viewInverse, data->projInverse, i);
+			checksum = KernelBench::hash(checksum, direction[0] + direction[1] + direction[2]);
+		}
+		return checksum;
+	});
+
+	bench.add("camera_ray_setup_legacy", KERNEL_DATA_SIZE, []() {
+		uint64_t checksum = 0;
+		for (size_t i = 0; i < KERNEL_DATA_SIZE; ++i) {
+			legacy::Vector3f direction = getCameraRayDirection<legacy::Vector2f, legacy::Vector3f, legacy::Vector4f>(data->legacyViewInverse, data->legacyProjInverse, i);
+			checksum = KernelBench::hash(checksum, direction[0] + direction[1] + direction[2]);
+		}
+		return checksum;
+	});
+
+	bench.add("triangle_ray_intersect", KERNEL_DATA_SIZE, []() {
+		uint64_t checksum = 0;
+		for (size_t i = 0; i < KERNEL_DATA_SIZE; ++i) {
+			float t = 0.0f;
+			bool hit = data->triangles[i].rayIntersects(data->rays[i], t);
+			checksum = KernelBench::hash(checksum, hit ? t : -1.0f);
+		}
+		return checksum;
+	});
+
+	// one item is one ray tested against the SIMD_WIDTH triangles of a block
+	bench.add("triangle_block_ray_intersect", KERNEL_DATA_SIZE, []() {
+		uint64_t checksum = 0;
+		for (size_t i = 0; i < KERNEL_DATA_SIZE; ++i) {
+			float t = 0.0f;
+			int lane = data->blocks[i / SIMD_WIDTH].rayIntersects(data->rays[i], INFINITY, t);
+			checksum = KernelBench::hash(checksum, lane >= 0 ? t : float(lane));
+		}
+		return checksum;
+	});
+
+	// one item is one triangle tested against the RAY_PACKET_SIZE rays of a packet
+	bench.add("triangle_packet_intersect", KERNEL_DATA_SIZE / RAY_PACKET_SIZE, []() {
+		uint64_t checksum = 0;
+		alignas(SIMD_ALIGNMENT) float t[RAY_PACKET_SIZE];
+		for (size_t i = 0; i < KERNEL_DATA_SIZE / RAY_PACKET_SIZE; ++i) {
+			uint32_t hitMask = data->triangles[i].rayIntersects(data->packets[i], RAY_PACKET_FULL_MASK, t);
+			checksum = KernelBench::hash(checksum, uint64_t(hitMask));
+		}
+		return checksum;
+	});
+
+	bench.add("aabb_ray_intersect", KERNEL_DATA_SIZE, []() {
+		uint64_t checksum = 0;
+		for (size_t i = 0; i < KERNEL_DATA_SIZE; ++i) {
+			checksum = KernelBench::hash(checksum, uint64_t(data->boxes[i].doesRayIntersect(data->rays[i])));
+		}
+		return checksum;
+	});
+
+	bench.add("alias_table_sample", KERNEL_DATA_SIZE, []() {
+		uint64_t checksum = 0;
+		for (size_t i = 0; i < KERNEL_DATA_SIZE; ++i) {
+			checksum = KernelBench::hash(checksum, uint64_t(data->aliasTable.sample(data->uniforms[i])));
+		}
+		return checksum;
+	});
+
+	bench.add("random_normal_direction", KERNEL_DATA_SIZE, []() {
+		// reseeded every pass so every pass draws the same directions
+		RandomGenerator rng(KERNEL_SEED, 0);
+		uint64_t checksum = 0;
+		for (size_t i = 0; i < KERNEL_DATA_SIZE; ++i) {
+			Vector3f direction = rng.randomNormalDirection(data->a[i]);
+			checksum = KernelBench::hash(checksum, direction[0] + direction[1] + direction[2]);
+		}
+		return checksum;
+	});
+}
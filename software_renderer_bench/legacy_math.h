@@ -0,0 +1,723 @@
+#pragma once
+
+#include <cmath>
+#include <algorithm>
+#include <vector>
+#include <iostream>
+#include <type_traits>
+
+// The Vector and Matrix templates as they were before the compile time unrolled versions in
+// software_renderer/math, kept so the ray setup benchmarks can compare both.
+
+namespace legacy {
+
+template <size_t s, typename T>
+class Vector {
+	public:
+		// Vector itself
+		T v[s];
+
+		// Constructors
+
+		Vector() : v{0} {}
+		Vector(const T* vec) : v{0} {
+			for (size_t i = 0; i < s; ++i) {
+				this->v[i] = vec[i];
+			}
+		}
+		Vector(const std::vector<T>& vec) : v{0} {
+			for (size_t i = 0; i < s && i < vec.size(); ++i) {
+				this->v[i] = vec[i];
+			}
+		}
+
+		Vector(const Vector& other) {
+			for (size_t i = 0; i < s; ++i) {
+				this->v[i] = other.v[i];
+			}
+		}
+
+		Vector& operator=(const Vector& other) {
+			for (size_t i = 0; i < s; ++i) {
+				this->v[i] = other.v[i];
+			}
+			return *this;
+		}
+
+		// Access Operators
+
+		T& operator[](const size_t i) {
+			return v[i];
+		}
+
+		const T& operator[](const size_t i) const {
+			return v[i];
+		}
+
+		size_t size() const {
+			return s;
+		}
+
+		// Math Operators with Scalar
+
+		template<typename S>
+		Vector operator+(const S scalar) const {
+			Vector ret(*this);
+			for (size_t i = 0; i < s; ++i) {
+				ret.v[i] += scalar;
+			}
+			return ret;
+		}
+
+		template<typename S>
+		Vector operator-(const S scalar) const {
+			Vector ret(*this);
+			for (size_t i = 0; i < s; ++i) {
+				ret.v[i] -= scalar;
+			}
+			return ret;
+		}
+
+		template<typename S>
+		Vector operator*(const S scalar) const {
+			Vector ret(*this);
+			for (size_t i = 0; i < s; ++i) {
+				ret.v[i] *= scalar;
+			}
+			return ret;
+		}
+
+		template<typename S>
+		Vector operator/(const S scalar) const {
+			Vector ret(*this);
+			for (size_t i = 0; i < s; ++i) {
+				ret.v[i] /= scalar;
+			}
+			return ret;
+		}
+
+		template<typename S>
+		Vector& operator+=(const S scalar) {
+			for (size_t i = 0; i < s; ++i) {
+				this->v[i] += scalar;
+			}
+			return *this;
+		}
+
+		template<typename S>
+		Vector& operator-=(const S scalar) {
+			for (size_t i = 0; i < s; ++i) {
+				this->v[i] -= scalar;
+			}
+			return *this;
+		}
+
+		template<typename S>
+		Vector& operator*=(const S scalar) {
+			for (size_t i = 0; i < s; ++i) {
+				this->v[i] *= scalar;
+			}
+			return *this;
+		}
+
+		template<typename S>
+		Vector& operator/=(const S scalar) {
+			for (size_t i = 0; i < s; ++i) {
+				this->v[i] /= scalar;
+			}
+			return *this;
+		}
+
+		// Math Operators with Vector
+
+		Vector operator+(const Vector& other) const {
+			Vector ret(*this);
+			for (size_t i = 0; i < s; ++i) {
+				ret.v[i] += other.v[i];
+			}
+			return ret;
+		}
+
+		Vector operator-(const Vector& other) const {
+			Vector ret(*this);
+			for (size_t i = 0; i < s; ++i) {
+				ret.v[i] -= other.v[i];
+			}
+			return ret;
+		}
+
+		Vector operator*(const Vector& other) const {
+			Vector ret(*this);
+			for (size_t i = 0; i < s; ++i) {
+				ret.v[i] *= other.v[i];
+			}
+			return ret;
+		}
+
+		Vector operator/(const Vector& other) const {
+			Vector ret(*this);
+			for (size_t i = 0; i < s; ++i) {
+				ret.v[i] /= other.v[i];
+			}
+			return ret;
+		}
+
+		Vector& operator+=(const Vector& other) {
+			for (size_t i = 0; i < s; ++i) {
+				this->v[i] += other.v[i];
+			}
+			return *this;
+		}
+
+		Vector& operator-=(const Vector& other) {
+			for (size_t i = 0; i < s; ++i) {
+				this->v[i] -= other.v[i];
+			}
+			return *this;
+		}
+
+		Vector& operator*=(const Vector& other) {
+			for (size_t i = 0; i < s; ++i) {
+				this->v[i] *= other.v[i];
+			}
+			return *this;
+		}
+
+		Vector& operator/=(const Vector& other) {
+			for (size_t i = 0; i < s; ++i) {
+				this->v[i] /= other.v[i];
+			}
+			return *this;
+		}
+
+		// Compare operatores
+
+		bool operator==(const Vector& other) const {
+			bool equal = true;
+
+			for (size_t i = 0; i < s; ++i) {
+				equal = equal && (this->v[i] == other.v[i]);
+			}
+
+			return equal;
+		}
+
+		// additional math operators
+
+		T magnitudeSquared() const {
+			T sum = 0;
+			for (size_t i = 0; i < s; ++i) {
+				sum += this->v[i] * this->v[i];
+			}
+			return sum;
+		}
+
+		double magnitude() const {
+			return std::sqrt((double) magnitudeSquared());
+		}
+
+		Vector& normalize() {
+			double magnitude = this->magnitude();
+
+			if (magnitude != 0) {
+				double factor = 1.0 / magnitude;
+				for (size_t i = 0; i < s; ++i) {
+					this->v[i] *= factor;
+				}
+			}
+
+			return *this;
+		}
+
+		T distanceSquared(const Vector& other) const {
+			return (*this - other).magnitudeSquared();
+		}
+
+		double distance(const Vector& other) const {
+			return (*this - other).magnitude();
+		}
+
+		T dot(const Vector& other) const {
+			T sum = 0;
+			for (size_t i = 0; i < s; ++i) {
+				sum += this->v[i] * other.v[i];
+			}
+			return sum;
+		}
+
+		double angle(const Vector& other) const {
+			return acos( std::clamp(double(this->dot(other)) / (this->magnitude() * other.magnitude()), -1.0, 1.0) );
+		}
+};
+
+// Math Operators with Scalar
+
+template<size_t s, typename T, typename S>
+Vector<s, T> operator+(const S scalar, const Vector<s, T>& vector) {
+	Vector<s, T> ret;
+	for (size_t i = 0; i < s; ++i) {
+		ret.v[i] = scalar + vector.v[i];
+	}
+	return ret;
+}
+
+template<size_t s, typename T, typename S>
+Vector<s, T> operator-(const S scalar, const Vector<s, T>& vector) {
+	Vector<s, T> ret;
+	for (size_t i = 0; i < s; ++i) {
+		ret.v[i] = scalar - vector.v[i];
+	}
+	return ret;
+}
+
+template<size_t s, typename T, typename S>
+Vector<s, T> operator*(const S scalar, const Vector<s, T>& vector) {
+	Vector<s, T> ret;
+	for (size_t i = 0; i < s; ++i) {
+		ret.v[i] = scalar * vector.v[i];
+	}
+	return ret;
+}
+
+template<size_t s, typename T, typename S>
+Vector<s, T> operator/(const S scalar, const Vector<s, T>& vector) {
+	Vector<s, T> ret;
+	for (size_t i = 0; i < s; ++i) {
+		ret.v[i] = scalar / vector.v[i];
+	}
+	return ret;
+}
+
+// Cross Product
+
+template<typename T>
+Vector<3, T> cross(const Vector<3, T>& a, const Vector<3, T>& b) {
+	Vector<3, T> ret;
+
+	ret[0] = a[1] * b[2] - a[2] * b[1];
+	ret[1] = a[2] * b[0] - a[0] * b[2];
+	ret[2] = a[0] * b[1] - a[1] * b[0];
+
+	return ret;
+}
+
+// lerp
+
+template<typename T>
+T lerp(T v0, T v1, float t) {
+	return (1.0f - t) * v0 + t * v1;
+}
+
+template<size_t s, typename T>
+Vector<s, T> lerp(const Vector<s, T>& v0, const Vector<s, T>& v1, float t) {
+	Vector<s, T> res;
+
+	for (size_t i = 0; i < s; ++i) {
+		res[i] = lerp(v0[i], v1[i], t);
+	}
+
+	return res;
+}
+
+// reflect, refract
+
+template<size_t s, typename T>
+Vector<s, T> reflect(const Vector<s, T>& I, const Vector<s, T>& N) {
+	return I - ((2.0 * N.dot(I)) * N);
+}
+
+template<size_t s, typename T>
+Vector<s, T> refract(const Vector<s, T>& I, const Vector<s, T>& N, T eta) {
+	// float NdI = N.dot(I);
+	float k = 1.0 - eta * eta * (1.0 - N.dot(I) * N.dot(I));
+	if (k < 0.0) return Vector<s, T>();
+	else return eta * I - (eta * N.dot(I) + sqrt(k)) * N;
+}
+
+template<size_t s, typename T>
+Vector<s, T> customRefract(const Vector<s, T>& I, Vector<s, T> N, T eta) {
+	if (N.dot(I) > 0.0) {
+		N = -1.0 * N;
+	} else {
+		eta = 1.0 / eta;
+	}
+
+	float angle = sin(acos(N.dot(I))) * eta;
+	if (-1.0 < angle && angle < 1.0)
+		return refract(I, N, eta);
+	else
+		return reflect(I, N);
+}
+
+// Triangle Area
+
+template<typename T>
+float getTriangleArea(const Vector<3, T>& v1, const Vector<3, T>& v2, const Vector<3, T>& v3) {
+	Vector<3, T> ab = v2 - v1;
+	Vector<3, T> ac = v3 - v1;
+	Vector<3, T> cp = cross(ab, ac);
+	return 0.5f * cp.magnitude();
+}
+
+// Comverts
+
+template<typename T>
+Vector<4, T> expandVector(const Vector<3, T>& vec, T v) {
+	return Vector<4, T>({vec[0], vec[1], vec[2], v});
+}
+
+template<typename T>
+Vector<3, T> cutVector(const Vector<4, T>& vec) {
+	return Vector<3, T>({vec[0], vec[1], vec[2]});
+}
+
+// Compares
+
+template<size_t s, typename T, typename S>
+bool operator<(const Vector<s, T>& a, const Vector<s, S>& b) {
+	for (size_t i = 0; i < s; ++i) {
+		if (a[i] != b[i]) return a[i] < b[i];
+	}
+	return false;
+}
+
+// ostream
+
+template<size_t s, typename T>
+std::ostream& operator<<(std::ostream& out, const Vector<s, T>& v) {
+	out << "v" << s << "(";
+
+	for (size_t i = 0; i < s; ++i) {
+		if (i > 0) out << ";";
+		out << v[i];
+	}
+
+	out << ")";
+
+	return out;
+}
+
+// Typedefs
+
+template <typename T>
+using Vector2 = Vector<2, T>;
+typedef Vector2<int32_t> Vector2i;
+typedef Vector2<uint32_t> Vector2u;
+typedef Vector2<float> Vector2f;
+typedef Vector2<double> Vector2d;
+
+template <typename T>
+using Vector3 = Vector<3, T>;
+typedef Vector3<int32_t> Vector3i;
+typedef Vector3<uint32_t> Vector3u;
+typedef Vector3<float> Vector3f;
+typedef Vector3<double> Vector3d;
+
+template <typename T>
+using Vector4 = Vector<4, T>;
+typedef Vector4<int32_t> Vector4i;
+typedef Vector4<uint32_t> Vector4u;
+typedef Vector4<float> Vector4f;
+typedef Vector4<double> Vector4d;
+
+template <size_t s, typename T>
+class Matrix {
+	public:
+		// Class Definitions
+
+		class Row {
+			public:
+				Matrix& mat;
+				const size_t i;
+
+				Row(Matrix& mat, const size_t i): mat(mat), i(i) {}
+				T& operator[](const size_t j) {
+					return mat.m[i][j];
+				}
+		};
+
+		class Const_Row {
+			public:
+				const Matrix& mat;
+				const size_t i;
+
+				Const_Row(const Matrix& mat, const size_t i): mat(mat), i(i) {}
+				const T& operator[](const size_t j) const {
+					return mat.m[i][j];
+				}
+		};
+
+		// Matrix itself
+		T m[s][s];
+
+		// Constructors
+
+		Matrix(): m{0} {
+			for (size_t i = 0; i < s; ++i) {
+				m[i][i] = 1.0f;
+			}
+		}
+
+		Matrix(const Matrix& other) {
+			for (size_t i = 0; i < s; ++i) {
+				for (size_t j = 0; j < s; ++j) {
+					this->m[i][j] = other.m[i][j];
+				}
+			}
+		}
+
+		Matrix& operator=(const Matrix& other) {
+			for (size_t i = 0; i < s; ++i) {
+				for (size_t j = 0; j < s; ++j) {
+					this->m[i][j] = other.m[i][j];
+				}
+			}
+			return *this;
+		}
+
+		// Access Operators
+
+		Row operator[](const size_t i) {
+			return Row(*this, i);
+		}
+
+		Const_Row operator[](const size_t i) const {
+			return Const_Row(*this, i);
+		}
+
+		size_t size() const {
+			return s;
+		}
+
+		// Math Operators
+
+		Matrix operator+(const Matrix& other) const {
+			Matrix ret(*this);
+			for (size_t i = 0; i < s; ++i) {
+				for (size_t j = 0; j < s; ++j) {
+					ret.m[i][j] += other.m[i][j];
+				}
+			}
+			return ret;
+		}
+
+		Matrix operator-(const Matrix& other) const {
+			Matrix ret(*this);
+			for (size_t i = 0; i < s; ++i) {
+				for (size_t j = 0; j < s; ++j) {
+					ret.m[i][j] -= other.m[i][j];
+				}
+			}
+			return ret;
+		}
+
+		Matrix& operator+=(const Matrix& other) {
+			for (size_t i = 0; i < s; ++i) {
+				for (size_t j = 0; j < s; ++j) {
+					this->m[i][j] += other.m[i][j];
+				}
+			}
+			return *this;
+		}
+
+		Matrix& operator-=(const Matrix& other) {
+			for (size_t i = 0; i < s; ++i) {
+				for (size_t j = 0; j < s; ++j) {
+					this->m[i][j] -= other.m[i][j];
+				}
+			}
+			return *this;
+		}
+
+		template<typename S>
+		Matrix& operator*=(const S scalar) {
+			for (size_t i = 0; i < s; ++i) {
+				for (size_t j = 0; j < s; ++j) {
+					this->m[i][j] *= scalar;
+				}
+			}
+			return *this;
+		}
+
+		template<size_t size = s>
+		typename std::enable_if<(size > 2), Matrix<size-1, T>>::type
+		subMatrix(size_t ri, size_t rj) const {
+			Matrix<size-1, T> sub_mat;
+
+			size_t i_sub = 1;
+			for (size_t i = 1; i < size; ++i) {
+				if ((i - 1) == ri) i_sub = 0;
+
+				size_t j_sub = 1;
+				for (size_t j = 1; j < size; ++j) {
+					if ((j - 1) == rj) j_sub = 0;
+					sub_mat[i-1][j-1] = m[i - i_sub][j - j_sub];
+				}
+			}
+
+			return sub_mat;
+		}
+
+		Matrix& transpose() {
+			for (size_t i = 1; i < s; ++i) {
+				for (size_t j = 0; j < i; ++j) {
+					T tmp = m[i][j];
+					m[i][j] = m[j][i];
+					m[j][i] = tmp;
+				}
+			}
+			return *this;
+		}
+
+		template<size_t size = s>
+		typename std::enable_if<(size == 2), Matrix>::type
+		cofactorMatrix() {
+			Matrix ret;
+
+			T a11 = m[0][0];
+			T a12 = m[0][1];
+			T a21 = m[1][0];
+			T a22 = m[1][1];
+
+			ret[0][0] =  a22;
+			ret[0][1] = -a12;
+			ret[1][0] = -a21;
+			ret[1][1] =  a11;
+
+			return ret;
+		}
+
+		template<size_t size = s>
+		typename std::enable_if<(size > 2), Matrix>::type
+		cofactorMatrix() const {
+			Matrix cof;
+
+			for (size_t i = 0; i < s; ++i) {
+				for (size_t j = 0; j < s; ++j) {
+					cof[i][j] = subMatrix(j, i).det();
+					if ((i + j) % 2 == 1) cof[i][j] *= -1;
+				}
+			}
+
+			return cof;
+		}
+
+		template<size_t size = s>
+		typename std::enable_if<(size == 2), T>::type
+		det() const {
+			return m[0][0] * m[1][1] - m[0][1] * m[1][0];
+		}
+
+		template<size_t size = s>
+		typename std::enable_if<(size > 2), T>::type
+		det() const {
+			T det = 0;
+
+			for (size_t i = 0; i < s; ++i) {
+				Matrix<s-1, T> sub_mat = subMatrix(0, i);
+
+				if (i%2 == 0) det += m[0][i] * sub_mat.det();
+				else          det -= m[0][i] * sub_mat.det();
+			}
+
+			return det;
+		}
+
+		Matrix inverseMatrix() {
+			return (T(1.0) / this->det()) * this->cofactorMatrix();
+		}
+
+		Matrix operator*(const Matrix& other) const {
+			Matrix ret;
+			for (size_t i = 0; i < s; ++i) {
+				ret.m[i][i] = 0.0f;
+				for (size_t j = 0; j < s; ++j) {
+					for (size_t n = 0; n < s; ++n) {
+						ret.m[i][j] += this->m[i][n] * other.m[n][j];
+					}
+				}
+			}
+			return ret;
+		}
+
+		Matrix& operator*=(const Matrix& other) {
+			Matrix ret;
+			for (size_t i = 0; i < s; ++i) {
+				ret.m[i][i] = 0.0f;
+				for (size_t j = 0; j < s; ++j) {
+					for (size_t n = 0; n < s; ++n) {
+						ret.m[i][j] += this->m[i][n] * other.m[n][j];
+					}
+				}
+			}
+			*this = ret;
+			return *this;
+		}
+
+		// Vector matrix muliplication
+
+		Vector<s, T> operator*(const Vector<s, T>& vector) const {
+			Vector<s, T> ret;
+			for (size_t i = 0; i < s; ++i) {
+				for (size_t j = 0; j < s; ++j) {
+					ret[j] += this->m[i][j] * vector[i];
+				}
+			}
+			return ret;
+		}
+};
+
+// Special functions
+
+template<size_t s, typename T, typename S>
+Matrix<s, T> operator*(const S scalar, const Matrix<s, T>& matrix) {
+	Matrix<s, T> ret(matrix);
+	for (size_t i = 0; i < s; ++i) {
+		for (size_t j = 0; j < s; ++j) {
+			ret.m[i][j] *= scalar;
+		}
+	}
+	return ret;
+}
+
+// ostream
+
+template<size_t s, typename T>
+std::ostream& operator<<(std::ostream& out, const Matrix<s, T>& m) {
+	out << "m" << s << "(\n";
+
+	for (size_t i = 0; i < s; ++i) {
+		out << "\t";
+		for (size_t j = 0; j < s; ++j) {
+			if (j > 0) out << " ";
+			out << m.m[i][j];
+		}
+		out << "\n";
+	}
+
+	out << ")";
+
+	return out;
+}
+
+// Typedefs
+
+template <typename T>
+using Matrix2 = Matrix<2, T>;
+typedef Matrix2<int> Matrix2i;
+typedef Matrix2<float> Matrix2f;
+typedef Matrix2<double> Matrix2d;
+
+template <typename T>
+using Matrix3 = Matrix<3, T>;
+typedef Matrix3<int> Matrix3i;
+typedef Matrix3<float> Matrix3f;
+typedef Matrix3<double> Matrix3d;
+
+template <typename T>
+using Matrix4 = Matrix<4, T>;
+typedef Matrix4<int> Matrix4i;
+typedef Matrix4<float> Matrix4f;
+typedef Matrix4<double> Matrix4d;
+
+}
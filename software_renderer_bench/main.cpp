@@ -0,0 +1,246 @@
+#include <iostream>
+#include <chrono>
+#include <random>
+#include <vector>
+#include <functional>
+#include <fstream>
+#include <filesystem>
+
+#include "../software_renderer/graphic/scene.h"
+#include "../software_renderer/graphic/graphics_object.h"
+
+#include "../software_renderer/init_exception.h"
+#include "../software_renderer/mesh_manager.h"
+#include "../software_renderer/stl_loader.h"
+
+#include "../software_renderer/math/vector.h"
+#include "../software_renderer/math/ray.h"
+
+#include "kernel_bench.h"
+
+#define SURFACE_DISTANCE_OFFSET 0.01f
+#define BENCH_SEED 42
+
+
+struct Segment {
+	Vector3f startPos;
+	Vector3f endPos;
+};
+
+int64_t measureExecTimeMicroseconds(std::function<void()> exec) {
+	auto start = std::chrono::high_resolution_clock::now();
+	exec();
+	auto stop = std::chrono::high_resolution_clock::now();
+
+	auto duration = std::chrono::duration_cast<std::chrono::microseconds>(stop - start);
+	return duration.count();
+}
+
+Vector3f randomDirection(std::mt19937& rng) {
+	std::uniform_real_distribution<float> distribution(-1.0f, 1.0f);
+
+	Vector3f direction;
+	do {
+		direction = Vector3f({distribution(rng), distribution(rng), distribution(rng)});
+	} while (direction.magnitudeSquared() > 1.0f || direction.magnitudeSquared() == 0.0f);
+
+	return direction.normalize();
+}
+
+// Connection segments between random surface points, like the ones
+// BidirectionalPathTracer builds between vision and light paths.
+std::vector<Segment> createSegments(const Scene& scene, const Vector3f& origin, size_t segmentCount) {
+	std::mt19937 rng(BENCH_SEED);
+
+	std::vector<Mesh::Vertex> surfacePoints;
+	surfacePoints.reserve(2 * segmentCount);
+	while (surfacePoints.size() < 2 * segmentCount) {
+		Mesh::Vertex hitVertex;
+		const GraphicsObject* obj;
+		if (scene.traceRay(Ray(origin, randomDirection(rng)), hitVertex, obj)) {
+			surfacePoints.push_back(hitVertex);
+		}
+	}
+
+	std::vector<Segment> segments(segmentCount);
+	for (size_t i = 0; i < segmentCount; ++i) {
+		const Mesh::Vertex& start = surfacePoints[2 * i + 0];
+		const Mesh::Vertex& end   = surfacePoints[2 * i + 1];
+		segments[i].startPos = start.pos + SURFACE_DISTANCE_OFFSET * start.normal;
+		segments[i].endPos   = end.pos   + SURFACE_DISTANCE_OFFSET * end.normal;
+	}
+
+	return segments;
+}
+
+// Occlusion through the closest hit query, the way isOccluded worked before the any hit traversal.
+static bool isOccludedClosestHit(const Scene& scene, const Segment& segment) {
+	Vector3f direction = segment.endPos - segment.startPos;
+	float dist2 = direction.magnitudeSquared();
+	direction.normalize();
+
+	Mesh::Vertex hitVertex;
+	const GraphicsObject* obj;
+	if (!scene.traceRay(Ray(segment.startPos, direction), hitVertex, obj)) return false;
+
+	return segment.startPos.distanceSquared(hitVertex.pos) <= dist2;
+}
+
+void benchOcclusion(const std::string& name, const std::vector<Segment>& segments, std::function<bool(const Segment&)> isOccluded) {
+	size_t occludedCount = 0;
+
+	int64_t time = measureExecTimeMicroseconds([&segments, &isOccluded, &occludedCount]() {
+		for (const Segment& segment: segments) {
+			if (isOccluded(segment)) ++occludedCount;
+		}
+	});
+
+	float seconds = float(time) / (1000.0f * 1000.0f);
+	float raysPerSecond = float(segments.size()) / seconds;
+
+	std::cout << name << ": " << segments.size() << " rays in " << seconds << " s, ";
+	std::cout << raysPerSecond / 1000000.0f << " Mrays/s, ";
+	std::cout << occludedCount << " occluded" << std::endl;
+}
+
+// Binary STL of a terraced height field: smooth slopes that share their vertices
+// and steep steps whose edges exceed the crease angle, two triangles per cell.
+void writeHeightFieldStl(const std::string& path, size_t triangleCount) {
+	size_t cells = std::max(size_t(1), size_t(std::sqrt(float(triangleCount / 2))));
+	auto getPos = [cells](size_t x, size_t y) {
+		float u = float(x) / float(cells);
+		float v = float(y) / float(cells);
+		float height = 0.05f * std::sin(8.0f * u) * std::cos(8.0f * v) + 0.1f * std::floor(4.0f * (u + v));
+		return Vector3f({u, v, height});
+	};
+
+	std::ofstream file(path, std::ios::out | std::ios::binary);
+	char header[80] = "SoftwareRendererBench height field";
+	uint32_t count = 2 * cells * cells;
+	file.write(header, 80);
+	file.write((const char*) &count, 4);
+
+	for (size_t y = 0; y < cells; ++y) {
+		for (size_t x = 0; x < cells; ++x) {
+			Vector3f quad[4] = {getPos(x, y), getPos(x + 1, y), getPos(x + 1, y + 1), getPos(x, y + 1)};
+			size_t corners[2][3] = {{0, 1, 2}, {0, 2, 3}};
+
+			for (size_t t = 0; t < 2; ++t) {
+				STLLoader::RawTriangle raw;
+				const Vector3f& v0 = quad[corners[t][0]];
+				Vector3f normal = cross(quad[corners[t][1]] - v0, quad[corners[t][2]] - v0).normalize();
+				for (size_t i = 0; i < 3; ++i) {
+					raw.normal[i] = normal[i];
+					for (size_t c = 0; c < 3; ++c) raw.vertex[c][i] = quad[corners[t][c]][i];
+				}
+				raw.attrib = 0;
+				file.write((const char*) &raw, sizeof(raw));
+			}
+		}
+	}
+}
+
+static void benchStl(size_t triangleCount) {
+	std::string path = (std::filesystem::temp_directory_path() / "software_renderer_bench.stl").string();
+	writeHeightFieldStl(path, triangleCount);
+
+	STLLoader loader("");
+	Mesh* mesh = nullptr;
+
+	// loadFile only maps the file, the pages are read in get_mesh, so only the sum is meaningful
+	int64_t loadTime = measureExecTimeMicroseconds([&loader, &path, &mesh]() {
+		loader.loadFile(path);
+		mesh = loader.get_mesh();
+	});
+
+	std::cout << "STL " << mesh->indices.size() / 3 << " triangles: ";
+	std::cout << "load and get_mesh " << float(loadTime) / 1000.0f << " ms, ";
+	std::cout << mesh->vertices.size() << " vertices" << std::endl;
+
+	delete mesh;
+	std::filesystem::remove(path);
+}
+
+static int benchKernels(int argc, char* argv[]) {
+	KernelBench bench;
+	std::string filter = ".*";
+	std::string jsonPath;
+
+	for (int i = 2; i < argc; ++i) {
+		std::string option = argv[i];
+		bool hasValue = i + 1 < argc;
+
+		if      (option == "--filter" && hasValue)      filter = argv[++i];
+		else if (option == "--min-time" && hasValue)    bench.minTime = std::stof(argv[++i]);
+		else if (option == "--repetitions" && hasValue) bench.repetitions = std::max(1, std::atoi(argv[++i]));
+		else if (option == "--json" && hasValue)        jsonPath = argv[++i];
+		else {
+			std::cout << "Error: unknown option \"" << option << "\"!" << std::endl;
+			return -1;
+		}
+	}
+
+	addKernelBenchmarks(bench);
+	bench.run(filter);
+	bench.printTable(std::cout);
+
+	if (!jsonPath.empty()) {
+		std::ofstream file(jsonPath);
+		if (!file.is_open()) {
+			std::cout << "Error: could not write \"" << jsonPath << "\"!" << std::endl;
+			return -1;
+		}
+		bench.writeJson(file);
+		std::cout << "Results written to " << jsonPath << std::endl;
+	}
+
+	return 0;
+}
+
+int main(int argc, char* argv[]) {
+	if (argc > 1 && std::string(argv[1]) == "--stl") {
+		benchStl(argc > 2 ? std::atoi(argv[2]) : 4000000);
+		return 0;
+	}
+	if (argc > 1 && std::string(argv[1]) == "--kernels") {
+		return benchKernels(argc, argv);
+	}
+
+	if (argc > 3) {
+		std::cout << "Error: wrong paramter count!" << std::endl;
+		std::cout << "Usage: SoftwareRendererBench [scene] [ray_count]" << std::endl;
+		std::cout << "       SoftwareRendererBench --stl [triangle_count]" << std::endl;
+		std::cout << "       SoftwareRendererBench --kernels [--filter regex] [--min-time seconds] [--repetitions number] [--json path]" << std::endl;
+		return -1;
+	}
+
+	const std::string execpath = argv[0];
+	const std::string basepath = execpath.substr(0, execpath.size() - sizeof("SoftwareRendererBench") + 1);
+
+	std::string scenePath = argc > 1 ? argv[1] : basepath + "../res/scene/cornell_box_with_blocks.scene";
+	size_t rayCount = argc > 2 ? std::atoi(argv[2]) : 1000000;
+
+	MeshManager* meshManager = new MeshManager(basepath);
+	meshManager->createObjectsFromFile(scenePath);
+
+	Scene scene;
+	for (GraphicsObject* obj: meshManager->getCreatedObjects()) {
+		obj->init();
+		scene.addObject(obj);
+	}
+	scene.init();
+
+	std::vector<Segment> segments = createSegments(scene, Vector3f({0.0f, 0.0f, 0.0f}), rayCount);
+
+	std::cout << "Connection rays in " << scenePath << std::endl;
+	benchOcclusion("closest hit", segments, [&scene](const Segment& segment) {
+		return isOccludedClosestHit(scene, segment);
+	});
+	benchOcclusion("any hit", segments, [&scene](const Segment& segment) {
+		return scene.isOccluded(segment.startPos, segment.endPos);
+	});
+
+	delete meshManager;
+
+	return 0;
+}
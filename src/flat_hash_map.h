@@ -0,0 +1,72 @@
+#pragma once
+
+#include <vector>
+#include <utility>
+#include <cstdint>
+#include <cstddef>
+
+
+// Open addressing hash map with linear probing over a single array. Entries
+// can only be added, which is all the mesh loaders need to weld vertices,
+// and it avoids the per node allocations of std::map and std::unordered_map.
+template<typename Key, typename Value, typename Hash>
+class FlatHashMap {
+	public:
+		FlatHashMap(size_t expectedSize=0)
+		:entries(), used(), entryCount(0), hash() {
+			reserve(expectedSize);
+		}
+
+		void reserve(size_t expectedSize) {
+			size_t capacity = 16;
+			while (capacity < 2 * expectedSize) capacity *= 2;
+			if (capacity > entries.size()) rehash(capacity);
+		}
+
+		// Returns the value stored for the key, or inserts value and returns it.
+		Value insert(const Key& key, const Value& value, bool& inserted) {
+			if (2 * (entryCount + 1) > entries.size()) rehash(2 * entries.size());
+
+			size_t mask = entries.size() - 1;
+			for (size_t i = hash(key) & mask;; i = (i + 1) & mask) {
+				if (!used[i]) {
+					entries[i] = {key, value};
+					used[i] = true;
+					++entryCount;
+					inserted = true;
+					return value;
+				}
+				if (entries[i].first == key) {
+					inserted = false;
+					return entries[i].second;
+				}
+			}
+		}
+
+		size_t size() const {
+			return entryCount;
+		}
+
+	private:
+		void rehash(size_t capacity) {
+			std::vector<std::pair<Key, Value>> oldEntries(capacity);
+			std::vector<uint8_t> oldUsed(capacity, 0);
+			oldEntries.swap(entries);
+			oldUsed.swap(used);
+
+			size_t mask = capacity - 1;
+			for (size_t j = 0; j < oldEntries.size(); ++j) {
+				if (!oldUsed[j]) continue;
+
+				size_t i = hash(oldEntries[j].first) & mask;
+				while (used[i]) i = (i + 1) & mask;
+				entries[i] = oldEntries[j];
+				used[i] = true;
+			}
+		}
+
+		std::vector<std::pair<Key, Value>> entries;
+		std::vector<uint8_t> used;
+		size_t entryCount;
+		Hash hash;
+};
@@ -1,28 +1,78 @@
 #include "input_parser.h"
 
+#include <cstring>
+#include <charconv>
+#include <algorithm>
+
+#include "mapped_file.h"
+
+
+static bool isBlank(char c) {
+	return c == ' ' || c == '\t' || c == '\r';
+}
+
+static const char* skipBlanks(const char* p, const char* end) {
+	while (p < end && isBlank(*p)) ++p;
+	return p;
+}
+
+static const char* trimBlanks(const char* begin, const char* end) {
+	while (end > begin && isBlank(end[-1])) --end;
+	return end;
+}
+
+InputEntry::Value parseValue(const char* begin, const char* end) {
+	begin = skipBlanks(begin, end);
+	end = trimBlanks(begin, end);
+
+	InputEntry::Value value;
+	value.text = std::string(begin, end);
+
+	const char* number = (begin < end && *begin == '+') ? begin + 1 : begin;
+	std::from_chars_result result = std::from_chars(number, end, value.number);
+	value.isNumber = number < end && result.ec == std::errc() && result.ptr == end;
+	value.floatNumber = 0.0f;
+	if (value.isNumber) std::from_chars(number, end, value.floatNumber);
+
+	return value;
+}
+
+
 ////////////////
 // InputEntry //
 ////////////////
 
-InputEntry::InputEntry(const std::string& name)
-:name(name), data() {}
+InputEntry::InputEntry(const std::string& name, std::shared_ptr<const std::string> path, unsigned int line)
+:name(name), line(line), path(path), data() {}
 
 InputEntry::~InputEntry() {}
 
-void InputEntry::insert(const RawInputEntry& rawInputEntry) {
-	data.insert(rawInputEntry);
+void InputEntry::insert(std::string&& key, Parameter&& parameter) {
+	data.emplace(std::move(key), std::move(parameter));
 }
 
 bool InputEntry::keyExists(const std::string& key) const {
 	return data.count(key) > 0;
 }
 
+size_t InputEntry::getValueCount(const std::string& key) const {
+	return getParameter(key).values.size();
+}
+
 Rotation InputEntry::getRotation(const std::string& key) const {
-	return Rotation(Vector3f({
-		std::stof(data.at(key).at(0)),
-		std::stof(data.at(key).at(1)),
-		std::stof(data.at(key).at(2))
-	}), std::stof(data.at(key).at(3)));
+	Vector<4, float> rotation = getVector<4, float>(key);
+	return Rotation(Vector3f({rotation[0], rotation[1], rotation[2]}), rotation[3]);
+}
+
+const InputEntry::Parameter& InputEntry::getParameter(const std::string& key) const {
+	auto it = data.find(key);
+	if (it == data.end()) fail(line, key, "is missing");
+	return it->second;
+}
+
+void InputEntry::fail(unsigned int line, const std::string& key, const std::string& message) const {
+	std::string location = path != nullptr ? *path + ":" + std::to_string(line) + ": " : "";
+	throw InitException("InputEntry", location + "key \"" + key + "\" of \"" + name + "\" " + message + "!");
 }
 
 
@@ -36,60 +86,66 @@ InputParser::InputParser(const std::string& path)
 InputParser::~InputParser() {}
 
 void InputParser::parse() {
-	std::ifstream istream(path);
-
-	if (istream.fail())	throw InitException("InputParser", std::string("failed to open file \"") + path + "\"!");
-
-	InputEntry currentInputEntry("");
-
-	while(istream.good()) {
-		char c = istream.get();
-		if (c == '\n') {
-			continue;
-		} else if (c == '#') {
-			std::string tmp;
-			getline(istream, tmp);
-		} else if (c == '\t') {
-			RawInputEntry rawInputEntry = parseInputEntry(istream);
-			currentInputEntry.insert(rawInputEntry);
-		} else if (c != ' ') {
-			istream.unget();
-			if (currentInputEntry.name != "") inputEntries.push_back(currentInputEntry);
-
-			std::string inputEntryName;
-			std::getline(istream, inputEntryName);
-			currentInputEntry = InputEntry(inputEntryName);
+	MappedFile file;
+	if (!file.open(path)) throw InitException("InputParser", std::string("failed to open file \"") + path + "\"!");
+
+	std::shared_ptr<const std::string> sharedPath = std::make_shared<const std::string>(path);
+	const char* p = file.data();
+	const char* end = p + file.size();
+	unsigned int line = 0;
+
+	while (p < end) {
+		++line;
+		const char* lineEnd = static_cast<const char*>(std::memchr(p, '\n', end - p));
+		if (lineEnd == nullptr) lineEnd = end;
+
+		// leading spaces are ignored, a tab after them starts a key
+		const char* start = p;
+		while (start < lineEnd && *start == ' ') ++start;
+		const char* content = skipBlanks(start, lineEnd);
+
+		if (content == lineEnd || *content == '#') {
+			// empty line or comment
+		} else if (*start == '\t') {
+			if (inputEntries.empty()) fail(line, "key outside of an entry");
+			parseKey(content, lineEnd, line);
+		} else {
+			inputEntries.emplace_back(std::string(content, trimBlanks(content, lineEnd)), sharedPath, line);
 		}
+
+		p = lineEnd < end ? lineEnd + 1 : end;
 	}
+}
 
-	if (currentInputEntry.name != "") inputEntries.push_back(currentInputEntry);
+void InputParser::parseKey(const char* p, const char* end, unsigned int line) {
+	const char* open = static_cast<const char*>(std::memchr(p, '(', end - p));
+	if (open == nullptr) fail(line, "expected '(' after the key");
 
-	istream.close();
-}
+	const char* close = static_cast<const char*>(std::memchr(open, ')', end - open));
+	if (close == nullptr) fail(line, "expected ')' after the values");
 
-RawInputEntry InputParser::parseInputEntry(std::ifstream& istream) {
-	std::string name;
-	std::getline(istream, name, '(');
-
-	std::vector<std::string> values;
-	std::string current = "";
-	while(istream.good()) {
-		char c = istream.get();
-
-		if (c == ')') {
-			istream.get();
-			break;
-		} else if (c == ',') {
-			values.push_back(current);
-			current = "";
-		} else if (c != ' ') {
-			current += c;
-		}
+	const char* rest = skipBlanks(close + 1, end);
+	if (rest < end && *rest != '#') fail(line, "unexpected text after ')'");
+
+	std::string key(p, trimBlanks(p, open));
+	if (key.empty()) fail(line, "key without a name");
+
+	InputEntry::Parameter parameter;
+	parameter.line = line;
+	parameter.values.reserve(std::count(open, close, ',') + 1);
+	for (const char* value = open + 1; value <= close;) {
+		const char* valueEnd = static_cast<const char*>(std::memchr(value, ',', close - value));
+		if (valueEnd == nullptr) valueEnd = close;
+		parameter.values.push_back(parseValue(value, valueEnd));
+		value = valueEnd + 1;
 	}
 
-	values.push_back(current);
+	if (inputEntries.back().keyExists(key)) fail(line, std::string("duplicate key \"") + key + "\"");
+	inputEntries.back().insert(std::move(key), std::move(parameter));
+}
 
-	return {name, values};
+void InputParser::fail(unsigned int line, const std::string& message) const {
+	throw InitException("InputParser", path + ":" + std::to_string(line) + ": " + message + "!");
 }
 
 unsigned int InputParser::size() const {
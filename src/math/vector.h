@@ -5,6 +5,7 @@
 #include <algorithm>
 #include <vector>
 #include <iostream>
+#include <type_traits>
 
 template <size_t s, typename T>
 class Vector {
@@ -26,19 +27,6 @@ class Vector {
 			}
 		}
 
-		Vector(const Vector& other) {
-			for (size_t i = 0; i < s; ++i) {
-				this->v[i] = other.v[i];
-			}
-		}
-
-		Vector& operator=(const Vector& other) {
-			for (size_t i = 0; i < s; ++i) {
-				this->v[i] = other.v[i];
-			}
-			return *this;
-		}
-
 		// Access Operators
 
 		T& operator[](const size_t i) {
@@ -168,6 +156,9 @@ class Vector {
 		}
 };
 
+static_assert(std::is_trivially_copyable_v<Vector<3, float>>, "vectors are copied and stored as plain bytes");
+static_assert(std::is_trivially_copyable_v<Vector<4, float>>, "vectors are copied and stored as plain bytes");
+
 // Math Operators with Scalar
 
 template<size_t s, typename T, typename S>
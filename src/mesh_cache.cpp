@@ -0,0 +1,111 @@
+#include "mesh_cache.h"
+
+#include <cstring>
+#include <filesystem>
+#include <type_traits>
+
+#include "mapped_file.h"
+#include "binary_file.h"
+
+#define MESH_CACHE_PATH std::string("../res/mesh/")
+#define MESH_CACHE_SUFFIX std::string(".vk.mesh")
+#define MESH_CACHE_MAGIC 0x434d5452 // "RTMC"
+// has to be increased whenever the loaders or the stored layout change
+#define MESH_CACHE_VERSION 1
+
+static_assert(std::is_trivially_copyable_v<Mesh::Vertex>, "vertices are stored as plain bytes");
+
+// 64 bit multiply xor hash over four independent lanes, reads the source at memory speed
+static uint64_t hashData(const char* data, size_t size) {
+	const uint64_t prime = 0x9E3779B97F4A7C15ull;
+	uint64_t lanes[4] = {size, prime, ~size, ~prime};
+
+	size_t i = 0;
+	for (; i + 32 <= size; i += 32) {
+		for (size_t l = 0; l < 4; ++l) {
+			uint64_t word;
+			std::memcpy(&word, data + i + 8 * l, 8);
+			lanes[l] = (lanes[l] ^ word) * prime;
+			lanes[l] ^= lanes[l] >> 29;
+		}
+	}
+	for (; i < size; ++i) {
+		lanes[i % 4] = (lanes[i % 4] ^ uint8_t(data[i])) * prime;
+	}
+
+	uint64_t h = 0;
+	for (size_t l = 0; l < 4; ++l) {
+		h = (h ^ lanes[l]) * prime;
+		h ^= h >> 32;
+	}
+	return h;
+}
+
+
+MeshCache::MeshCache(const std::string& basepath)
+:basepath(basepath) {}
+
+MeshCache::~MeshCache() {}
+
+Mesh* MeshCache::load(const std::string& name, uint64_t sourceHash, const Device* device) const {
+	MappedFile file;
+	if (!file.open(getCachePath(name))) return nullptr;
+
+	BinaryReader reader(file.data(), file.size());
+	Header header = reader.read<Header>();
+	Header expected = getHeader(sourceHash);
+	if (!reader.isValid() || std::memcmp(&header, &expected, sizeof(Header)) != 0) return nullptr;
+
+	Mesh* mesh = new Mesh(device);
+	reader.readArray(mesh->vertices);
+	reader.readArray(mesh->indices);
+	if (!reader.isValid() || mesh->indices.size() % 3 != 0) {
+		delete mesh;
+		return nullptr;
+	}
+	for (uint32_t index: mesh->indices) {
+		if (index >= mesh->vertices.size()) {
+			delete mesh;
+			return nullptr;
+		}
+	}
+
+	mesh->init();
+
+	return mesh;
+}
+
+bool MeshCache::save(const std::string& name, uint64_t sourceHash, const Mesh& mesh) const {
+	std::string path = getCachePath(name);
+
+	// a read only res directory only costs the speedup
+	std::error_code error;
+	std::filesystem::create_directories(std::filesystem::path(path).parent_path(), error);
+	if (error) return false;
+
+	BinaryWriter writer(path);
+	if (!writer.isOpen()) return false;
+
+	writer.write(getHeader(sourceHash));
+	writer.writeArray(mesh.vertices);
+	writer.writeArray(mesh.indices);
+	return writer.commit();
+}
+
+uint64_t MeshCache::hashFile(const std::string& path) {
+	MappedFile file;
+	if (!file.open(path)) return 0;
+	return hashData(file.data(), file.size());
+}
+
+std::string MeshCache::getCachePath(const std::string& name) const {
+	return basepath + MESH_CACHE_PATH + name + MESH_CACHE_SUFFIX;
+}
+
+MeshCache::Header MeshCache::getHeader(uint64_t sourceHash) {
+	Header header{};
+	header.magic = MESH_CACHE_MAGIC;
+	header.version = MESH_CACHE_VERSION;
+	header.sourceHash = sourceHash;
+	return header;
+}
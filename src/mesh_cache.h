@@ -0,0 +1,35 @@
+#pragma once
+
+#include <string>
+#include <cstdint>
+
+#include "graphic/device.h"
+#include "graphic/mesh.h"
+
+
+// Preprocessed meshes in res/mesh, one file per source file holding the welded vertices
+// and the indices. Entries are keyed by a hash of the source file, an entry that does not
+// match is rebuilt and overwritten.
+class MeshCache {
+	public:
+		struct Header {
+			uint32_t magic;
+			uint32_t version;
+			uint64_t sourceHash;
+		};
+
+		MeshCache(const std::string& basepath);
+		~MeshCache();
+
+		// returns nullptr if there is no matching entry
+		Mesh* load(const std::string& name, uint64_t sourceHash, const Device* device) const;
+		bool save(const std::string& name, uint64_t sourceHash, const Mesh& mesh) const;
+
+		static uint64_t hashFile(const std::string& path);
+
+	private:
+		std::string getCachePath(const std::string& name) const;
+		static Header getHeader(uint64_t sourceHash);
+
+		std::string basepath;
+};
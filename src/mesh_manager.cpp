@@ -7,7 +7,7 @@ inline bool ends_with(std::string const & value, std::string const & ending) {
 
 
 MeshManager::MeshManager(Device* device, const std::string& basepath)
-:device(device), basepath(basepath), meshes(), createdObjects() {}
+:useMeshCache(true), device(device), basepath(basepath), meshCache(basepath), meshes(), createdObjects() {}
 
 MeshManager::~MeshManager() {
 	for (GraphicsObject* obj: createdObjects) delete obj;
@@ -19,8 +19,18 @@ Mesh* MeshManager::getMesh(const std::string& name) {
 		return meshes[name];
 	} else {
 		Mesh* mesh = nullptr;
-		if      (ends_with(name, ".obj")) mesh = loadObj(name);
-		else if (ends_with(name, ".stl")) mesh = loadStl(name);
+		uint64_t sourceHash = 0;
+		if (useMeshCache) {
+			sourceHash = MeshCache::hashFile(getSourcePath(name));
+			mesh = meshCache.load(name, sourceHash, device);
+		}
+
+		if (mesh == nullptr) {
+			if      (ends_with(name, ".obj")) mesh = loadObj(name);
+			else if (ends_with(name, ".stl")) mesh = loadStl(name);
+			if (useMeshCache && mesh != nullptr) meshCache.save(name, sourceHash, *mesh);
+		}
+
 		meshes[name] = mesh;
 		return mesh;
 	}
@@ -116,6 +126,11 @@ Mesh* MeshManager::loadObj(const std::string& filename) {
 	return mesh;
 }
 
+std::string MeshManager::getSourcePath(const std::string& filename) const {
+	if (ends_with(filename, ".stl")) return STLLoader(basepath).getFilePath(filename);
+	return ObjLoader(basepath).getFilePath(filename);
+}
+
 Mesh* MeshManager::loadStl(const std::string& filename) {
 	STLLoader loader(basepath);
 	loader.load(filename);
@@ -12,6 +12,7 @@
 #include "input_parser.h"
 #include "stl_loader.h"
 #include "obj_loader.h"
+#include "mesh_cache.h"
 
 #include "math/vector.h"
 #include "math/matrix.h"
@@ -39,13 +40,16 @@ class MeshManager {
 		std::vector<GraphicsObject*> getCreatedLightSources() const { return createdLightSources; }
 
 		ProbeData probeData;
+		bool useMeshCache;
 
 	private:
 		Mesh* loadObj(const std::string& filename);
 		Mesh* loadStl(const std::string& filename);
+		std::string getSourcePath(const std::string& filename) const;
 
 		Device* device;
 		std::string basepath;
+		MeshCache meshCache;
 
 		std::unordered_map<std::string, Mesh*> meshes;
 		std::vector<GraphicsObject*> createdObjects;
@@ -1,126 +1,236 @@
 #include "obj_loader.h"
 
+#include <thread>
+#include <charconv>
+
 #include "graphic/mesh.h"
+#include "mapped_file.h"
+#include "flat_hash_map.h"
 
 #define OBJ_PATH std::string("../res/obj/")
 #define MTL_PATH std::string("../res/obj/")
 
+#define OBJ_MIN_CHUNK_SIZE (1 << 20)
+
+
+static bool isSpace(char c) {
+	return c == ' ' || c == '\t' || c == '\r';
+}
+
+static const char* skipSpaces(const char* p, const char* end) {
+	while (p < end && isSpace(*p)) ++p;
+	return p;
+}
+
+static const char* skipLine(const char* p, const char* end) {
+	while (p < end && *p != '\n') ++p;
+	return p < end ? p + 1 : end;
+}
+
+static const char* parseFloat(const char* p, const char* end, float& value) {
+	p = skipSpaces(p, end);
+	if (p < end && *p == '+') ++p;
+
+	std::from_chars_result result = std::from_chars(p, end, value);
+	if (result.ec == std::errc()) return result.ptr;
+
+	// like atof unparsable values become 0, the token is skipped
+	value = 0.0f;
+	while (p < end && !isSpace(*p) && *p != '\n') ++p;
+	return p;
+}
+
+// OBJ indices start at 1, negative indices count back from the last element read so far.
+// Those are stored relative to the chunk, its offset is only known when merging.
+static const char* parseIndex(const char* p, const char* end, unsigned int elementCount, unsigned int& index, bool& relative) {
+	int value = 0;
+	std::from_chars_result result = std::from_chars(p, end, value);
+
+	relative = value < 0;
+	index = relative ? elementCount + value + 1 : value;
+	return result.ptr;
+}
+
+std::string parseName(const char* p, const char* end) {
+	p = skipSpaces(p, end);
+	const char* nameEnd = p;
+	while (nameEnd < end && *nameEnd != '\n') ++nameEnd;
+	while (nameEnd > p && isSpace(nameEnd[-1])) --nameEnd;
+	return std::string(p, nameEnd);
+}
+
+unsigned int& getIndex(ObjLoader::Vertex& vertex, unsigned int component) {
+	if (component == 0) return vertex.point;
+	if (component == 1) return vertex.texcoord;
+	return vertex.normal;
+}
+
+
+size_t ObjLoader::VertexHash::operator()(const Vertex& vertex) const {
+	uint64_t h = vertex.point * 0x9E3779B97F4A7C15ull;
+	h ^= vertex.texcoord * 0xC2B2AE3D27D4EB4Full;
+	h ^= vertex.normal * 0x165667B19E3779F9ull;
+	h ^= h >> 32;
+	return size_t(h);
+}
+
 ObjLoader::ObjLoader(const std::string& basepath)
-:points(), texcoords(), normals(), faces(),
+:points(), texcoords(), normals(), faceVertices(), faceOffsets(),
 materials(), usedMaterial(nullptr), basepath(basepath) {
 	std::pair<std::string, ObjLoader::Material> new_insert("none", ObjLoader::Material());
 	materials.insert(new_insert);
 }
 
 ObjLoader::~ObjLoader() {
-	
+
 }
 
 void ObjLoader::load(const std::string& name) {
-	std::ifstream file(basepath + OBJ_PATH + name);
-	if (!file.is_open()) {
+	MappedFile file;
+	if (!file.open(getFilePath(name))) {
 		SDL_LogError(SDL_LOG_CATEGORY_RENDER, "Could not load OBJ file %s", name.c_str());
 		return;
 	}
-	std::string line;
-
-	while (std::getline(file, line)) {
-		std::istringstream line_stream(line);
-		std::string mode;
 
-		std::getline(line_stream, mode, ' ');
+	const char* begin = file.data();
+	const char* end = begin + file.size();
 
-		if (mode == "mtllib") {
-			std::string name;
-			std::getline(line_stream, name);
-			loadMtl(name);
-		} else if (mode == "usemtl") {
-			std::string name;
-			std::getline(line_stream, name);
-			if (materials.count(name) > 0) {
-				usedMaterial = &materials[name];
-			} else {
-				usedMaterial = &materials["none"];
-			}
-		} else if (mode == "v") {
-			points.push_back(loadPoint(line_stream));
-		} else if (mode == "vt") {
-			texcoords.push_back(loadTexcoord(line_stream));
-		} else if (mode == "vn") {
-			normals.push_back(loadNormal(line_stream));
-		} else if (mode == "f") {
-			faces.push_back(loadFace(line_stream));
-		} 
+	// split at line ends into one chunk per thread, small files are parsed in one piece
+	size_t chunkCount = std::max(size_t(1), std::min(size_t(std::max(1u, std::thread::hardware_concurrency())), file.size() / OBJ_MIN_CHUNK_SIZE));
+	std::vector<const char*> bounds(chunkCount + 1, end);
+	bounds[0] = begin;
+	for (size_t i = 1; i < chunkCount; ++i) {
+		const char* bound = begin + i * (file.size() / chunkCount);
+		bounds[i] = skipLine(std::max(bound, bounds[i - 1]) - 1, end);
 	}
 
-	file.close();
-}
-
-Vector3f ObjLoader::loadPoint(std::istringstream& line_stream) {
-	std::string line;
-	Vector3f value;
+	std::vector<Chunk> chunks(chunkCount);
+	if (chunkCount == 1) {
+		parseChunk(begin, end, chunks[0]);
+	} else {
+		std::vector<std::thread> threads;
+		for (size_t i = 0; i < chunkCount; ++i) {
+			threads.push_back(std::thread(&ObjLoader::parseChunk, bounds[i], bounds[i + 1], std::ref(chunks[i])));
+		}
+		for (std::thread& th: threads) th.join();
+	}
 
-	std::getline(line_stream, line, ' ');
-	value[0] = std::atof(line.c_str());
-	std::getline(line_stream, line, ' ');
-	value[1] = std::atof(line.c_str());
-	std::getline(line_stream, line);
-	value[2] = std::atof(line.c_str());
+	size_t pointCount = points.size(), texcoordCount = texcoords.size(), normalCount = normals.size(), faceVertexCount = faceVertices.size(), faceCount = faceOffsets.size();
+	for (const Chunk& chunk: chunks) {
+		pointCount += chunk.points.size();
+		texcoordCount += chunk.texcoords.size();
+		normalCount += chunk.normals.size();
+		faceVertexCount += chunk.faceVertices.size();
+		faceCount += chunk.faceSizes.size();
+	}
+	points.reserve(pointCount);
+	texcoords.reserve(texcoordCount);
+	normals.reserve(normalCount);
+	faceVertices.reserve(faceVertexCount);
+	faceOffsets.reserve(faceCount + 1);
 
-	return value;
+	for (Chunk& chunk: chunks) mergeChunk(chunk);
 }
 
-Vector2f ObjLoader::loadTexcoord(std::istringstream& line_stream) {
-	std::string line;
-	Vector2f value;
-
-	std::getline(line_stream, line, ' ');
-	value[0] = std::atof(line.c_str());
-	std::getline(line_stream, line);
-	value[1] = 1.0f - std::atof(line.c_str());
-
-	return value;
+std::string ObjLoader::getFilePath(const std::string& name) const {
+	return basepath + OBJ_PATH + name;
 }
 
-Vector3f ObjLoader::loadNormal(std::istringstream& line_stream) {
-	std::string line;
-	Vector3f value;
+void ObjLoader::parseChunk(const char* begin, const char* end, Chunk& chunk) {
+	const char* p = begin;
+
+	while (p < end) {
+		p = skipSpaces(p, end);
+
+		const char* mode = p;
+		while (p < end && !isSpace(*p) && *p != '\n') ++p;
+		size_t modeLength = p - mode;
+
+		if (modeLength == 1 && mode[0] == 'v') {
+			Vector3f value;
+			p = parseFloat(p, end, value[0]);
+			p = parseFloat(p, end, value[1]);
+			p = parseFloat(p, end, value[2]);
+			chunk.points.push_back(value);
+		} else if (modeLength == 2 && mode[0] == 'v' && mode[1] == 't') {
+			Vector2f value;
+			p = parseFloat(p, end, value[0]);
+			p = parseFloat(p, end, value[1]);
+			value[1] = 1.0f - value[1];
+			chunk.texcoords.push_back(value);
+		} else if (modeLength == 2 && mode[0] == 'v' && mode[1] == 'n') {
+			Vector3f value;
+			p = parseFloat(p, end, value[0]);
+			p = parseFloat(p, end, value[1]);
+			p = parseFloat(p, end, value[2]);
+			chunk.normals.push_back(value);
+		} else if (modeLength == 1 && mode[0] == 'f') {
+			unsigned int faceSize = 0;
+
+			while (true) {
+				p = skipSpaces(p, end);
+				if (p >= end || *p == '\n' || *p == '#') break;
+
+				Vertex vertex = {0, 0, 0};
+				bool relative[3] = {false, false, false};
+				const char* start = p;
+				p = parseIndex(p, end, chunk.points.size(), vertex.point, relative[0]);
+				if (p < end && *p == '/') {
+					p = parseIndex(p + 1, end, chunk.texcoords.size(), vertex.texcoord, relative[1]);
+					if (p < end && *p == '/') p = parseIndex(p + 1, end, chunk.normals.size(), vertex.normal, relative[2]);
+				}
+
+				// skip whatever is left of a malformed vertex
+				while (p < end && !isSpace(*p) && *p != '\n') ++p;
+				if (p == start) break;
+
+				for (unsigned int c = 0; c < 3; ++c) {
+					if (relative[c]) chunk.relativeIndices.push_back(3 * chunk.faceVertices.size() + c);
+				}
+				chunk.faceVertices.push_back(vertex);
+				++faceSize;
+			}
 
-	std::getline(line_stream, line, ' ');
-	value[0] = std::atof(line.c_str());
-	std::getline(line_stream, line, ' ');
-	value[1] = std::atof(line.c_str());
-	std::getline(line_stream, line);
-	value[2] = std::atof(line.c_str());
+			chunk.faceSizes.push_back(faceSize);
+		} else if (std::string(mode, modeLength) == "mtllib" || std::string(mode, modeLength) == "usemtl") {
+			chunk.materialCommands.push_back({std::string(mode, modeLength), parseName(p, end)});
+		}
 
-	return value;
+		p = skipLine(p, end);
+	}
 }
 
-std::vector<ObjLoader::Vertex> ObjLoader::loadFace(std::istringstream& line_stream) {
-	std::vector<ObjLoader::Vertex> vertices;
-	std::string line;
+void ObjLoader::mergeChunk(Chunk& chunk) {
+	unsigned int offsets[3] = {(unsigned int) points.size(), (unsigned int) texcoords.size(), (unsigned int) normals.size()};
 
-	while (std::getline(line_stream, line, ' ')) {
-		std::istringstream face_stream(line);
+	points.insert(points.end(), chunk.points.begin(), chunk.points.end());
+	texcoords.insert(texcoords.end(), chunk.texcoords.begin(), chunk.texcoords.end());
+	normals.insert(normals.end(), chunk.normals.begin(), chunk.normals.end());
+	std::vector<Vector3f>().swap(chunk.points);
+	std::vector<Vector2f>().swap(chunk.texcoords);
+	std::vector<Vector3f>().swap(chunk.normals);
 
-		vertices.push_back(loadVertex(face_stream));
+	// relative indices may point into earlier chunks, so they are shifted with wrap around
+	for (size_t relativeIndex: chunk.relativeIndices) {
+		getIndex(chunk.faceVertices[relativeIndex / 3], relativeIndex % 3) += offsets[relativeIndex % 3];
 	}
+	faceVertices.insert(faceVertices.end(), chunk.faceVertices.begin(), chunk.faceVertices.end());
+	std::vector<Vertex>().swap(chunk.faceVertices);
 
-	return vertices;
-}
-
-ObjLoader::Vertex ObjLoader::loadVertex(std::istringstream& line_stream) {
-	std::string line;
-	Vertex vertex;
-
-	std::getline(line_stream, line, '/');
-	vertex.point = std::atoi(line.c_str());
-	std::getline(line_stream, line, '/');
-	vertex.texcoord = std::atoi(line.c_str());
-	std::getline(line_stream, line);
-	vertex.normal = std::atoi(line.c_str());
+	if (faceOffsets.empty()) faceOffsets.push_back(0);
+	for (unsigned int faceSize: chunk.faceSizes) {
+		faceOffsets.push_back(faceOffsets.back() + faceSize);
+	}
 
-	return vertex;
+	for (const std::pair<std::string, std::string>& command: chunk.materialCommands) {
+		if (command.first == "mtllib") {
+			loadMtl(command.second);
+		} else if (materials.count(command.second) > 0) {
+			usedMaterial = &materials[command.second];
+		} else {
+			usedMaterial = &materials["none"];
+		}
+	}
 }
 
 void ObjLoader::loadMtl(const std::string& name) {
@@ -157,27 +267,30 @@ void ObjLoader::loadMtl(const std::string& name) {
 
 Mesh* ObjLoader::get_mesh(const Device* device) const {
 	Mesh* mesh = new Mesh(device);
+	mesh->vertices.reserve(points.size());
 
-	std::map<ObjLoader::Vertex, unsigned int> unique_vertices;
-	for (std::vector<ObjLoader::Vertex> face: faces) {
-		for (ObjLoader::Vertex vertex: face) {
-			if (unique_vertices.count(vertex) == 0) {
-				Vector3f point = points.at(vertex.point - 1);
-				Vector3f normal = normals.at(vertex.normal - 1);
-				mesh->addPoint(point, normal);
-				unsigned int position = mesh->vertices.size() - 1;
+	FlatHashMap<ObjLoader::Vertex, unsigned int, ObjLoader::VertexHash> unique_vertices(points.size());
+	std::vector<unsigned int> vertex_indices(faceVertices.size());
 
-				unique_vertices.insert(std::pair<ObjLoader::Vertex, unsigned int>(vertex, position));
-			}
+	for (size_t i = 0; i < faceVertices.size(); ++i) {
+		const ObjLoader::Vertex& vertex = faceVertices[i];
+		bool inserted;
+		vertex_indices[i] = unique_vertices.insert(vertex, mesh->vertices.size(), inserted);
+
+		if (inserted) {
+			Vector3f point = points.at(vertex.point - 1);
+			Vector3f normal = normals.at(vertex.normal - 1);
+			mesh->addPoint(point, normal);
 		}
 	}
 
-	for (std::vector<ObjLoader::Vertex> face: faces) {
-		for (unsigned int i = 2; i < face.size(); ++i) {
+	for (size_t face = 0; face + 1 < faceOffsets.size(); ++face) {
+		unsigned int first = faceOffsets[face];
+		for (unsigned int i = first + 2; i < faceOffsets[face + 1]; ++i) {
 			mesh->addIndex(Vector3u({
-				unique_vertices.find(face.at(    0))->second,
-				unique_vertices.find(face.at(i - 1))->second,
-				unique_vertices.find(face.at(i    ))->second
+				vertex_indices[first],
+				vertex_indices[i - 1],
+				vertex_indices[i]
 			}));
 		}
 	}
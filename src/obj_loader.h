@@ -21,16 +21,15 @@ class ObjLoader {
 			unsigned int texcoord;
 			unsigned int normal;
 
-			bool operator<(const Vertex& other) const {
-				if (point < other.point) return true;
-				if (point > other.point) return false;
-				if (texcoord < other.texcoord) return true;
-				if (texcoord > other.texcoord) return false;
-				if (normal < other.normal) return true;
-				return false;
+			bool operator==(const Vertex& other) const {
+				return point == other.point && texcoord == other.texcoord && normal == other.normal;
 			}
 		};
 
+		struct VertexHash {
+			size_t operator()(const Vertex& vertex) const;
+		};
+
 		struct Material {
 			Material(): name(), imageName("no_texture.png") {}
 
@@ -42,20 +41,31 @@ class ObjLoader {
 		~ObjLoader();
 
 		void load(const std::string& name);
+		std::string getFilePath(const std::string& name) const;
 		Mesh* get_mesh(const Device* device) const;
 
 		std::vector<Vector3f> points;
 		std::vector<Vector2f> texcoords;
 		std::vector<Vector3f> normals;
-		std::vector<std::vector<Vertex>> faces;
+		// the vertices of face i are faceVertices[faceOffsets[i]] up to faceVertices[faceOffsets[i + 1]]
+		std::vector<Vertex> faceVertices;
+		std::vector<unsigned int> faceOffsets;
 		std::map<std::string, Material> materials;
 		Material* usedMaterial;
 	private:
-		Vector3f loadPoint(std::istringstream& line_stream);
-		Vector2f loadTexcoord(std::istringstream& line_stream);
-		Vector3f loadNormal(std::istringstream& line_stream);
-		std::vector<Vertex> loadFace(std::istringstream& line_stream);
-		Vertex loadVertex(std::istringstream& line_stream);
+		// result of parsing one part of the file, relative indices are resolved when merging
+		struct Chunk {
+			std::vector<Vector3f> points;
+			std::vector<Vector2f> texcoords;
+			std::vector<Vector3f> normals;
+			std::vector<Vertex> faceVertices;
+			std::vector<unsigned int> faceSizes;
+			std::vector<size_t> relativeIndices;
+			std::vector<std::pair<std::string, std::string>> materialCommands;
+		};
+
+		static void parseChunk(const char* begin, const char* end, Chunk& chunk);
+		void mergeChunk(Chunk& chunk);
 
 		void loadMtl(const std::string& name);
 
@@ -1,119 +1,194 @@
 #include "stl_loader.h"
 
+#include <cstring>
+#include <thread>
+#include <functional>
+
+#include "flat_hash_map.h"
+
 #define ANGLE_THREASHOLD 1.0/3.0 * M_PI
 
 #define STL_PATH std::string("../res/stl/")
+#define STL_HEADER_SIZE 84
+#define STL_MIN_PARALLEL_COUNT 65536
+
+
+static_assert(sizeof(STLLoader::RawTriangle) == 50, "STL triangle records are 50 bytes");
+
+static bool fits(const Vector3f& n1, const Vector3f& n2, float cos_threshold) {
+	return n1.dot(n2) > cos_threshold * std::sqrt(n1.dot(n1) * n2.dot(n2));
+}
+
+// Splits [0, count) into one range per hardware thread, small counts run on the calling thread.
+static void parallelFor(size_t count, const std::function<void(size_t, size_t)>& body) {
+	size_t threadCount = std::max(1u, std::thread::hardware_concurrency());
+	if (count < STL_MIN_PARALLEL_COUNT || threadCount == 1) {
+		body(0, count);
+		return;
+	}
+
+	std::vector<std::thread> threads;
+	for (size_t t = 0; t < threadCount; ++t) {
+		threads.push_back(std::thread(body, t * count / threadCount, (t + 1) * count / threadCount));
+	}
+	for (std::thread& th: threads) th.join();
+}
 
 
+size_t STLLoader::PositionHash::operator()(const Vector3f& pos) const {
+	uint64_t h = 0;
+	for (size_t i = 0; i < 3; ++i) {
+		// adding 0 turns -0 into 0, which compares equal and has to hash equal
+		float value = pos[i] + 0.0f;
+		uint32_t bits;
+		std::memcpy(&bits, &value, sizeof(bits));
+		h = (h ^ bits) * 0x9E3779B97F4A7C15ull;
+	}
+	return size_t(h ^ (h >> 32));
+}
+
 STLLoader::STLLoader(const std::string& basepath)
-:header(), triangle_count(), triangles(), basepath(basepath) {}
+:header(), triangle_count(0), file(), raw_triangles(nullptr), basepath(basepath) {}
 
 STLLoader::~STLLoader() {}
 
-bool fits(Vector3f n1, Vector3f n2) {
-	float angle = n1.angle(n2);
-	return angle < ANGLE_THREASHOLD;
+void STLLoader::load(const std::string& path) {
+	loadFile(getFilePath(path));
 }
 
-void STLLoader::load(const std::string& path) {
-	triangles.clear();
+std::string STLLoader::getFilePath(const std::string& path) const {
+	return basepath + STL_PATH + path;
+}
 
-	std::ifstream file(STL_PATH + path, std::ifstream::in | std::ifstream::binary);
+void STLLoader::loadFile(const std::string& filePath) {
+	triangle_count = 0;
 
-	file.read((char*) header, 80);
-	file.read((char*) &triangle_count, 4);
+	if (!file.open(filePath)) {
+		SDL_LogError(SDL_LOG_CATEGORY_RENDER, "Could not load STL file %s", filePath.c_str());
+		return;
+	}
 
-	for (size_t i = 0; i < triangle_count; ++i) {
-		RawTriangle raw;
-		file.read((char*) &raw, sizeof(RawTriangle));
+	if (file.size() < STL_HEADER_SIZE) {
+		SDL_LogError(SDL_LOG_CATEGORY_RENDER, "STL file %s has no header", filePath.c_str());
+		return;
+	}
+	std::memcpy(header, file.data(), 80);
+	std::memcpy(&triangle_count, file.data() + 80, 4);
 
-		Triangle triangle;
-		triangle.normal = Vector3f({raw.normal[0], raw.normal[2], raw.normal[1]});
-		for (size_t i = 0; i < 3; ++i) {
-			triangle.vertex[i] = Vector3f({raw.vertex[i][0], raw.vertex[i][2], raw.vertex[i][1]});
-		}
-		triangles.push_back(triangle);
+	if (file.size() < STL_HEADER_SIZE + size_t(triangle_count) * sizeof(RawTriangle)) {
+		SDL_LogError(SDL_LOG_CATEGORY_RENDER, "STL file %s is truncated", filePath.c_str());
+		triangle_count = 0;
+		return;
 	}
+	raw_triangles = reinterpret_cast<const RawTriangle*>(file.data() + STL_HEADER_SIZE);
+}
+
+Vector3f STLLoader::getNormal(size_t triangle_index) const {
+	const RawTriangle& raw = raw_triangles[triangle_index];
+	return Vector3f({raw.normal[0], raw.normal[2], raw.normal[1]});
+}
 
-	file.close();
+Vector3f STLLoader::getVertex(size_t triangle_index, unsigned int vertex_index) const {
+	const RawTriangle& raw = raw_triangles[triangle_index];
+	return Vector3f({raw.vertex[vertex_index][0], raw.vertex[vertex_index][2], raw.vertex[vertex_index][1]});
 }
 
 Mesh* STLLoader::get_mesh(const Device* device) const {
 	Mesh* mesh = new Mesh(device);
+	size_t corner_count = 3 * size_t(triangle_count);
+	const float cos_threshold = std::cos(ANGLE_THREASHOLD);
+
+	// weld the corners with equal positions
+	std::vector<Vector3f> positions;
+	std::vector<uint32_t> corner_positions(corner_count);
+	FlatHashMap<Vector3f, uint32_t, PositionHash> position_indices(corner_count / 4);
+
+	for (size_t corner = 0; corner < corner_count; ++corner) {
+		Vector3f pos = getVertex(corner / 3, corner % 3);
+		bool inserted;
+		corner_positions[corner] = position_indices.insert(pos, positions.size(), inserted);
+		if (inserted) positions.push_back(pos);
+	}
 
-	std::unordered_map<Vector3f, std::vector<TrianglePoint>> pre_groups;
-	std::vector<std::pair<Vector3f, std::vector<TrianglePoint>>> post_groups;
-	std::vector<IndexedTriangle> indexed_triangles(triangles.size());
+	// corners of position p are position_corners[position_offsets[p]] up to position_corners[position_offsets[p + 1]]
+	std::vector<uint32_t> position_offsets(positions.size() + 1, 0);
+	for (uint32_t position: corner_positions) ++position_offsets[position + 1];
+	for (size_t p = 0; p < positions.size(); ++p) position_offsets[p + 1] += position_offsets[p];
 
-	for (unsigned int triangle_index = 0; triangle_index < triangles.size(); ++triangle_index) {
-		const Triangle* triangle = &triangles.at(triangle_index);
-		
-		for (unsigned int i = 0; i < 3; ++i) {
-			Vector3f pos = triangle->vertex[i];
+	std::vector<uint32_t> position_corners(corner_count);
+	std::vector<uint32_t> fill_offsets(position_offsets.begin(), position_offsets.end() - 1);
+	for (size_t corner = 0; corner < corner_count; ++corner) {
+		position_corners[fill_offsets[corner_positions[corner]]++] = corner;
+	}
 
-			if (pre_groups.count(pos) == 0) {
-				pre_groups.insert({pos, {}});
-			}
+	// Split every position into groups of corners with similar normals. The last corner
+	// opens the first group, every other corner joins the first group whose opening
+	// normal is within the angle threshold or opens a new one.
+	std::vector<uint32_t> corner_groups(corner_count);
+	std::vector<uint32_t> vertex_offsets(positions.size() + 1, 0);
 
-			TrianglePoint tp;
-			tp.triangle = triangle;
-			tp.pos = pos;
-			tp.vertex_index = i;
-			tp.triangle_index = triangle_index;
-			pre_groups[pos].push_back(tp);
-		}
+	parallelFor(positions.size(), [&](size_t begin, size_t end) {
+		std::vector<Vector3f> group_normals;
 
-		indexed_triangles.at(triangle_index).triangle = triangle;
-	}
+		for (size_t p = begin; p < end; ++p) {
+			const uint32_t* corners = position_corners.data() + position_offsets[p];
+			size_t count = position_offsets[p + 1] - position_offsets[p];
 
-	for (const std::pair<Vector3f, std::vector<TrianglePoint>> kv: pre_groups) {
-		const Vector3f pos = kv.first;
-		std::vector<TrianglePoint> pre_triangles = kv.second;
-
-		std::vector<std::vector<TrianglePoint>> post_triangles(0);
-		post_triangles.push_back({pre_triangles.back()});
-		pre_triangles.pop_back();
-
-		for (TrianglePoint& pre_tp: pre_triangles) {
-			bool is_added = false;
-			for (std::vector<TrianglePoint>& tp_group: post_triangles) {
-				if (fits(tp_group.at(0).triangle->normal, pre_tp.triangle->normal)) {
-					tp_group.push_back(pre_tp);
-					is_added = true;
-					break;
-				}
-			}
-			if (!is_added) {
-				post_triangles.push_back({pre_tp});
+			group_normals.clear();
+			group_normals.push_back(getNormal(corners[count - 1] / 3));
+			corner_groups[corners[count - 1]] = 0;
+
+			for (size_t i = 0; i + 1 < count; ++i) {
+				Vector3f normal = getNormal(corners[i] / 3);
+
+				size_t group = 0;
+				while (group < group_normals.size() && !fits(group_normals[group], normal, cos_threshold)) ++group;
+				if (group == group_normals.size()) group_normals.push_back(normal);
+
+				corner_groups[corners[i]] = group;
 			}
-		}
 
-		for (std::vector<TrianglePoint>& tp_group: post_triangles) {
-			post_groups.push_back({pos, tp_group});
+			vertex_offsets[p + 1] = group_normals.size();
 		}
-	}
+	});
 
-	unsigned int index = 0;
-	for (const std::pair<Vector3f, std::vector<TrianglePoint>> kv: post_groups) {
-		const Vector3f pos = kv.first;
-		std::vector<TrianglePoint> group_triangles = kv.second;
+	for (size_t p = 0; p < positions.size(); ++p) vertex_offsets[p + 1] += vertex_offsets[p];
 
-		Vector3f normal;
-		for (TrianglePoint tp: group_triangles) {
-			normal += tp.triangle->normal;
-		}
-		normal /= group_triangles.size();
+	// every group becomes a vertex with the average normal of its triangles, summed in group order
+	std::vector<Vector3f> vertex_normals(vertex_offsets.back());
+	std::vector<uint32_t> vertex_sizes(vertex_offsets.back(), 0);
+
+	parallelFor(positions.size(), [&](size_t begin, size_t end) {
+		for (size_t p = begin; p < end; ++p) {
+			auto addCorner = [&](uint32_t corner) {
+				uint32_t vertex = vertex_offsets[p] + corner_groups[corner];
+				vertex_normals[vertex] += getNormal(corner / 3);
+				++vertex_sizes[vertex];
+			};
 
-		mesh->addPoint(pos, normal);
-		for (TrianglePoint tp: group_triangles) {
-			IndexedTriangle& it = indexed_triangles.at(tp.triangle_index);
-			it.indexes[tp.vertex_index] = index;
+			uint32_t last = position_offsets[p + 1] - 1;
+			addCorner(position_corners[last]);
+			for (uint32_t i = position_offsets[p]; i < last; ++i) addCorner(position_corners[i]);
+		}
+	});
+
+	mesh->vertices.reserve(vertex_normals.size());
+	for (size_t p = 0; p < positions.size(); ++p) {
+		for (uint32_t vertex = vertex_offsets[p]; vertex < vertex_offsets[p + 1]; ++vertex) {
+			Vector3f normal = vertex_normals[vertex];
+			normal /= float(vertex_sizes[vertex]);
+			mesh->addPoint(positions[p], normal);
 		}
-		++index;
 	}
 
-	for (const IndexedTriangle& it: indexed_triangles) {
-		mesh->addIndex(it.indexes);
+	mesh->indices.reserve(corner_count);
+	for (size_t triangle_index = 0; triangle_index < triangle_count; ++triangle_index) {
+		Vector3u indexes;
+		for (unsigned int i = 0; i < 3; ++i) {
+			size_t corner = 3 * triangle_index + i;
+			indexes[i] = vertex_offsets[corner_positions[corner]] + corner_groups[corner];
+		}
+		mesh->addIndex(indexes);
 	}
 
 	mesh->init();